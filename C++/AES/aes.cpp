@@ -1,275 +1,584 @@
 #include "aes_config.h"
 #include "aes.h"
+#include "aes_ni.h"
+#include "aes_bitslice.h"
+#include "aes_key_cache.h"
+#include "aes_progress.h"
+#include "aes_internal.h"
+
+//
+void AES_SecureZero(void* data, size_t length) {
+	volatile uint8_t* p = (volatile uint8_t*)data;
+	while (length--)
+		*p++ = 0;
+}
+
+//Big-endian word access for the T-table engine
+#define GETU32(p)		(((uint32_t)(p)[0] << 24) ^ ((uint32_t)(p)[1] << 16) ^ ((uint32_t)(p)[2] << 8) ^ ((uint32_t)(p)[3]))
+#define PUTU32(p, v)	{ (p)[0] = (uint8_t)((v) >> 24); (p)[1] = (uint8_t)((v) >> 16); (p)[2] = (uint8_t)((v) >> 8); (p)[3] = (uint8_t)(v); }
+
+//Single S-box lookups for the last round of the T-table engine
+#define SBOX(x)			((uint32_t)sBox[x])
+#define SBOX_INV(x)		((uint32_t)sBoxInv[x])
+
+//T-table engine steps on one block held in four column words (s, t: uint32_t[4], rk: current key stage)
+#define TTABLE_LOAD(s, block, rk) \
+	s[0] = GETU32(block) ^ rk[0]; s[1] = GETU32(block + 4) ^ rk[1]; s[2] = GETU32(block + 8) ^ rk[2]; s[3] = GETU32(block + 12) ^ rk[3];
+
+#define TTABLE_STORE(block, t) \
+	PUTU32(block, t[0]); PUTU32(block + 4, t[1]); PUTU32(block + 8, t[2]); PUTU32(block + 12, t[3]);
+
+#define TTABLE_ENC_ROUND(t, s, rk) \
+	t[0] = Te0[s[0] >> 24] ^ Te1[(s[1] >> 16) & 0xFF] ^ Te2[(s[2] >> 8) & 0xFF] ^ Te3[s[3] & 0xFF] ^ rk[0]; \
+	t[1] = Te0[s[1] >> 24] ^ Te1[(s[2] >> 16) & 0xFF] ^ Te2[(s[3] >> 8) & 0xFF] ^ Te3[s[0] & 0xFF] ^ rk[1]; \
+	t[2] = Te0[s[2] >> 24] ^ Te1[(s[3] >> 16) & 0xFF] ^ Te2[(s[0] >> 8) & 0xFF] ^ Te3[s[1] & 0xFF] ^ rk[2]; \
+	t[3] = Te0[s[3] >> 24] ^ Te1[(s[0] >> 16) & 0xFF] ^ Te2[(s[1] >> 8) & 0xFF] ^ Te3[s[2] & 0xFF] ^ rk[3];
+
+//Last round without MixColumns
+#define TTABLE_ENC_LAST(t, s, rk) \
+	t[0] = (SBOX(s[0] >> 24) << 24) ^ (SBOX((s[1] >> 16) & 0xFF) << 16) ^ (SBOX((s[2] >> 8) & 0xFF) << 8) ^ SBOX(s[3] & 0xFF) ^ rk[0]; \
+	t[1] = (SBOX(s[1] >> 24) << 24) ^ (SBOX((s[2] >> 16) & 0xFF) << 16) ^ (SBOX((s[3] >> 8) & 0xFF) << 8) ^ SBOX(s[0] & 0xFF) ^ rk[1]; \
+	t[2] = (SBOX(s[2] >> 24) << 24) ^ (SBOX((s[3] >> 16) & 0xFF) << 16) ^ (SBOX((s[0] >> 8) & 0xFF) << 8) ^ SBOX(s[1] & 0xFF) ^ rk[2]; \
+	t[3] = (SBOX(s[3] >> 24) << 24) ^ (SBOX((s[0] >> 16) & 0xFF) << 16) ^ (SBOX((s[1] >> 8) & 0xFF) << 8) ^ SBOX(s[2] & 0xFF) ^ rk[3];
+
+#define TTABLE_DEC_ROUND(t, s, rk) \
+	t[0] = Td0[s[0] >> 24] ^ Td1[(s[3] >> 16) & 0xFF] ^ Td2[(s[2] >> 8) & 0xFF] ^ Td3[s[1] & 0xFF] ^ rk[0]; \
+	t[1] = Td0[s[1] >> 24] ^ Td1[(s[0] >> 16) & 0xFF] ^ Td2[(s[3] >> 8) & 0xFF] ^ Td3[s[2] & 0xFF] ^ rk[1]; \
+	t[2] = Td0[s[2] >> 24] ^ Td1[(s[1] >> 16) & 0xFF] ^ Td2[(s[0] >> 8) & 0xFF] ^ Td3[s[3] & 0xFF] ^ rk[2]; \
+	t[3] = Td0[s[3] >> 24] ^ Td1[(s[2] >> 16) & 0xFF] ^ Td2[(s[1] >> 8) & 0xFF] ^ Td3[s[0] & 0xFF] ^ rk[3];
+
+//Last round without InvMixColumns
+#define TTABLE_DEC_LAST(t, s, rk) \
+	t[0] = (SBOX_INV(s[0] >> 24) << 24) ^ (SBOX_INV((s[3] >> 16) & 0xFF) << 16) ^ (SBOX_INV((s[2] >> 8) & 0xFF) << 8) ^ SBOX_INV(s[1] & 0xFF) ^ rk[0]; \
+	t[1] = (SBOX_INV(s[1] >> 24) << 24) ^ (SBOX_INV((s[0] >> 16) & 0xFF) << 16) ^ (SBOX_INV((s[3] >> 8) & 0xFF) << 8) ^ SBOX_INV(s[2] & 0xFF) ^ rk[1]; \
+	t[2] = (SBOX_INV(s[2] >> 24) << 24) ^ (SBOX_INV((s[1] >> 16) & 0xFF) << 16) ^ (SBOX_INV((s[0] >> 8) & 0xFF) << 8) ^ SBOX_INV(s[3] & 0xFF) ^ rk[2]; \
+	t[3] = (SBOX_INV(s[3] >> 24) << 24) ^ (SBOX_INV((s[2] >> 16) & 0xFF) << 16) ^ (SBOX_INV((s[1] >> 8) & 0xFF) << 8) ^ SBOX_INV(s[0] & 0xFF) ^ rk[3];
+
+//
+AESKeySchedule::AESKeySchedule(const char* key) {
+	uint8_t keyArr[16] = { 0 };
+
+	for (uint8_t i = 0; i < 16 && key[i] != '\0'; i++)
+		keyArr[i] = (uint8_t)key[i];
+
+	CalculateKeys(keyArr, 16);
+	AES_SecureZero(keyArr, sizeof(keyArr));
+}
+
+//
+AESKeySchedule::~AESKeySchedule() {
+	AES_SecureZero(cryptoKex, sizeof(cryptoKex));
+	AES_SecureZero(cryptoKexInv, sizeof(cryptoKexInv));
+	AES_SecureZero(cryptoKexWords, sizeof(cryptoKexWords));
+	AES_SecureZero(cryptoKexWordsInv, sizeof(cryptoKexWordsInv));
+	AES_SecureZero(cryptoKexBitslice, sizeof(cryptoKexBitslice));
+}
+
+//
+bool AESKeySchedule::MatchesKey(const uint8_t* key, size_t keyLength) const {
+	if (key == NULL || keyLength != ((size_t)rounds - 6) * 4)	return false;
+
+	uint8_t diff = 0;
+	for (size_t i = 0; i < keyLength; i++)
+		diff |= cryptoKex[0][i] ^ key[i];
+
+	return diff == 0;
+}
+
+//
+std::shared_ptr<const AESKeySchedule> AESKeySchedule::Create(const uint8_t* key, size_t keyLength) {
+	if (key == NULL || (keyLength != 16 && keyLength != 24 && keyLength != 32))		return NULL;
+
+	std::shared_ptr<AESKeySchedule> keySchedule = std::make_shared<AESKeySchedule>();
+	keySchedule->CalculateKeys(key, keyLength);
+
+	return keySchedule;
+}
+
+//
+const std::shared_ptr<const AESKeySchedule>& AESKeySchedule::Empty() {
+	static const std::shared_ptr<const AESKeySchedule> emptySchedule = std::make_shared<const AESKeySchedule>();
+	return emptySchedule;
+}
+
+//
+AES::AES(std::shared_ptr<const AESKeySchedule> keySchedule) {
+	SetKeySchedule(keySchedule);
+}
 
 //
 void AES::Init(char* key) {
-	CalculateKeys(key);
+	keySchedule = keyCache ? keyCache->Get(key) : std::make_shared<const AESKeySchedule>(key);
 }
 
 //
 void AES::ChangeSecretKey(char* key) {
-	CalculateKeys(key);
+	keySchedule = keyCache ? keyCache->Get(key) : std::make_shared<const AESKeySchedule>(key);
 }
 
 //
-void AES::EncryptBlock(uint8_t* block) {
-	if (block == NULL)		return;
+bool AES::Init(const uint8_t* key, size_t keyLength) {
+	std::shared_ptr<const AESKeySchedule> newSchedule = keyCache ? keyCache->Get(key, keyLength) : AESKeySchedule::Create(key, keyLength);
+	if (!newSchedule)	return false;
 
-	AddRoundKey(block, 0);
-	for (uint8_t i = 1; i < 10; i++)
-	{
-		SubBytes(block);
-		ShiftRowsLeft(block);
-		MixColumns(block);
-		AddRoundKey(block, i);
-	}
-	SubBytes(block);
-	ShiftRowsLeft(block);
-	AddRoundKey(block, 10);
+	keySchedule = newSchedule;
+	return true;
 }
 
 //
-void AES::EncryptStreamOrigin(uint8_t* stream, size_t length) {
-	if (stream == NULL)		return;
-	size_t blcks = length / 16;
-	for (size_t i = 0; i < blcks; i++)
-		EncryptBlock(stream + i * 16);
+void AES::SetKeySchedule(std::shared_ptr<const AESKeySchedule> keySchedule) {
+	this->keySchedule = keySchedule ? keySchedule : AESKeySchedule::Empty();
 }
 
 //
-void AES::EncryptStream(uint8_t* src, uint8_t* dst, size_t length) {
-	if (src == NULL || dst == NULL)		return;
-	memcpy(dst, src, length);
-	EncryptStreamOrigin(dst, length);
+std::shared_ptr<const AESKeySchedule> AES::GetKeySchedule() const {
+	return keySchedule;
 }
 
 //
-uint8_t* AES::Encrypt(uint8_t* src, size_t length, size_t* streamLength, bool attachPadding) {
-	if (src == NULL || length < 1)	return NULL;		//Define error	->	NULL src or length
+void AES::SetKeyCache(std::shared_ptr<AESKeyCache> keyCache) {
+	this->keyCache = keyCache;
+}
 
-	*streamLength = length + (attachPadding ? ((length & 0x0F) == 0 ? 0x10 : 16 - (length & 0x0F)) : length);
+//
+std::shared_ptr<AESKeyCache> AES::GetKeyCache() const {
+	return keyCache;
+}
 
-	uint8_t* dstStream = (uint8_t*)malloc((*streamLength) * sizeof(uint8_t));
-	if (dstStream == NULL)	return dstStream;			//Define error	->	Mem. allocation falied
+//
+bool AES::SetEngine(AES_ENGINE engine) {
+	if (engine == AES_ENGINE_AESNI && !AESNI_Supported())			return false;
+	if (engine == AES_ENGINE_BITSLICE && !Bitslice_Supported())		return false;
+	this->engine = engine;
+	return true;
+}
 
-	memcpy(dstStream, src, length);
+//
+AES_ENGINE AES::GetEngine() const {
+	return engine;
+}
 
-	//Padding the data with #PKCS7
-	if (attachPadding)
-		for (size_t i = (*streamLength) - 1; i >= length; i--)
-			dstStream[i] = ((length & 0x0F) == 0 ? 0x10 : 16 - (length & 0x0F));
+//
+void AES::SetThreadNum(int threadNum) {
+	this->threadNum = threadNum < 0 ? 0 : threadNum;
+}
 
-	EncryptStreamOrigin(dstStream, *streamLength);
+//
+void AES::SetParallelMinSize(size_t minSize) {
+	parallelMinSize = minSize;
+}
 
-	return dstStream;
+//
+void AES::SetFileMode(AES_FILE_MODE fileMode) {
+	this->fileMode = fileMode;
 }
 
 //
-int AES::EncryptFileToFile(char* inputFileName, char* outputFileName) {
+AES_FILE_MODE AES::GetFileMode() const {
+	return fileMode;
+}
 
-	if (inputFileName == NULL || outputFileName == NULL)	return 0x0A;
+//
+void AES::SetFileQueueDepth(uint32_t depth) {
+	if (depth < 1)							depth = 1;
+	if (depth > AES_FILE_URING_MAX_DEPTH)	depth = AES_FILE_URING_MAX_DEPTH;
+	fileQueueDepth = depth;
+}
 
-	FILE* inputFile;
-	fopen_s(&inputFile, inputFileName, "rb");
-	if (inputFile == NULL)		return 0x01;		//Error while opening source file
+//
+uint32_t AES::GetFileQueueDepth() const {
+	return fileQueueDepth;
+}
 
-	//Input file's length in bytes
-	size_t streamLen = GetFileSizeBytes(inputFile);
-	if (streamLen < 1)			return 0x02;
+//
+void AES::SetObserver(std::shared_ptr<AESObserver> observer) {
+	this->observer = observer;
+}
 
-	//Create output file
-	FILE* outputFile;
-	fopen_s(&outputFile, outputFileName, "wb");
-	if (outputFile == NULL)		return 0x03;		//Error creating output file
+//
+std::shared_ptr<AESObserver> AES::GetObserver() const {
+	return observer;
+}
 
-	//The maximum ammount of data (bytes) to work on at once
-	size_t dataChunkSize = (streamLen > AES_MAX_BUFFER_SIZE ? AES_MAX_BUFFER_SIZE : streamLen);
+//
+AES_ENGINE AES::DefaultEngine() {
+	static const AES_ENGINE defaultEngine = AESNI_Supported() ? AES_ENGINE_AESNI : AES_ENGINE_TTABLE;
+	return defaultEngine;
+}
 
-	size_t encryptedChunkSize = 0;
+//
+void AES::EncryptBlock(uint8_t* block) const {
+	if (block == NULL)		return;
 
-	//Encrypting without padding
-	while (streamLen > dataChunkSize) {
+	const AESKeySchedule* ks = keySchedule.get();
 
-		//Store data from file
-		uint8_t* rawData = (uint8_t*)malloc(dataChunkSize * sizeof(uint8_t));
+	if (engine == AES_ENGINE_AESNI) {
+		AESNI_EncryptBlocks(ks->cryptoKex[0], ks->rounds, block, block, 1);
+		return;
+	}
 
-		//Read data from file into buffer
-		fread(rawData, sizeof(uint8_t), dataChunkSize, inputFile);
+	if (engine == AES_ENGINE_BITSLICE) {
+		Bitslice_EncryptBlocks(ks->cryptoKexBitslice[0], ks->rounds, block, block, 1);
+		return;
+	}
 
-		uint8_t* encryptedData = Encrypt(rawData, dataChunkSize, &encryptedChunkSize, false);
+	//One switch on the key size per call, the rounds themselves are specialized
+	switch (ks->rounds) {
+	case 12:
+		engine == AES_ENGINE_TTABLE ? EncryptBlockTTable<12>(block, block) : EncryptBlockReference<12>(block);
+		break;
+	case 14:
+		engine == AES_ENGINE_TTABLE ? EncryptBlockTTable<14>(block, block) : EncryptBlockReference<14>(block);
+		break;
+	default:
+		engine == AES_ENGINE_TTABLE ? EncryptBlockTTable<10>(block, block) : EncryptBlockReference<10>(block);
+		break;
+	}
+}
 
-		//Don't need this anymore
-		free(rawData);
+//
+template<uint8_t Rounds>
+void AES::EncryptBlockReference(uint8_t* block) const {
+	AddRoundKey(block, 0);
+	for (uint8_t i = 1; i < Rounds; i++)
+	{
+		SubBytes(block);
+		ShiftRowsLeft(block);
+		MixColumns(block);
+		AddRoundKey(block, i);
+	}
+	SubBytes(block);
+	ShiftRowsLeft(block);
+	AddRoundKey(block, Rounds);
+}
 
-		fwrite(encryptedData, sizeof(uint8_t), dataChunkSize, outputFile);
-		fflush(outputFile);
+//
+void AES::EncryptBlocks(uint8_t* blocks, size_t blockCount) const {
+	EncryptBlocks(blocks, blocks, blockCount);
+}
 
-		encryptedChunkSize = 0;
+//
+void AES::EncryptBlocks(const uint8_t* src, uint8_t* dst, size_t blockCount) const {
+	if (src == NULL || dst == NULL)		return;
 
-		streamLen -= dataChunkSize;
+	const AESKeySchedule* ks = keySchedule.get();
 
-		//Free up memory
-		free(encryptedData);
+	switch (engine) {
+	case AES_ENGINE_AESNI:
+		AESNI_EncryptBlocks(ks->cryptoKex[0], ks->rounds, src, dst, blockCount);
+		break;
+	case AES_ENGINE_BITSLICE:
+		Bitslice_EncryptBlocks(ks->cryptoKexBitslice[0], ks->rounds, src, dst, blockCount);
+		break;
+	case AES_ENGINE_TTABLE:
+		if (ks->rounds == 12)			EncryptBlocksTTable<12>(src, dst, blockCount);
+		else if (ks->rounds == 14)		EncryptBlocksTTable<14>(src, dst, blockCount);
+		else							EncryptBlocksTTable<10>(src, dst, blockCount);
+		break;
+	default:
+		for (size_t i = 0; i < blockCount; i++) {
+			if (src != dst)
+				memcpy(dst + i * 16, src + i * 16, 16);
+			EncryptBlock(dst + i * 16);
+		}
+		break;
 	}
+}
+
+//
+bool AES::EncryptStreamOrigin(uint8_t* stream, size_t length) const {
+	return EncryptStream(stream, stream, length);
+}
+
+//
+bool AES::EncryptStream(const uint8_t* src, uint8_t* dst, size_t length) const {
+	if (src == NULL || dst == NULL)		return true;
+
+	size_t blcks = length / 16;
 
-	//Last round with padding
-	uint8_t* rawData = (uint8_t*)malloc(streamLen * sizeof(uint8_t));
+	//Every thread works on cache sized block ranges, ECB has no dependency between them
+	if (UseChunks(length))
+		return CryptChunks(blcks * 16, [&](size_t first, size_t bytes) { EncryptBlocks(src + first, dst + first, bytes / 16); });
+
+	EncryptBlocks(src, dst, blcks);
+	return true;
+}
+
+//
+uint8_t* AES::Encrypt(uint8_t* src, size_t length, size_t* streamLength, bool attachPadding) const {
+	if (src == NULL || length < 1)	return NULL;		//Define error	->	NULL src or length
+
+	*streamLength = PaddedLength(length, attachPadding);
+
+	uint8_t* dstStream = (uint8_t*)malloc((*streamLength) * sizeof(uint8_t));
+	if (dstStream == NULL)	return dstStream;			//Define error	->	Mem. allocation falied
 
-	//Read data from file into buffer
-	fread_s(rawData, streamLen * sizeof(uint8_t), sizeof(uint8_t), streamLen, inputFile);
+	if (attachPadding) {
+		if (EncryptInto(src, length, dstStream, *streamLength, streamLength, true) != 0x00) { free(dstStream); return NULL; }		//Define error	->	Cancelled
+		return dstStream;
+	}
 
-	uint8_t* encryptedData = Encrypt(rawData, streamLen, &encryptedChunkSize, true);
+	//Without padding a partial last block is copied as it is
+	if (!EncryptStream(src, dstStream, length)) { free(dstStream); return NULL; }		//Define error	->	Cancelled
+	memcpy(dstStream + (length & ~(size_t)0x0F), src + (length & ~(size_t)0x0F), length & 0x0F);
 
-	fwrite(encryptedData, sizeof(uint8_t), encryptedChunkSize, outputFile);
-	fflush(outputFile);
+	return dstStream;
+}
 
-	free(rawData);
-	free(encryptedData);
+//
+size_t AES::GetEncryptedSize(size_t length, bool attachPadding) {
+	return PaddedLength(length, attachPadding);
+}
 
-	//Close files
-	fclose(outputFile);
-	fclose(inputFile);
+//
+int AES::EncryptInto(const uint8_t* src, size_t length, uint8_t* dst, size_t dstSize, size_t* dstLength, bool attachPadding) const {
+	if (src == NULL || dst == NULL || dstLength == NULL)	return 0x01;		//Define error	->	NULL pointer
+	if (!attachPadding && (length & 0x0F) != 0)				return 0x03;		//Define error	->	Length is not a multiple of 16
+
+	size_t paddedLength = PaddedLength(length, attachPadding);
+	if (dstSize < paddedLength)								return 0x02;		//Define error	->	Destination too small
+
+	//Whole blocks go straight from src to dst
+	size_t fullLength = length & ~(size_t)0x0F;
+	if (!EncryptStream(src, dst, fullLength))				return 0x0B;		//Define error	->	Cancelled by the observer
+
+	//The last block is assembled on the stack with its padding
+	if (attachPadding) {
+		uint8_t last[16];
+		memcpy(last, src + fullLength, length - fullLength);
+		AttachPadding(last, length - fullLength);
+		EncryptBlock(last);
+		memcpy(dst + fullLength, last, 16);
+	}
 
+	*dstLength = paddedLength;
 	return 0x00;
 }
 
 //
-void AES::DecryptBlock(uint8_t* block) {
-	AddRoundKey(block, 10);
-	for (uint8_t i = 9; i > 0; i--) {
-		ShiftRowsRight(block);
+void AES::DecryptBlock(uint8_t* block) const {
+	if (block == NULL)		return;
+
+	const AESKeySchedule* ks = keySchedule.get();
+
+	if (engine == AES_ENGINE_AESNI) {
+		AESNI_DecryptBlocks(ks->cryptoKexInv[0], ks->rounds, block, block, 1);
+		return;
+	}
+
+	if (engine == AES_ENGINE_BITSLICE) {
+		Bitslice_DecryptBlocks(ks->cryptoKexBitslice[0], ks->rounds, block, block, 1);
+		return;
+	}
+
+	switch (ks->rounds) {
+	case 12:
+		engine == AES_ENGINE_TTABLE ? DecryptBlockTTable<12>(block, block) : DecryptBlockReference<12>(block);
+		break;
+	case 14:
+		engine == AES_ENGINE_TTABLE ? DecryptBlockTTable<14>(block, block) : DecryptBlockReference<14>(block);
+		break;
+	default:
+		engine == AES_ENGINE_TTABLE ? DecryptBlockTTable<10>(block, block) : DecryptBlockReference<10>(block);
+		break;
+	}
+}
+
+//
+template<uint8_t Rounds>
+void AES::DecryptBlockReference(uint8_t* block) const {
+	//Equivalent inverse cipher: same round order as encryption, the key stages already carry InvMixColumns
+	AddRoundKeyInv(block, 0);
+	for (uint8_t i = 1; i < Rounds; i++)
+	{
 		SubBytesInv(block);
-		AddRoundKey(block, i);
+		ShiftRowsRight(block);
 		MixColumnsInv(block);
+		AddRoundKeyInv(block, i);
 	}
-	ShiftRowsRight(block);
 	SubBytesInv(block);
-	AddRoundKey(block, 0);
+	ShiftRowsRight(block);
+	AddRoundKeyInv(block, Rounds);
+}
+
 
+//
+void AES::DecryptBlocks(uint8_t* blocks, size_t blockCount) const {
+	DecryptBlocks(blocks, blocks, blockCount);
+}
+
+//
+void AES::DecryptBlocks(const uint8_t* src, uint8_t* dst, size_t blockCount) const {
+	if (src == NULL || dst == NULL)		return;
+
+	const AESKeySchedule* ks = keySchedule.get();
+
+	switch (engine) {
+	case AES_ENGINE_AESNI:
+		AESNI_DecryptBlocks(ks->cryptoKexInv[0], ks->rounds, src, dst, blockCount);
+		break;
+	case AES_ENGINE_BITSLICE:
+		Bitslice_DecryptBlocks(ks->cryptoKexBitslice[0], ks->rounds, src, dst, blockCount);
+		break;
+	case AES_ENGINE_TTABLE:
+		if (ks->rounds == 12)			DecryptBlocksTTable<12>(src, dst, blockCount);
+		else if (ks->rounds == 14)		DecryptBlocksTTable<14>(src, dst, blockCount);
+		else							DecryptBlocksTTable<10>(src, dst, blockCount);
+		break;
+	default:
+		for (size_t i = 0; i < blockCount; i++) {
+			if (src != dst)
+				memcpy(dst + i * 16, src + i * 16, 16);
+			DecryptBlock(dst + i * 16);
+		}
+		break;
+	}
 }
 
 //
-void AES::DecryptStream(uint8_t* src, uint8_t* dst, size_t length) {
-	memcpy(dst, src, length);
-	DecryptStreamOrigin(dst, length);
+bool AES::DecryptStreamOrigin(uint8_t* stream, size_t length) const {
+	return DecryptStream(stream, stream, length);
 }
 
 //
-void AES::DecryptStreamOrigin(uint8_t* stream, size_t length) {
+bool AES::DecryptStream(const uint8_t* src, uint8_t* dst, size_t length) const {
+	if (src == NULL || dst == NULL)		return true;
+
 	size_t blcks = length / 16;
-	for (size_t i = 0; i < blcks; i++)
-		DecryptBlock(stream + i * 16);
+
+	if (UseChunks(length))
+		return CryptChunks(blcks * 16, [&](size_t first, size_t bytes) { DecryptBlocks(src + first, dst + first, bytes / 16); });
+
+	DecryptBlocks(src, dst, blcks);
+	return true;
 }
 
 //
-uint8_t* AES::Decrypt(uint8_t* src, size_t length, size_t* streamLength, bool removePadding) {
+uint8_t* AES::Decrypt(uint8_t* src, size_t length, size_t* streamLength, bool removePadding) const {
 	if (src == NULL || length < 1) return NULL;		//Define error	->	NULL src or length
 
-	if ((length & 0x0F) != 0) { printf("\nAES: Bad stream size!\n"); return NULL; }			//Define error	->	Bad stream size
-
+	if ((length & 0x0F) != 0)	return NULL;					//Define error	->	Bad stream size
 
 	uint8_t* dstStream = (uint8_t*)malloc(length);
 	if (dstStream == NULL)	return dstStream;		//Define error	->	Mem. allocation falied
 
-	memcpy(dstStream, src, length);
+	if (!DecryptStream(src, dstStream, length)) { free(dstStream); return NULL; }		//Define error	->	Cancelled
 
-	DecryptStreamOrigin(dstStream, length);
+	*streamLength = length;
 
-	*streamLength = length - (removePadding ? (dstStream[length - 1] == 0x10 ? 0x10 : dstStream[length - 1]) : 0);
+	//A malformed padding is rejected, a trusted length from it would reach past the buffer
+	if (removePadding && !CheckPadding(dstStream, length, streamLength)) {
+		AES_SecureZero(dstStream, length);
+		free(dstStream);
+		return NULL;											//Define error	->	Bad padding
+	}
 
 	return dstStream;
 }
 
-size_t AES::DecryptFileToFile(char* inputFileName, char* outputFileName) {
-
-	if (inputFileName == NULL || outputFileName == NULL)	return 0x0A;
-
-	FILE* inputFile;
-	fopen_s(&inputFile, inputFileName, "rb");
-	if (inputFile == NULL)		return 0x01;			//Error while opening source file
-
-
-	//
-	size_t streamLen =  GetFileSizeBytes(inputFile);
-
-	if (streamLen < 1)		return 0x02;			//Empty input file
-	if ((streamLen & 0x0F) != 0x00)	return 0x03;	//Bad file size
+//
+int AES::DecryptInto(const uint8_t* src, size_t length, uint8_t* dst, size_t dstSize, size_t* dstLength, bool removePadding) const {
+	if (src == NULL || dst == NULL || dstLength == NULL)	return 0x01;		//Define error	->	NULL pointer
+	if ((length & 0x0F) != 0 || (removePadding && length == 0))	return 0x03;	//Define error	->	Bad stream size
+	if (dstSize < length)									return 0x02;		//Define error	->	Destination too small
 
-	//Create output file
-	FILE* outputFile;
-	fopen_s(&outputFile, outputFileName, "wb");
-	if (outputFile == NULL)		return 0x04;			//Error creating output file
+	if (!DecryptStream(src, dst, length))					return 0x0B;		//Define error	->	Cancelled by the observer
 
-	//The maximum ammount of data (bytes) to work on at once
-	size_t dataChunkSize = (streamLen > AES_MAX_BUFFER_SIZE ? AES_MAX_BUFFER_SIZE : streamLen);
+	if (!removePadding) {
+		*dstLength = length;
+		return 0x00;
+	}
 
-	size_t encryptedChunkSize = 0;
+	if (!CheckPadding(dst, length, dstLength))				return 0x04;		//Define error	->	Bad padding
 
-	//Encrypting without padding
-	while (streamLen > dataChunkSize) {
+	return 0x00;
+}
 
-		//Store data from file
-		uint8_t* rawData = (uint8_t*)malloc(dataChunkSize * sizeof(uint8_t));
+//
+size_t AES::PaddedLength(size_t length, bool attachPadding) {
+	return attachPadding ? length + 16 - (length & 0x0F) : length;
+}
 
-		//Read data from file into buffer
-		fread(rawData, sizeof(uint8_t), dataChunkSize, inputFile);
+//
+void AES::AttachPadding(uint8_t* stream, size_t length) {
+	//Padding the data with #PKCS7 (a full block if the data is already aligned)
+	uint8_t pad = (uint8_t)(16 - (length & 0x0F));
+	memset(stream + length, pad, pad);
+}
 
-		uint8_t* decryptedData = Decrypt(rawData, dataChunkSize, &encryptedChunkSize, false);
+//
+bool AES::CheckPadding(const uint8_t* stream, size_t length, size_t* dstLength) {
+	//Check every padding byte without branching on their values
+	uint8_t pad = stream[length - 1];
+	uint8_t bad = (uint8_t)((pad == 0) | (pad > 16));
+	for (uint8_t i = 1; i <= 16; i++)
+		bad |= (uint8_t)((i <= pad) & (stream[length - i] != pad));
 
-		fwrite(decryptedData, sizeof(uint8_t), dataChunkSize, outputFile);
-		fflush(outputFile);
+	if (bad)	return false;
 
-		//Updating tracker
-		//progress += encryptedChunkSize;
-		encryptedChunkSize = 0;
+	*dstLength = length - pad;
+	return true;
+}
 
-		streamLen -= dataChunkSize;
+//
+bool AES::UseParallel(size_t length) const {
+	return length >= parallelMinSize && length > AES_PARALLEL_CHUNK_SIZE && threadNum != 1;
+}
 
-		//Free up memory
-		free(decryptedData);
-		free(rawData);
-	}
+//
+bool AES::UseChunks(size_t length) const {
+	return UseParallel(length) || (observer && length > AES_PARALLEL_CHUNK_SIZE);
+}
 
-	//Last round with padding
-	uint8_t* rawData = (uint8_t*)malloc(streamLen * sizeof(uint8_t));
+//
+bool AES::CryptChunks(size_t length, const std::function<void(size_t, size_t)>& crypt) const {
+	const long long chunks = (long long)((length + AES_PARALLEL_CHUNK_SIZE - 1) / AES_PARALLEL_CHUNK_SIZE);
 
-	//Read data from file into buffer
-	fread_s(rawData, streamLen * sizeof(uint8_t), sizeof(uint8_t), streamLen, inputFile);
+	//An observed stream below the parallel limit still runs chunk by chunk, on the calling thread
+	int threads = 1;
+#ifdef _OPENMP
+	if (UseParallel(length))	threads = threadNum > 0 ? threadNum : omp_get_max_threads();
+#endif
 
-	uint8_t* decryptedData = Decrypt(rawData, streamLen, &encryptedChunkSize, true);
+	AESProgressTracker progress(observer.get(), length);
+	progress.SetChunks((uint64_t)chunks);
 
-	fwrite(decryptedData, sizeof(uint8_t), encryptedChunkSize, outputFile);
-	fflush(outputFile);
+	#pragma omp parallel for schedule(static) num_threads(threads)
+	for (long long c = 0; c < chunks; c++) {
+		if (progress.Cancelled())	continue;		//The remaining chunks are left unprocessed
 
-	free(rawData);
-	free(decryptedData);
+		size_t first = (size_t)c * AES_PARALLEL_CHUNK_SIZE;
+		size_t bytes = length - first < AES_PARALLEL_CHUNK_SIZE ? length - first : AES_PARALLEL_CHUNK_SIZE;
 
-	//Close files
-	fclose(outputFile);
-	fclose(inputFile);
+		uint64_t start = progress.Now();
+		crypt(first, bytes);
+		progress.AddCipher(progress.Now() - start);
+		progress.Chunk(bytes);
+	}
 
-	return 0x00;
+	return !progress.Cancelled();
 }
 
 //
-uint8_t AES::SubByteSingle(uint8_t byte) {
-	return sBox[byte >> 4][byte & 0x0F];
+uint8_t AESKeySchedule::SubByteSingle(uint8_t byte) {
+	return sBox[byte];
 }
 
 //
 void AES::SubBytes(uint8_t* block) {
 	for (uint8_t i = 0; i < 16; i++)
-		block[i] = sBox[block[i] >> 4][block[i] & 0x0F];
+		block[i] = sBox[block[i]];
 }
 
 //
 void AES::SubBytesInv(uint8_t* block) {
 	for (uint8_t i = 0; i < 16; i++)
-		block[i] = sBoxInv[block[i] >> 4][block[i] & 0x0F];
+		block[i] = sBoxInv[block[i]];
 }
 
 //
 void AES::ShiftRowsLeft(uint8_t* block) {
+	uint8_t procArray[16];
 	procArray[0] = block[0];
 	procArray[1] = block[5];
 	procArray[2] = block[10];
@@ -291,6 +600,7 @@ void AES::ShiftRowsLeft(uint8_t* block) {
 
 //
 void AES::ShiftRowsRight(uint8_t* block) {
+	uint8_t procArray[16];
 	procArray[0] = block[0];
 	procArray[1] = block[13];
 	procArray[2] = block[10];
@@ -313,105 +623,320 @@ void AES::ShiftRowsRight(uint8_t* block) {
 //
 void AES::MixColumns(uint8_t* block) {
 	for (uint8_t i = 0; i < 4; i++)
-		for (uint8_t mult = 0; mult < 4; mult++)
-			procArray[i * 4 + mult] = GFMult(constMatrix[mult][0], block[i * 4]) ^ GFMult(constMatrix[mult][1], block[i * 4 + 1]) ^ GFMult(constMatrix[mult][2], block[i * 4 + 2]) ^ GFMult(constMatrix[mult][3], block[i * 4 + 3]);
-	memcpy(block, procArray, 16);
+		AES_MixColumn<constMatrix>(block + i * 4, block + i * 4);
 }
 
 //
 void AES::MixColumnsInv(uint8_t* block) {
-	for (uint8_t i = 0; i < 4; i++)
-		for (uint8_t mult = 0; mult < 4; mult++)
-			procArray[i * 4 + mult] = GFMult(constMatrixInv[mult][0], block[i * 4]) ^ GFMult(constMatrixInv[mult][1], block[i * 4 + 1]) ^ GFMult(constMatrixInv[mult][2], block[i * 4 + 2]) ^ GFMult(constMatrixInv[mult][3], block[i * 4 + 3]);
-	memcpy(block, procArray, 16);
+	//{0E, 0B, 0D, 09} = {02, 03, 01, 01} x {05, 00, 04, 00}: two xtimes per column pair, then the forward matrix
+	for (uint8_t i = 0; i < 4; i++) {
+		uint8_t* col = block + i * 4;
+		uint8_t u = AES_GFMul<0x04>(col[0] ^ col[2]);
+		uint8_t v = AES_GFMul<0x04>(col[1] ^ col[3]);
+		col[0] ^= u;
+		col[1] ^= v;
+		col[2] ^= u;
+		col[3] ^= v;
+		AES_MixColumn<constMatrix>(col, col);
+	}
 }
 
 //
-uint8_t AES::GFMult(uint8_t multiplier, uint16_t multiplicant) {
-	switch (multiplier)
-	{
-	case 1:
-		return (uint8_t)multiplicant;
-	case 2:
-		multiplicant = multiplicant << 0x01;
-		break;
-	case 3:
-		multiplicant = multiplicant ^ (multiplicant << 0x01);
-		break;
-	case 9:
-		return mul_9[multiplicant];
-	case 11:
-		return mul_11[multiplicant];
-	case 13:
-		return mul_13[multiplicant];
-	case 14:
-		return mul_14[multiplicant];
-	default:
-		return 0;
+template<uint8_t Rounds>
+void AES::EncryptBlockTTable(const uint8_t* src, uint8_t* dst) const {
+	const uint32_t* rk = keySchedule->cryptoKexWords;
+	uint32_t s[4], t[4];
+
+	TTABLE_LOAD(s, src, rk);
+	AES_UNROLL
+	for (uint8_t i = 1; i < Rounds; i++) {
+		rk += 4;
+		TTABLE_ENC_ROUND(t, s, rk);
+		memcpy(s, t, sizeof(s));
 	}
-	return (uint8_t)(multiplicant >= GF_MULT_OVERFLOW ? (multiplicant - GF_MULT_OVERFLOW) ^ 0x1B : multiplicant);
+	rk += 4;
+	TTABLE_ENC_LAST(t, s, rk);
+	TTABLE_STORE(dst, t);
 }
 
 //
-void AES::AddRoundKey(uint8_t* block, uint8_t keyNum) {
+template<uint8_t Rounds>
+void AES::EncryptBlocksTTable(const uint8_t* src, uint8_t* dst, size_t blockCount) const {
+	size_t b = 0;
+
+	//Four independent blocks per round so the table loads of one block hide the latency of the others
+	for (; b + 4 <= blockCount; b += 4) {
+		const uint8_t* in = src + b * 16;
+		uint8_t* out = dst + b * 16;
+		const uint32_t* rk = keySchedule->cryptoKexWords;
+		uint32_t s0[4], s1[4], s2[4], s3[4], t0[4], t1[4], t2[4], t3[4];
+
+		TTABLE_LOAD(s0, in, rk);
+		TTABLE_LOAD(s1, in + 16, rk);
+		TTABLE_LOAD(s2, in + 32, rk);
+		TTABLE_LOAD(s3, in + 48, rk);
+		AES_UNROLL
+		for (uint8_t i = 1; i < Rounds; i++) {
+			rk += 4;
+			TTABLE_ENC_ROUND(t0, s0, rk);
+			TTABLE_ENC_ROUND(t1, s1, rk);
+			TTABLE_ENC_ROUND(t2, s2, rk);
+			TTABLE_ENC_ROUND(t3, s3, rk);
+			memcpy(s0, t0, sizeof(s0));
+			memcpy(s1, t1, sizeof(s1));
+			memcpy(s2, t2, sizeof(s2));
+			memcpy(s3, t3, sizeof(s3));
+		}
+		rk += 4;
+		TTABLE_ENC_LAST(t0, s0, rk);
+		TTABLE_ENC_LAST(t1, s1, rk);
+		TTABLE_ENC_LAST(t2, s2, rk);
+		TTABLE_ENC_LAST(t3, s3, rk);
+		TTABLE_STORE(out, t0);
+		TTABLE_STORE(out + 16, t1);
+		TTABLE_STORE(out + 32, t2);
+		TTABLE_STORE(out + 48, t3);
+	}
 
-	for (uint8_t i = 0; i < 4; i++)
-		for (uint8_t j = 0; j < 4; j++)
-			block[j * 4 + i] = block[j * 4 + i] ^ cryptoKex[keyNum][i * 4 + j];
+	for (; b < blockCount; b++)
+		EncryptBlockTTable<Rounds>(src + b * 16, dst + b * 16);
 }
 
 //
-void AES::ExpandKey(uint8_t* srcKey, uint8_t* dstKey, uint8_t keyNum) {
-	dstKey[0] = SubByteSingle(srcKey[7]) ^ srcKey[0] ^ rcon_table[keyNum];
-	dstKey[4] = SubByteSingle(srcKey[11]) ^ srcKey[4];
-	dstKey[8] = SubByteSingle(srcKey[15]) ^ srcKey[8];
-	dstKey[12] = SubByteSingle(srcKey[3]) ^ srcKey[12];
-	for (uint8_t i = 1; i < 4; i++) {
-		dstKey[i] = dstKey[i - 1] ^ srcKey[i];
-		dstKey[i + 4] = dstKey[i + 3] ^ srcKey[i + 4];
-		dstKey[i + 8] = dstKey[i + 7] ^ srcKey[i + 8];
-		dstKey[i + 12] = dstKey[i + 11] ^ srcKey[i + 12];
+template<uint8_t Rounds>
+void AES::DecryptBlockTTable(const uint8_t* src, uint8_t* dst) const {
+	const uint32_t* rk = keySchedule->cryptoKexWordsInv;
+	uint32_t s[4], t[4];
+
+	TTABLE_LOAD(s, src, rk);
+	AES_UNROLL
+	for (uint8_t i = 1; i < Rounds; i++) {
+		rk += 4;
+		TTABLE_DEC_ROUND(t, s, rk);
+		memcpy(s, t, sizeof(s));
 	}
+	rk += 4;
+	TTABLE_DEC_LAST(t, s, rk);
+	TTABLE_STORE(dst, t);
 }
 
 //
-void AES::CalculateKeys(char* key) {
+template<uint8_t Rounds>
+void AES::DecryptBlocksTTable(const uint8_t* src, uint8_t* dst, size_t blockCount) const {
+	size_t b = 0;
+
+	for (; b + 4 <= blockCount; b += 4) {
+		const uint8_t* in = src + b * 16;
+		uint8_t* out = dst + b * 16;
+		const uint32_t* rk = keySchedule->cryptoKexWordsInv;
+		uint32_t s0[4], s1[4], s2[4], s3[4], t0[4], t1[4], t2[4], t3[4];
+
+		TTABLE_LOAD(s0, in, rk);
+		TTABLE_LOAD(s1, in + 16, rk);
+		TTABLE_LOAD(s2, in + 32, rk);
+		TTABLE_LOAD(s3, in + 48, rk);
+		AES_UNROLL
+		for (uint8_t i = 1; i < Rounds; i++) {
+			rk += 4;
+			TTABLE_DEC_ROUND(t0, s0, rk);
+			TTABLE_DEC_ROUND(t1, s1, rk);
+			TTABLE_DEC_ROUND(t2, s2, rk);
+			TTABLE_DEC_ROUND(t3, s3, rk);
+			memcpy(s0, t0, sizeof(s0));
+			memcpy(s1, t1, sizeof(s1));
+			memcpy(s2, t2, sizeof(s2));
+			memcpy(s3, t3, sizeof(s3));
+		}
+		rk += 4;
+		TTABLE_DEC_LAST(t0, s0, rk);
+		TTABLE_DEC_LAST(t1, s1, rk);
+		TTABLE_DEC_LAST(t2, s2, rk);
+		TTABLE_DEC_LAST(t3, s3, rk);
+		TTABLE_STORE(out, t0);
+		TTABLE_STORE(out + 16, t1);
+		TTABLE_STORE(out + 32, t2);
+		TTABLE_STORE(out + 48, t3);
+	}
+
+	for (; b < blockCount; b++)
+		DecryptBlockTTable<Rounds>(src + b * 16, dst + b * 16);
+}
 
-	char keyArr[16] = { 0 };
+//
+void AES::AddRoundKey(uint8_t* block, uint8_t keyNum) const {
+	AES_XorBlock(block, keySchedule->cryptoKex[keyNum]);
+}
 
-	char i;
-	for (i = 0; i < 16 && key[i] != '\0'; i++)
-		keyArr[i] = key[i];
+//
+void AES::AddRoundKeyInv(uint8_t* block, uint8_t keyNum) const {
+	AES_XorBlock(block, keySchedule->cryptoKexInv[keyNum]);
+}
 
-	for (; i < 16; i++)
-		keyArr[i] = 0;
+//
+void AESKeySchedule::ExpandKey(const uint8_t* key, uint8_t keyWords) {
+	uint8_t* w = cryptoKex[0];		//Key stages are consecutive words in state byte order
+	uint8_t words = (uint8_t)((rounds + 1) * 4);
+
+	memcpy(w, key, keyWords * 4);
+
+	for (uint8_t i = keyWords; i < words; i++) {
+		uint8_t t[4] = { w[(i - 1) * 4], w[(i - 1) * 4 + 1], w[(i - 1) * 4 + 2], w[(i - 1) * 4 + 3] };
+
+		if (i % keyWords == 0) {
+			//RotWord, SubWord and rcon
+			uint8_t t0 = t[0];
+			t[0] = SubByteSingle(t[1]) ^ rcon_table[i / keyWords - 1];
+			t[1] = SubByteSingle(t[2]);
+			t[2] = SubByteSingle(t[3]);
+			t[3] = SubByteSingle(t0);
+		}
+		else if (keyWords > 6 && i % keyWords == 4) {
+			//AES-256 only: SubWord in the middle of every key block
+			for (uint8_t j = 0; j < 4; j++)
+				t[j] = SubByteSingle(t[j]);
+		}
 
-	for (uint8_t i = 0; i < 4; i++)
 		for (uint8_t j = 0; j < 4; j++)
-			cryptoKex[0][j * 4 + i] = keyArr[i * 4 + j];
+			w[i * 4 + j] = w[(i - keyWords) * 4 + j] ^ t[j];
+	}
+}
+
+//
+void AESKeySchedule::CalculateKeys(const uint8_t* key, size_t keyLength) {
+
+	rounds = (uint8_t)(keyLength / 4 + 6);
+
+	if (keyLength == 16 && AESNI_Supported()) {
+		//Expand in hardware, AESIMC builds the decryption key stages as well
+		AESNI_ExpandKey(key, cryptoKex[0], cryptoKexInv[0]);
+	}
+	else {
+		ExpandKey(key, (uint8_t)(keyLength / 4));
+		CalculateKeysInv();
+	}
+
+	CalculateEngineKeys();
+}
+
+//
+void AESKeySchedule::CalculateKeysInv() {
+
+	//Decryption runs the key stages in reverse order
+	for (uint8_t k = 0; k <= rounds; k++)
+		memcpy(cryptoKexInv[k], cryptoKex[rounds - k], 16);
+
+	//Apply InvMixColumns to the middle key stages
+	for (uint8_t k = 1; k < rounds; k++)
+		for (uint8_t c = 0; c < 4; c++)
+			AES_MixColumn<constMatrixInv>(cryptoKexInv[k] + c * 4, cryptoKexInv[k] + c * 4);
+}
+
+//
+void AESKeySchedule::CalculateEngineKeys() {
 
-	for (uint8_t i = 1; i < 11; i++)
-		ExpandKey(cryptoKex[i - 1], cryptoKex[i], i - 1);
+	//The T-table engine works on big-endian column words
+	for (uint8_t i = 0; i <= rounds; i++)
+		for (uint8_t j = 0; j < 4; j++) {
+			cryptoKexWords[i * 4 + j] = GETU32(cryptoKex[i] + j * 4);
+			cryptoKexWordsInv[i * 4 + j] = GETU32(cryptoKexInv[i] + j * 4);
+		}
+
+	Bitslice_ExpandKey(cryptoKex[0], rounds, cryptoKexBitslice[0]);
+}
+
+//
+uint8_t AESKeySchedule::GetRounds() const {
+	return rounds;
+}
+
+//
+const uint8_t* AESKeySchedule::GetRoundKeys() const {
+	return cryptoKex[0];
+}
+
+//
+const uint8_t* AESKeySchedule::GetRoundKeysInv() const {
+	return cryptoKexInv[0];
+}
+
+//
+size_t AESKeySchedule::GetBlobSize() const {
+	return 2 * ((size_t)rounds + 1) * 16;
+}
+
+//
+int AESKeySchedule::Export(uint8_t* blob, size_t blobSize) const {
+	if (blob == NULL)					return 0x01;		//Define error	->	NULL blob
+	if (blobSize < GetBlobSize())		return 0x02;		//Define error	->	Blob too small
+
+	size_t half = GetBlobSize() / 2;
+	memcpy(blob, cryptoKex, half);
+	memcpy(blob + half, cryptoKexInv, half);
+
+	return 0x00;
+}
+
+//
+std::shared_ptr<const AESKeySchedule> AESKeySchedule::Import(const uint8_t* blob, size_t blobSize) {
+	if (blob == NULL)	return NULL;
+
+	//The blob size tells the key size
+	size_t half = blobSize / 2;
+	if (blobSize % 32 != 0 || (half != 11 * 16 && half != 13 * 16 && half != 15 * 16))	return NULL;
+
+	std::shared_ptr<AESKeySchedule> keySchedule = std::make_shared<AESKeySchedule>();
+	keySchedule->rounds = (uint8_t)(half / 16 - 1);
+	memcpy(keySchedule->cryptoKex, blob, half);
+
+	//Rebuild the decryption half to reject blobs that would decrypt with a different key
+	keySchedule->CalculateKeysInv();
+	if (memcmp(keySchedule->cryptoKexInv, blob + half, half) != 0)
+		return NULL;
+
+	keySchedule->CalculateEngineKeys();
+
+	return keySchedule;
 }
 
+//64-bit file positions (ftell returns a 32-bit long on Windows)
+#ifdef _MSC_VER
+#define AES_FTELL(file)					_ftelli64(file)
+#define AES_FSEEK(file, offset, origin)	_fseeki64(file, offset, origin)
+#else
+#define AES_FTELL(file)					ftello(file)
+#define AES_FSEEK(file, offset, origin)	fseeko(file, (off_t)(offset), origin)
+#endif
+
 //
-size_t AES::GetFileSizeBytes(FILE* file) {
+size_t AES::GetFileSizeBytes(FILE* file) const {
 	if (!file)
 		return 0;
-	size_t filePointerPos = (size_t)ftell(file);
-	fseek(file, 0, SEEK_END);
-	size_t fileSize = ftell(file);
-	fseek(file, filePointerPos, SEEK_SET);
-	return fileSize;
+	long long filePointerPos = (long long)AES_FTELL(file);
+	AES_FSEEK(file, 0, SEEK_END);
+	long long fileSize = (long long)AES_FTELL(file);
+	AES_FSEEK(file, filePointerPos, SEEK_SET);
+	return fileSize > 0 ? (size_t)fileSize : 0;
 }
 
-size_t AES::GetFileSizeBytes(char* fileName) {
-	FILE* targetFile;
-	fopen_s(&targetFile, (const char*)fileName, "r");
+size_t AES::GetFileSizeBytes(char* fileName) const {
+	FILE* targetFile = OpenFile(fileName, "rb");
 	if (!targetFile)
 		return 0;
-	fseek(targetFile, 0, SEEK_END);
-	size_t fileSize = ftell(targetFile);
+	size_t fileSize = GetFileSizeBytes(targetFile);
 	fclose(targetFile);
 	return fileSize;
 }
+
+//
+FILE* AES::OpenFile(const char* fileName, const char* mode) {
+	if (fileName == NULL || mode == NULL)
+		return NULL;
+#ifdef _MSC_VER
+	FILE* file = NULL;
+	if (fopen_s(&file, fileName, mode) != 0)
+		return NULL;
+	return file;
+#else
+	return fopen(fileName, mode);
+#endif
+}
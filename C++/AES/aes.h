@@ -29,29 +29,269 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#pragma once
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <omp.h>
-
-#define AES_MAX_BUFFER_SIZE    256 * ( 1000000 /* 1 MB */ )    //Max buffer size on heap in megabytes -!!- MUST BE MULTIPLE OF 16 bytes -!!-
+#include <functional>
+#include <memory>
+
+#define AES_FILE_BUFFER_SIZE	( 4 * 1024 * 1024 )				//Bytes per file pipeline buffer -!!- MUST BE MULTIPLE OF 16 bytes -!!-
+#define AES_FILE_BUFFER_COUNT	4								//Buffers in the file pipeline ring (reader, cipher and writer each hold at least one)
+#define AES_FILE_BUFFER_ALIGN	4096							//File buffers are page aligned
+#define AES_FILE_URING_CHUNK	( 1024 * 1024 )					//Bytes per io_uring read / write -!!- MUST BE MULTIPLE OF 16 bytes -!!-
+#define AES_FILE_URING_DEPTH	16								//Default io_uring queue depth (buffers, each one read, in the cipher or one write)
+#define AES_FILE_URING_MAX_DEPTH	1024						//Largest accepted queue depth
 /*
 * 
-*	Note: This size only restricts single buffers, NOT the whole program buffer size.
+*	Note: The file functions hold AES_FILE_BUFFER_COUNT * AES_FILE_BUFFER_SIZE bytes at most, whatever the file size.
 * 
 */
 
+#define AES_CTR_BATCH_BLOCKS	64								//Counter blocks encrypted together for the CTR keystream (1 KB, stays in L1 cache)
+
+#define AES_CBC_BATCH_BLOCKS	64								//Blocks decrypted together by the CBC decryption (1 KB, stays in L1 cache)
+#define AES_CBC_LANES			8								//Independent messages interleaved by EncryptStreamsCBC
+
+#define AES_MAX_ROUNDS			14								//Rounds of AES-256 (AES-128: 10, AES-192: 12)
+#define AES_KEY_SCHEDULE_BLOB_SIZE	( 2 * (AES_MAX_ROUNDS + 1) * 16 )	//Largest exported key schedule: encryption key stages followed by decryption key stages
+
+#define AES_THREAD_NUM			0								//Default number of threads for parallel streams (0: OpenMP default)
+#define AES_PARALLEL_MIN_SIZE	( 1000000 /* 1 MB */ )			//Streams shorter than this are processed on the calling thread
+#define AES_PARALLEL_CHUNK_SIZE	( 256 * 1024 )					//Bytes per parallel work item, sized to stay in L2 cache -!!- MUST BE MULTIPLE OF 16 bytes -!!-
+
+/**
+*	Overwrite key material so the compiler cannot drop the stores
+*
+*	@param <void*> data				Memory to clear
+*	@param <size_t> length			Length in bytes
+*/
+void AES_SecureZero(void* data, size_t length);
+
+class AESKeyCache;
+class AESObserver;
+class AESProgressTracker;
+
+/**
+*	Round engines available for block encryption and decryption
+*/
+enum AES_ENGINE : uint8_t {
+	AES_ENGINE_REFERENCE = 0,		///< Byte-wise reference rounds (SubBytes, ShiftRows, MixColumns, AddRoundKey)
+	AES_ENGINE_TTABLE = 1,			///< Word-oriented rounds with combined lookup tables (Te0..Te3 / Td0..Td3)
+	AES_ENGINE_AESNI = 2,			///< x86 AES-NI instructions (AESENC / AESDEC / AESKEYGENASSIST)
+	AES_ENGINE_BITSLICE = 3			///< Constant-time bitsliced SSE2 / AVX2 rounds (8 / 16 blocks per pass)
+};
+
+/**
+*	I/O strategies of EncryptFileToFile and DecryptFileToFile (every mode writes the same file)
+*/
+enum AES_FILE_MODE : uint8_t {
+	AES_FILE_PIPELINE = 0,			///< fread / fwrite on a ring of buffers, reader, cipher and writer on separate threads
+	AES_FILE_MMAP = 1,				///< Input and output mapped into memory, encrypted from page to page (POSIX regular files, else AES_FILE_PIPELINE)
+	AES_FILE_URING = 2,				///< Linux io_uring, reads and writes kept in flight on registered buffers (regular files, else AES_FILE_PIPELINE)
+	AES_FILE_PARALLEL = 3			///< Aligned ranges read, encrypted and written by SetThreadNum threads with pread / pwrite (POSIX regular files, else AES_FILE_PIPELINE)
+};
+
+/**
+*	Expanded AES key
+*
+*	Never modified after construction, so one schedule can be shared by several AES objects and threads.
+*/
+class AESKeySchedule {
+
+	friend class AES;
+
+private:
+
+	alignas(64) uint8_t cryptoKex[AES_MAX_ROUNDS + 1][16] = { 0 };		//Encryption key stages in state byte order (every engine)
+
+	alignas(64) uint8_t cryptoKexInv[AES_MAX_ROUNDS + 1][16] = { 0 };	//Decryption key stages for the equivalent inverse cipher (reverse order, InvMixColumns applied to the middle stages)
+
+	uint32_t cryptoKexWords[(AES_MAX_ROUNDS + 1) * 4] = { 0 };		//Encryption key stages as big-endian column words (T-table engine)
+
+	uint32_t cryptoKexWordsInv[(AES_MAX_ROUNDS + 1) * 4] = { 0 };	//Decryption key stages as big-endian column words (T-table engine)
+
+	uint16_t cryptoKexBitslice[AES_MAX_ROUNDS + 1][8] = { 0 };		//Key stages as bit planes (bitsliced engine)
+
+	uint8_t rounds = 10;					//Number of rounds: 10, 12 or 14 for 128, 192 or 256 bit keys
+
+public:
+
+	/**
+	*	Create an empty key schedule (every key stage is zero)
+	*/
+	AESKeySchedule() = default;
+
+	/**
+	*	Zeroize every key stage
+	*/
+	~AESKeySchedule();
+
+	/**
+	*	Expand a secret key for AES-128
+	*
+	*	@param <char*> key				Key used for encryption and decryption (up to 16 characters, zero padded)
+	*/
+	explicit AESKeySchedule(const char* key);
+
+	/**
+	*	Expand a binary secret key of any AES size
+	*
+	*	@param <uint8_t*> key			Key used for encryption and decryption
+	*	@param <size_t> keyLength		Key length in bytes: 16, 24 or 32 (AES-128, AES-192, AES-256)
+	*
+	*	@returns <std::shared_ptr>		Key schedule, NULL if the key is missing or has an unsupported length
+	*/
+	static std::shared_ptr<const AESKeySchedule> Create(const uint8_t* key, size_t keyLength);
+
+	/**
+	*	Get the shared empty key schedule
+	*
+	*	@returns <std::shared_ptr>		Key schedule used by AES objects before Init
+	*/
+	static const std::shared_ptr<const AESKeySchedule>& Empty();
+
+	/**
+	*	Check if this schedule was expanded from a key (constant-time compare)
+	*
+	*	@param <uint8_t*> key			Binary key
+	*	@param <size_t> keyLength		Key length in bytes
+	*
+	*	@returns <bool>					True if the key is the first keyLength bytes of the schedule
+	*/
+	bool MatchesKey(const uint8_t* key, size_t keyLength) const;
+
+	/**
+	*	Get the number of rounds
+	*
+	*	@returns <uint8_t>				10, 12 or 14 (AES-128, AES-192, AES-256)
+	*/
+	uint8_t GetRounds() const;
+
+	/**
+	*	Get the encryption key stages ((rounds + 1) x 16 bytes in state byte order, 64 byte aligned)
+	*
+	*	@returns <const uint8_t*>		First key stage
+	*/
+	const uint8_t* GetRoundKeys() const;
+
+	/**
+	*	Get the decryption key stages of the equivalent inverse cipher ((rounds + 1) x 16 bytes in state byte order, 64 byte aligned)
+	*
+	*	@returns <const uint8_t*>		First decryption key stage
+	*/
+	const uint8_t* GetRoundKeysInv() const;
+
+	/**
+	*	Get the size of the exported key schedule
+	*
+	*	@returns <size_t>				2 * (rounds + 1) * 16 bytes (352, 416 or 480)
+	*/
+	size_t GetBlobSize() const;
+
+	/**
+	*	Export the expanded key as a raw blob (encryption key stages followed by decryption key stages)
+	*
+	*	@param <uint8_t*> blob			Destination buffer
+	*	@param <size_t> blobSize		Destination buffer size (at least GetBlobSize())
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL blob, 0x02 buffer too small
+	*/
+	int Export(uint8_t* blob, size_t blobSize) const;
+
+	/**
+	*	Import an expanded key exported with Export (no key expansion)
+	*
+	*	@param <const uint8_t*> blob	Source buffer
+	*	@param <size_t> blobSize		Exported size, selects the key size (352: AES-128, 416: AES-192, 480: AES-256)
+	*
+	*	@returns <std::shared_ptr>		Key schedule, NULL if the blob is missing, has an unknown size or the two halves don't match
+	*/
+	static std::shared_ptr<const AESKeySchedule> Import(const uint8_t* blob, size_t blobSize);
+
+private:
+
+	/**
+	*	Substitute a single byte
+	*
+	*	@param <uint8_t>byte The byte to replace*
+	*
+	*	@returns uint8_t Corresponding byte according to sBox
+	*/
+	static uint8_t SubByteSingle(uint8_t byte);
+
+	/**
+	* 	Expand AES keys word by word (FIPS-197 KeyExpansion) into cryptoKex
+	*
+	* 	@param <uint8_t*>key		Secret key
+	* 	@param <uint8_t>keyWords	Key length in 32 bit words (4, 6 or 8)
+	*
+	*/
+	void ExpandKey(const uint8_t* key, uint8_t keyWords);
+
+	/**
+	* 	Calculate aes key stages
+	*
+	* 	@param	<uint8_t*>key		AES Secret key
+	* 	@param	<size_t>keyLength	Key length in bytes (16, 24 or 32)
+	*
+	*/
+	void CalculateKeys(const uint8_t* key, size_t keyLength);
+
+	/**
+	* 	Build the decryption key stages of the equivalent inverse cipher from cryptoKex
+	*
+	*/
+	void CalculateKeysInv();
+
+	/**
+	* 	Build the engine specific key copies (T-table words, bitsliced planes) from cryptoKex and cryptoKexInv
+	*
+	*/
+	void CalculateEngineKeys();
+
+};
+
 class AES {
 
+	friend class AESEncryptor;		//Streaming classes pad and check the padding with the helpers below
+	friend class AESDecryptor;
+
 private:
 
-	uint8_t	cryptoKex[11][16] = { 0 };		//Different key stages
+	std::shared_ptr<const AESKeySchedule> keySchedule = AESKeySchedule::Empty();	//Expanded key (never modified, may be shared)
+
+	std::shared_ptr<AESKeyCache> keyCache;	//Optional cache of expanded keys used by Init and ChangeSecretKey
+
+	AES_ENGINE engine = DefaultEngine();	//Round engine used by EncryptBlock and DecryptBlock
+
+	int threadNum = AES_THREAD_NUM;						//Threads used by the parallel stream functions (0: OpenMP default)
 
-	uint8_t procArray[16] = { 0 };			//Array to store a single block while it's being processed
+	size_t parallelMinSize = AES_PARALLEL_MIN_SIZE;		//Streams shorter than this stay single-threaded
+
+	AES_FILE_MODE fileMode = AES_FILE_PIPELINE;			//I/O strategy of the file functions
+
+	uint32_t fileQueueDepth = AES_FILE_URING_DEPTH;		//Buffers in flight in AES_FILE_URING mode
+
+	std::shared_ptr<AESObserver> observer;				//Optional progress reports and cancellation of the file functions and large streams
 
 public:
 
+	/**
+	*	Create AES without a key (call Init before use)
+	*/
+	AES() = default;
+
+	/**
+	*	Create AES on an already expanded key
+	*
+	*	@param <std::shared_ptr> keySchedule	Expanded key
+	*/
+	explicit AES(std::shared_ptr<const AESKeySchedule> keySchedule);
+
 	/**
 	*	Initialize AES
 	* 
@@ -66,32 +306,170 @@ public:
 	*/
 	void ChangeSecretKey(char* key);
 
+	/**
+	*	Initialize AES with a binary key of any AES size (also used to change the key)
+	*
+	*	@param <uint8_t*> key			Key used for encryption and decryption
+	*	@param <size_t> keyLength		Key length in bytes: 16, 24 or 32 (AES-128, AES-192, AES-256)
+	*
+	*	@returns <bool>					False if the key is missing or has an unsupported length (key is left unchanged)
+	*/
+	bool Init(const uint8_t* key, size_t keyLength);
+
+	/**
+	*	Use an already expanded key (the schedule is shared, not copied)
+	*
+	*	@param <std::shared_ptr> keySchedule	Expanded key
+	*/
+	void SetKeySchedule(std::shared_ptr<const AESKeySchedule> keySchedule);
+
+	/**
+	*	Get the expanded key, e.g. to share it with AES objects on other threads
+	*
+	*	@returns <std::shared_ptr>		Expanded key
+	*/
+	std::shared_ptr<const AESKeySchedule> GetKeySchedule() const;
+
+	/**
+	*	Look up keys in a cache before expanding them (Init and ChangeSecretKey)
+	*
+	*	@param <std::shared_ptr> keyCache	Key cache, may be shared by many AES objects and threads (NULL: always expand)
+	*/
+	void SetKeyCache(std::shared_ptr<AESKeyCache> keyCache);
+
+	/**
+	*	Get the key cache
+	*
+	*	@returns <std::shared_ptr>		Key cache, NULL if none is set
+	*/
+	std::shared_ptr<AESKeyCache> GetKeyCache() const;
+
+	/**
+	*	Select the round engine used for encryption and decryption
+	*
+	*	@param <AES_ENGINE> engine		Round engine (all engines produce identical output)
+	*
+	*	@returns <bool>					False if the engine is not supported by the CPU (engine is left unchanged)
+	*/
+	bool SetEngine(AES_ENGINE engine);
+
+	/**
+	*	Get the selected round engine
+	*
+	*	@returns <AES_ENGINE>			Round engine in use
+	*/
+	AES_ENGINE GetEngine() const;
+
+	/**
+	*	Get the fastest round engine supported by the CPU (detected once with CPUID)
+	*
+	*	@returns <AES_ENGINE>			AES_ENGINE_AESNI if available, AES_ENGINE_TTABLE otherwise
+	*/
+	static AES_ENGINE DefaultEngine();
+
+	/**
+	*	Set the number of threads used for large streams
+	*
+	*	@param <int> threadNum			Number of threads (0: OpenMP default, 1: always single-threaded)
+	*/
+	void SetThreadNum(int threadNum);
+
+	/**
+	*	Set the stream size from which the stream functions run in parallel
+	*
+	*	@param <size_t> minSize			Minimum stream length in bytes
+	*/
+	void SetParallelMinSize(size_t minSize);
+
+	/**
+	*	Select how the file functions read and write
+	*
+	*	@param <AES_FILE_MODE> fileMode	I/O strategy (unsupported modes fall back to AES_FILE_PIPELINE per file)
+	*/
+	void SetFileMode(AES_FILE_MODE fileMode);
+
+	/**
+	*	Get the selected file I/O strategy
+	*
+	*	@returns <AES_FILE_MODE>		I/O strategy
+	*/
+	AES_FILE_MODE GetFileMode() const;
+
+	/**
+	*	Set the io_uring queue depth of AES_FILE_URING (AES_FILE_URING_CHUNK bytes of memory each)
+	*
+	*	@param <uint32_t> depth			Reads and writes in flight (1..AES_FILE_URING_MAX_DEPTH)
+	*/
+	void SetFileQueueDepth(uint32_t depth);
+
+	/**
+	*	Get the io_uring queue depth
+	*
+	*	@returns <uint32_t>				Reads and writes in flight
+	*/
+	uint32_t GetFileQueueDepth() const;
+
+	/**
+	*	Report the progress of the file functions and of ECB, CTR and CBC decryption streams above AES_PARALLEL_CHUNK_SIZE (once per chunk)
+	*
+	*	@param <std::shared_ptr> observer	Observer, may cancel the operation (NULL: no reports)
+	*/
+	void SetObserver(std::shared_ptr<AESObserver> observer);
+
+	/**
+	*	Get the progress observer
+	*
+	*	@returns <std::shared_ptr>		Observer, NULL if none is set
+	*/
+	std::shared_ptr<AESObserver> GetObserver() const;
+
 	/**
 	* 	Encrypt a single 16 byte long block
 	*
 	* 	@param	<uint8_t*>block			Array containing the data to be encrypted
 	*
 	*/
-	void EncryptBlock(uint8_t* block);
+	void EncryptBlock(uint8_t* block) const;
 
 	/**
-	* 	Encrypt stream of bytes
+	* 	Encrypt consecutive 16 byte long blocks (several blocks are kept in flight per round)
+	*
+	* 	@param	<uint8_t*>blocks		Array containing the data to be encrypted
+	*	@param <size_t>blockCount		Number of blocks
+	*
+	*/
+	void EncryptBlocks(uint8_t* blocks, size_t blockCount) const;
+
+	/**
+	* 	Encrypt consecutive 16 byte long blocks from src to dst in one pass
+	*
+	* 	@param	<uint8_t*>src			Blocks to be encrypted
+	*	@param <uint8_t*>dst			Encrypted blocks (may be src)
+	*	@param <size_t>blockCount		Number of blocks
+	*
+	*/
+	void EncryptBlocks(const uint8_t* src, uint8_t* dst, size_t blockCount) const;
+
+	/**
+	* 	Encrypt stream of bytes (whole blocks, src is read once and never modified; split across threads above the parallel size limit)
 	* 
 	* 	@param	<uint8_t*>src			Source stream
 	*	@param <uint8_t*>dst			Destination stream
 	* 	@param <size_t>length			Source length
 	*
+	*	@returns <bool>					False if the observer cancelled (dst is left partly encrypted)
 	*/
-	void EncryptStream(uint8_t* src, uint8_t* dst, size_t length);
+	bool EncryptStream(const uint8_t* src, uint8_t* dst, size_t length) const;
 
 	/**
-	* 	Encrypt stream at original position
+	* 	Encrypt stream at original position (split across threads above the parallel size limit)
 	*
 	*	@param <uint8_t*>stream			Source stream
 	* 	@param <size_t>length			Source length
 	*
+	*	@returns <bool>					False if the observer cancelled (stream is left partly encrypted)
 	*/
-	void EncryptStreamOrigin(uint8_t* stream, size_t length);
+	bool EncryptStreamOrigin(uint8_t* stream, size_t length) const;
 
 	/**
 	*	Encrypt and pad a stream of bytes
@@ -101,19 +479,43 @@ public:
 	*	@param <size_t*>streamLength	Finished stream length
 	*	@param <bool>attachPadding		Attach padding to last block
 	*
-	*	@returns	<uint8_t*>		Pointer to encrypted data
+	*	@returns	<uint8_t*>		Pointer to encrypted data (NULL on error or if the observer cancelled)
+	*/
+	uint8_t* Encrypt(uint8_t* src, size_t length, size_t* streamLength, bool attachPadding = true) const;
+
+	/**
+	*	Get the buffer size EncryptInto needs for a message (padding room included)
+	*
+	*	@param <size_t>length			Plaintext length
+	*	@param <bool>attachPadding		Attach #PKCS7 padding
+	*
+	*	@returns <size_t>				Ciphertext length
+	*/
+	static size_t GetEncryptedSize(size_t length, bool attachPadding = true);
+
+	/**
+	*	Encrypt and pad into a caller provided buffer (no heap allocation, src is read once)
+	*
+	*	@param <uint8_t*>src			Plaintext
+	*	@param <size_t>length			Plaintext length
+	*	@param <uint8_t*>dst			Ciphertext buffer, may be src if it has room for the padding
+	*	@param <size_t>dstSize			Ciphertext buffer size (at least GetEncryptedSize(length, attachPadding))
+	*	@param <size_t*>dstLength		Ciphertext length
+	*	@param <bool>attachPadding		Attach #PKCS7 padding (without padding length must be a multiple of 16)
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL pointer, 0x02 dst too small, 0x03 bad length, 0x0B cancelled by the observer (dst is incomplete)
 	*/
-	uint8_t* Encrypt(uint8_t* src, size_t length, size_t* streamLength, bool attachPadding = true);
+	int EncryptInto(const uint8_t* src, size_t length, uint8_t* dst, size_t dstSize, size_t* dstLength, bool attachPadding = true) const;
 
 	/**
-	*	Encrypt and save file
+	*	Encrypt and save file (reading, encryption and writing overlap on separate threads)
 	*
 	*	@param <char*> inputFileName	Name of the source (input) file
 	*	@param <char*> outputFileName	Encrypted file's name
 	*
-	*	@returns <int>					Exit code
+	*	@returns <int>					Exit code: 0x00 success, 0x01 can't open input, 0x02 empty input, 0x03 can't create output, 0x04 read / write error, 0x05 out of memory, 0x0A NULL file name, 0x0B cancelled by the observer (the output is incomplete)
 	*/
-	int EncryptFileToFile(char* inputFileName, char* outputFileName);
+	int EncryptFileToFile(char* inputFileName, char* outputFileName) const;
 
 	/**
 	* 	Decrypt a single 16 byte long block*
@@ -121,26 +523,47 @@ public:
 	* 	@param	<uint8_t*>block			Array containing the data to be decrypted
 	*
 	*/
-	void DecryptBlock(uint8_t* block);
+	void DecryptBlock(uint8_t* block) const;
 
 	/**
-	* 	Decrypt stream of bytes
+	* 	Decrypt consecutive 16 byte long blocks (several blocks are kept in flight per round)
+	*
+	* 	@param	<uint8_t*>blocks		Array containing the data to be decrypted
+	*	@param <size_t>blockCount		Number of blocks
+	*
+	*/
+	void DecryptBlocks(uint8_t* blocks, size_t blockCount) const;
+
+	/**
+	* 	Decrypt consecutive 16 byte long blocks from src to dst in one pass
+	*
+	* 	@param	<uint8_t*>src			Blocks to be decrypted
+	*	@param <uint8_t*>dst			Decrypted blocks (may be src)
+	*	@param <size_t>blockCount		Number of blocks
+	*
+	*/
+	void DecryptBlocks(const uint8_t* src, uint8_t* dst, size_t blockCount) const;
+
+	/**
+	* 	Decrypt stream of bytes (whole blocks, src is read once and never modified; split across threads above the parallel size limit)
 	*
 	* 	@param	<uint8_t*>src			Source stream
 	*	@param <uint8_t*>dst			Destination stream
 	* 	@param <size_t>length			Source length
 	*
+	*	@returns <bool>					False if the observer cancelled (dst is left partly decrypted)
 	*/
-	void DecryptStream(uint8_t* src, uint8_t* dst, size_t length);
+	bool DecryptStream(const uint8_t* src, uint8_t* dst, size_t length) const;
 
 	/**
-	* 	Decrypt stream at original position
+	* 	Decrypt stream at original position (split across threads above the parallel size limit)
 	*
 	*	@param <uint8_t*>stream			Source stream
 	* 	@param <size_t>length			Source length
 	*
+	*	@returns <bool>					False if the observer cancelled (stream is left partly decrypted)
 	*/
-	void DecryptStreamOrigin(uint8_t* stream, size_t length);
+	bool DecryptStreamOrigin(uint8_t* stream, size_t length) const;
 
 	/**
 	*	Decrypt and pad a stream of bytes
@@ -150,19 +573,115 @@ public:
 	*	@param <size_t*> streamength	Finished stream length
 	*	@param <bool> removePadding		Remove padding from the last block
 	*
-	*	@returns	<uint8_t*>			Pointer to decrypted data
+	*	@returns	<uint8_t*>			Pointer to decrypted data (NULL on error, a malformed padding or if the observer cancelled)
 	*/
-	uint8_t* Decrypt(uint8_t* src, size_t length, size_t* streamLength, bool removePadding);
+	uint8_t* Decrypt(uint8_t* src, size_t length, size_t* streamLength, bool removePadding) const;
 
 	/**
-	*	Decrypt binary file to the original file
+	*	Decrypt into a caller provided buffer (no heap allocation, src is read once)
+	*
+	*	@param <uint8_t*>src			Ciphertext
+	*	@param <size_t>length			Ciphertext length (multiple of 16)
+	*	@param <uint8_t*>dst			Plaintext buffer, may be src
+	*	@param <size_t>dstSize			Plaintext buffer size (at least length, the padding is decrypted too)
+	*	@param <size_t*>dstLength		Plaintext length without the padding
+	*	@param <bool>removePadding		Check and remove #PKCS7 padding
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL pointer, 0x02 dst too small, 0x03 bad length, 0x04 bad padding, 0x0B cancelled by the observer (dst is incomplete)
+	*/
+	int DecryptInto(const uint8_t* src, size_t length, uint8_t* dst, size_t dstSize, size_t* dstLength, bool removePadding = true) const;
+
+	/**
+	*	Decrypt binary file to the original file (reading, decryption and writing overlap on separate threads)
 	* 
 	*	@param <char*> inputFileName	The encrypted file's name
 	*	@param <char*> outputFileName	Decrypted (output) file's name
 	* 
-	*	@returns <size_t>				Decrypted file's length in bytes
+	*	@returns <size_t>				Exit code: 0x00 success, 0x01 can't open input, 0x02 empty input, 0x03 bad file size, 0x04 can't create output, 0x05 read / write error, 0x06 out of memory, 0x07 bad padding, 0x0A NULL file name, 0x0B cancelled by the observer (the output is incomplete)
+	*/
+	size_t DecryptFileToFile(char* inputFileName, char* outputFileName) const;
+
+	/**
+	*	Encrypt a stream in CBC mode at original position (only whole blocks are encrypted)
+	*
+	*	@param <uint8_t*> stream		Source stream
+	*	@param <size_t> length			Source length
+	*	@param <uint8_t*> iv			16 byte initialization vector, updated to the last ciphertext block to chain the next call
+	*/
+	void EncryptStreamOriginCBC(uint8_t* stream, size_t length, uint8_t* iv) const;
+
+	/**
+	*	Encrypt several independent streams in CBC mode, one block of AES_CBC_LANES streams in flight at once
+	*
+	*	@param <uint8_t**> streams		Source streams (encrypted at original position, only whole blocks)
+	*	@param <size_t*> lengths		Source lengths
+	*	@param <uint8_t**> ivs			Initialization vector of every stream, updated like in EncryptStreamOriginCBC
+	*	@param <size_t> count			Number of streams
+	*/
+	void EncryptStreamsCBC(uint8_t** streams, const size_t* lengths, uint8_t** ivs, size_t count) const;
+
+	/**
+	*	Encrypt and pad a stream of bytes in CBC mode
+	*
+	*	@param <uint8_t*> src			Source stream
+	*	@param <size_t> length			Source length
+	*	@param <size_t*> streamLength	Finished stream length
+	*	@param <uint8_t*> iv			16 byte initialization vector
+	*	@param <bool> attachPadding		Pad the last block (#PKCS7)
+	*
+	*	@returns	<uint8_t*>			Pointer to encrypted data (NULL on error)
+	*/
+	uint8_t* EncryptCBC(uint8_t* src, size_t length, size_t* streamLength, const uint8_t* iv, bool attachPadding = true) const;
+
+	/**
+	*	Decrypt a stream in CBC mode at original position (split across threads above the parallel size limit)
+	*
+	*	@param <uint8_t*> stream		Source stream
+	*	@param <size_t> length			Source length
+	*	@param <uint8_t*> iv			16 byte initialization vector, updated to the last ciphertext block to chain the next call (left unchanged if cancelled)
+	*
+	*	@returns <bool>					False on a NULL stream or iv, or if the observer cancelled (stream is left partly decrypted)
+	*/
+	bool DecryptStreamOriginCBC(uint8_t* stream, size_t length, uint8_t* iv) const;
+
+	/**
+	*	Decrypt a stream of bytes in CBC mode
+	*
+	*	@param <uint8_t*> src			Source stream (multiple of 16 bytes)
+	*	@param <size_t> length			Source length
+	*	@param <size_t*> streamLength	Finished stream length
+	*	@param <uint8_t*> iv			16 byte initialization vector
+	*	@param <bool> removePadding		Check and remove #PKCS7 padding from the last block
+	*
+	*	@returns	<uint8_t*>			Pointer to decrypted data (NULL on error, bad padding or if the observer cancelled)
+	*/
+	uint8_t* DecryptCBC(uint8_t* src, size_t length, size_t* streamLength, const uint8_t* iv, bool removePadding = true) const;
+
+	/**
+	*	Encrypt a stream in CTR mode (no padding, src and dst may be the same buffer)
+	*
+	*	@param <uint8_t*> src			Source stream
+	*	@param <uint8_t*> dst			Destination stream (length bytes)
+	*	@param <size_t> length			Source length
+	*	@param <uint8_t*> counter		Initial 16 byte counter block (nonce and counter, incremented as a 128-bit big-endian number)
+	*	@param <uint64_t> offset		Byte offset of src in the whole stream (keystream starts at counter + offset / 16)
+	*
+	*	@returns <bool>					False on a NULL pointer, or if the observer cancelled (dst is left partly encrypted)
 	*/
-	size_t DecryptFileToFile(char* inputFileName, char* outputFileName);
+	bool EncryptCTR(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* counter, uint64_t offset = 0) const;
+
+	/**
+	*	Decrypt a stream in CTR mode (same operation as EncryptCTR)
+	*
+	*	@param <uint8_t*> src			Source stream
+	*	@param <uint8_t*> dst			Destination stream (length bytes)
+	*	@param <size_t> length			Source length
+	*	@param <uint8_t*> counter		Initial 16 byte counter block used for encryption
+	*	@param <uint64_t> offset		Byte offset of src in the whole stream
+	*
+	*	@returns <bool>					False on a NULL pointer, or if the observer cancelled (dst is left partly decrypted)
+	*/
+	bool DecryptCTR(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* counter, uint64_t offset = 0) const;
 
 	//Other headers (will probably delete)
 	//int DecryptFileToFile(char* inputFileName, char* outputFileName, size_t* decryptedSizePtr, size_t* fullSizePtr);
@@ -175,7 +694,7 @@ public:
 	*
 	*	@returns <size_t>			The input file's size in bytes
 	*/
-	size_t GetFileSizeBytes(FILE* file);
+	size_t GetFileSizeBytes(FILE* file) const;
 
 	/**
 	*	Get a file's size int bytes
@@ -184,32 +703,33 @@ public:
 	*
 	*	@returns <size_t>			The input file's size in bytes
 	*/
-	size_t GetFileSizeBytes(char* fileName);
-
-private:
+	size_t GetFileSizeBytes(char* fileName) const;
 
 	/**
-	*	Substitute a single byte
+	*	Open a file (fopen_s on MSVC, fopen elsewhere)
 	*
-	*	@param <uint8_t>byte The byte to replace*
+	*	@param <char*> fileName			File name
+	*	@param <char*> mode				fopen mode string
 	*
-	*	@returns uint8_t Corresponding byte according to sBox
+	*	@returns <FILE*>				Opened file (NULL on error)
 	*/
-	uint8_t SubByteSingle(uint8_t byte);
+	static FILE* OpenFile(const char* fileName, const char* mode);
+
+private:
 
 	/**
 	*	Substitute bytes in block
 	*
 	*	@param <uint8_t>byte The block of data to work on
 	*/
-	void SubBytes(uint8_t* block);
+	static void SubBytes(uint8_t* block);
 
 	/**
 	*	Inverse substitute bytes in block
 	*
 	*	@param <uint8_t>byte The blockof data to work on
 	*/
-	void SubBytesInv(uint8_t* block);
+	static void SubBytesInv(uint8_t* block);
 
 	/**
 	* 	Shift rows left in block
@@ -217,7 +737,7 @@ private:
 	* 	@param <uint8_t*>block		The block of data to work on
 	*
 	*/
-	void ShiftRowsLeft(uint8_t* block);
+	static void ShiftRowsLeft(uint8_t* block);
 
 	/**
 	* 	Shift rows right in block
@@ -225,15 +745,15 @@ private:
 	* 	@param <uint8_t*>block		The block of data to work on
 	*
 	*/
-	void ShiftRowsRight(uint8_t* block);
+	static void ShiftRowsRight(uint8_t* block);
 
 	/**
-	* 	Mix columns round
+	* 	Mix columns round (constant multiplies as xtime chains)
 	*
 	* 	@param <uint8_t*>block		The block of data to work on
 	*
 	*/
-	void MixColumns(uint8_t* block);
+	static void MixColumns(uint8_t* block);
 
 	/**
 	* 	Inverse mix columns round
@@ -241,41 +761,234 @@ private:
 	* 	@param <uint8_t*>block		The blockof data to work on
 	*
 	*/
-	void MixColumnsInv(uint8_t* block);
+	static void MixColumnsInv(uint8_t* block);
 
 	/**
-		Galois field GF(2^8) multiplication
+	* 	Encrypt a single block with the reference rounds
+	*
+	* 	@param	<uint8_t*>block			Array containing the data to be encrypted
+	*
+	*/
+	template<uint8_t Rounds>
+	void EncryptBlockReference(uint8_t* block) const;
 
-		@param <uint8_t>Multiplicant
-		@param <uint8_t>Multiplier
+	/**
+	* 	Decrypt a single block with the reference rounds (equivalent inverse cipher)
+	*
+	* 	@param	<uint8_t*>block			Array containing the data to be decrypted
+	*
 	*/
-	uint8_t GFMult(uint8_t multiplier, uint16_t multiplicant);
+	template<uint8_t Rounds>
+	void DecryptBlockReference(uint8_t* block) const;
 
 	/**
-	* 	Add key to a blockof data
+	* 	Encrypt a single block with the T-table engine
 	*
-	* 	@param <uint8_t*>block		The block to add key
-	* 	@param <uint8_t>keyNum		Number of the key stage
+	* 	@param	<uint8_t*>src			Block to be encrypted
+	*	@param <uint8_t*>dst			Encrypted block (may be src)
+	*
+	*/
+	template<uint8_t Rounds>
+	void EncryptBlockTTable(const uint8_t* src, uint8_t* dst) const;
+
+	/**
+	* 	Encrypt consecutive blocks with the T-table engine, four blocks interleaved
+	*
+	* 	@param	<uint8_t*>src			Blocks to be encrypted
+	*	@param <uint8_t*>dst			Encrypted blocks (may be src)
+	*	@param <size_t>blockCount		Number of blocks
+	*
+	*/
+	template<uint8_t Rounds>
+	void EncryptBlocksTTable(const uint8_t* src, uint8_t* dst, size_t blockCount) const;
+
+	/**
+	* 	Decrypt a single block with the T-table engine
+	*
+	* 	@param	<uint8_t*>src			Block to be decrypted
+	*	@param <uint8_t*>dst			Decrypted block (may be src)
+	*
+	*/
+	template<uint8_t Rounds>
+	void DecryptBlockTTable(const uint8_t* src, uint8_t* dst) const;
+
+	/**
+	* 	Decrypt consecutive blocks with the T-table engine, four blocks interleaved
+	*
+	* 	@param	<uint8_t*>src			Blocks to be decrypted
+	*	@param <uint8_t*>dst			Decrypted blocks (may be src)
+	*	@param <size_t>blockCount		Number of blocks
+	*
+	*/
+	template<uint8_t Rounds>
+	void DecryptBlocksTTable(const uint8_t* src, uint8_t* dst, size_t blockCount) const;
+
+	/**
+	* 	Get the stream length after padding
+	*
+	*	@param <size_t> length			Source length
+	*	@param <bool> attachPadding		Pad the last block (#PKCS7)
+	*
+	*	@returns <size_t>				Padded length
+	*/
+	static size_t PaddedLength(size_t length, bool attachPadding);
+
+	/**
+	* 	Pad a stream with #PKCS7 (the buffer must hold PaddedLength(length, true) bytes)
+	*
+	*	@param <uint8_t*> stream		Stream to pad
+	*	@param <size_t> length			Stream length before padding
+	*/
+	static void AttachPadding(uint8_t* stream, size_t length);
+
+	/**
+	* 	Check the #PKCS7 padding of a decrypted stream (every padding byte, without branching on their values)
+	*
+	*	@param <uint8_t*> stream		Decrypted stream
+	*	@param <size_t> length			Decrypted stream length (multiple of 16, at least 16)
+	*	@param <size_t*> dstLength		Length without padding (only set if the padding is valid)
+	*
+	*	@returns <bool>					False if the padding is malformed
+	*/
+	static bool CheckPadding(const uint8_t* stream, size_t length, size_t* dstLength);
+
+	/**
+	* 	Decrypt consecutive blocks in CBC mode on the calling thread
+	*
+	*	@param <uint8_t*> blocks		Blocks to decrypt at original position
+	*	@param <size_t> blockCount		Number of blocks
+	*	@param <uint8_t*> prev			Ciphertext block before the first block (or the IV)
+	*/
+	void DecryptBlocksCBC(uint8_t* blocks, size_t blockCount, const uint8_t* prev) const;
+
+	/**
+	* 	XOR a CTR keystream into a stream on the calling thread
+	*
+	*	@param <uint8_t*> src			Source stream
+	*	@param <uint8_t*> dst			Destination stream
+	*	@param <size_t> length			Source length
+	*	@param <uint8_t*> counter		Initial counter block
+	*	@param <uint64_t> offset		Byte offset of src in the whole stream
+	*/
+	void CryptCTRRange(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* counter, uint64_t offset) const;
+
+	/**
+	* 	Add to a 128-bit big-endian counter block
+	*
+	*	@param <uint8_t*> counter		Counter block
+	*	@param <uint64_t> value			Number of blocks to add
+	*/
+	static void CounterAdd(uint8_t* counter, uint64_t value);
+
+	/**
+	* 	Check if a stream should be split across threads
+	*
+	* 	@param	<size_t>length			Stream length in bytes
+	*
+	*	@returns <bool>					True if the stream is long enough to split
+	*/
+	bool UseParallel(size_t length) const;
+
+	/**
+	* 	Check if a stream should be split into chunks (to run them in parallel or to report them to the observer)
+	*
+	* 	@param	<size_t>length			Stream length in bytes
+	*
+	*	@returns <bool>					True if the stream takes more than one chunk and is parallel or observed
+	*/
+	bool UseChunks(size_t length) const;
+
+	/**
+	* 	Run a stream as AES_PARALLEL_CHUNK_SIZE chunks, on parallel threads if UseParallel, one observer report per chunk
 	*
+	* 	@param	<size_t>length			Stream length in bytes
+	*	@param <std::function>crypt		Processes one chunk: (offset, length), chunks are independent
+	*
+	*	@returns <bool>					False if the observer cancelled (the remaining chunks were skipped)
+	*/
+	bool CryptChunks(size_t length, const std::function<void(size_t, size_t)>& crypt) const;
+
+	/**
+	* 	Run a file through the reader -> cipher -> writer pipeline (ring of AES_FILE_BUFFER_COUNT buffers)
+	*
+	* 	@param	<FILE*>inputFile		Source file, positioned at the start
+	*	@param <FILE*>outputFile		Destination file
+	*	@param <size_t>length			Bytes to read from inputFile
+	*	@param <bool>encrypt			True: encrypt and pad, false: decrypt and remove the padding
+	*
+	*	@param <AESProgressTracker&>progress	Progress of the file (one report per written chunk)
+	*
+	*	@returns <int>					0x00 success, 0x01 read / write error, 0x02 out of memory, 0x03 bad padding, 0x05 cancelled
 	*/
-	void AddRoundKey(uint8_t* block, uint8_t keyNum);
+	int CryptFilePipeline(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const;
 
 	/**
-	* 	Expand AES keys
+	* 	Map both files and run the cipher from the input pages straight into the output pages
 	*
-	* 	@param <uint8_t*>srcKey		Source key
-	* 	@param <uint8_t*>dstKey		Destination key
-	* 	@param <uint8_t>keyNum		Expanded key’s number
+	* 	@param	<FILE*>inputFile		Source file
+	*	@param <FILE*>outputFile		Destination file (empty, resized here)
+	*	@param <size_t>length			Source length
+	*	@param <bool>encrypt			True: encrypt and pad, false: decrypt and remove the padding
+	*	@param <AESProgressTracker&>progress	Progress of the file
 	*
+	*	@returns <int>					Codes of CryptFilePipeline, 0x04 if the files can't be mapped (nothing written, use the pipeline)
 	*/
-	void ExpandKey(uint8_t* srcKey, uint8_t* dstKey, uint8_t keyNum);
+	int CryptFileMapped(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const;
 
 	/**
-	* 	Calculate aes key stages (Input must be 16 bytes long!)
+	* 	Run a file through io_uring: fileQueueDepth reads and writes in flight, each read is encrypted as soon as it completes
+	*
+	* 	@param	<FILE*>inputFile		Source file
+	*	@param <FILE*>outputFile		Destination file (empty)
+	*	@param <size_t>length			Source length
+	*	@param <bool>encrypt			True: encrypt and pad, false: decrypt and remove the padding
+	*	@param <AESProgressTracker&>progress	Progress of the file
 	*
-	* 	@param	<char*>key			AES Secret key
+	*	@returns <int>					Codes of CryptFilePipeline, 0x04 if io_uring is not available (nothing written, use the pipeline)
+	*/
+	int CryptFileUring(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const;
+
+	/**
+	* 	Split a file into AES_FILE_BUFFER_SIZE ranges, threads pread, encrypt and pwrite them at the same offset (only the last range is padded)
+	*
+	* 	@param	<FILE*>inputFile		Source file
+	*	@param <FILE*>outputFile		Destination file (empty)
+	*	@param <size_t>length			Source length
+	*	@param <bool>encrypt			True: encrypt and pad, false: decrypt and remove the padding
+	*	@param <AESProgressTracker&>progress	Progress of the file
+	*
+	*	@returns <int>					Codes of CryptFilePipeline, 0x04 if the files have no positioned I/O (nothing written, use the pipeline)
+	*/
+	int CryptFileParallel(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const;
+
+	/**
+	* 	Run a file through the selected file mode
+	*
+	* 	@param	<FILE*>inputFile		Source file, positioned at the start
+	*	@param <FILE*>outputFile		Destination file
+	*	@param <size_t>length			Source length
+	*	@param <bool>encrypt			True: encrypt and pad, false: decrypt and remove the padding
+	*
+	*	@returns <int>					Codes of CryptFilePipeline
+	*/
+	int CryptFile(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt) const;
+
+	/**
+	* 	Add key to a blockof data
+	*
+	* 	@param <uint8_t*>block		The block to add key
+	* 	@param <uint8_t>keyNum		Number of the key stage
+	*
+	*/
+	void AddRoundKey(uint8_t* block, uint8_t keyNum) const;
+
+	/**
+	* 	Add decryption key to a block of data (equivalent inverse cipher)
+	*
+	* 	@param <uint8_t*>block		The block to add key
+	* 	@param <uint8_t>keyNum		Number of the decryption round (0: first, rounds: last)
 	*
 	*/
-	void CalculateKeys(char* key);
+	void AddRoundKeyInv(uint8_t* block, uint8_t keyNum) const;
 
 };
@@ -0,0 +1,403 @@
+#include "aes_config.h"
+#include "aes_batch.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef AES_POSIX
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+*	Work item: open a file (chunk < 0) or process one chunk of a split file
+*/
+struct AES_BATCH_TASK {
+	uint32_t file;
+	long long chunk;
+};
+
+/**
+*	Open files of a split file, closed by the worker that finishes its last chunk
+*/
+struct AES_BATCH_STATE {
+	FILE* input = NULL;
+	FILE* output = NULL;
+	size_t length = 0;
+	long long chunks = 0;
+	std::atomic<long long> remaining{ 0 };		//Chunks not done yet
+	std::atomic<int> error{ 0x00 };				//First error: 0x01 read / write, 0x03 bad padding
+	std::mutex io;								//Serializes seek + transfer where there is no positioned I/O
+};
+
+/**
+*	Task queue of one worker: the owner works from the back, thieves take from the front
+*/
+class AESBatchQueue {
+
+private:
+
+	std::deque<AES_BATCH_TASK> tasks;
+	std::mutex lock;
+
+public:
+
+	//
+	void Push(const AES_BATCH_TASK& task) {
+		std::lock_guard<std::mutex> guard(lock);
+		tasks.push_back(task);
+	}
+
+	//Newest task of the owner (the chunks it just split off stay warm in its cache)
+	bool Pop(AES_BATCH_TASK* task) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (tasks.empty())	return false;
+		*task = tasks.back();
+		tasks.pop_back();
+		return true;
+	}
+
+	//Oldest task for another worker
+	bool Steal(AES_BATCH_TASK* task) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (tasks.empty())	return false;
+		*task = tasks.front();
+		tasks.pop_front();
+		return true;
+	}
+};
+
+//Internal result (0x01 read / write, 0x02 out of memory, 0x03 bad padding) -> exit code of the file functions
+static int AESBatch_ExitCode(int result, bool encrypt) {
+	switch (result) {
+	case 0x00:	return 0x00;
+	case 0x02:	return encrypt ? 0x05 : 0x06;		//Out of memory
+	case 0x03:	return encrypt ? 0x04 : 0x07;		//Bad padding
+	default:	return encrypt ? 0x04 : 0x05;		//Read / write error
+	}
+}
+
+#ifdef AES_POSIX
+
+//Read a whole range of the input at an offset (continues short reads)
+static bool AESBatch_ReadAt(AES_BATCH_STATE& state, uint8_t* buffer, size_t length, uint64_t offset) {
+	int fd = fileno(state.input);
+	while (length > 0) {
+		ssize_t n = pread(fd, buffer, length, (off_t)offset);
+		if (n < 0 && errno == EINTR)	continue;
+		if (n <= 0)						return false;
+		buffer += n;
+		length -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+	return true;
+}
+
+//Write a whole range of the output at an offset (continues short writes)
+static bool AESBatch_WriteAt(AES_BATCH_STATE& state, const uint8_t* buffer, size_t length, uint64_t offset) {
+	int fd = fileno(state.output);
+	while (length > 0) {
+		ssize_t n = pwrite(fd, buffer, length, (off_t)offset);
+		if (n < 0 && errno == EINTR)	continue;
+		if (n <= 0)						return false;
+		buffer += n;
+		length -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+	return true;
+}
+
+#else
+
+//No positioned reads: seek and read under the file's lock (the cipher still runs on many workers)
+static bool AESBatch_ReadAt(AES_BATCH_STATE& state, uint8_t* buffer, size_t length, uint64_t offset) {
+	std::lock_guard<std::mutex> guard(state.io);
+	if (_fseeki64(state.input, (long long)offset, SEEK_SET) != 0)	return false;
+	return fread(buffer, 1, length, state.input) == length;
+}
+
+//
+static bool AESBatch_WriteAt(AES_BATCH_STATE& state, const uint8_t* buffer, size_t length, uint64_t offset) {
+	std::lock_guard<std::mutex> guard(state.io);
+	if (_fseeki64(state.output, (long long)offset, SEEK_SET) != 0)	return false;
+	return fwrite(buffer, 1, length, state.output) == length;
+}
+
+#endif
+
+//
+AESBatch::AESBatch(const AES& aes) : aes(aes) {
+	//Every worker already runs its own file or chunk, the cipher inside stays single-threaded
+	this->aes.SetThreadNum(1);
+
+	//Chunks of many files finish in any order, progress of single files is not reported
+	this->aes.SetObserver(NULL);
+}
+
+//
+void AESBatch::SetThreadNum(int threadNum) {
+	this->threadNum = threadNum < 0 ? 0 : threadNum;
+}
+
+//
+void AESBatch::Add(const char* input, const char* output) {
+	if (input == NULL || output == NULL)	return;
+
+	AES_BATCH_FILE file;
+	file.input = input;
+	file.output = output;
+	files.push_back(file);
+}
+
+//
+int AESBatch::AddDirectory(const char* inputDir, const char* outputDir) {
+	if (inputDir == NULL || outputDir == NULL)	return 0x0A;
+
+	namespace fs = std::filesystem;
+	std::error_code error;
+
+	fs::path inputRoot(inputDir), outputRoot(outputDir);
+	fs::recursive_directory_iterator it(inputRoot, error), end;
+	if (error)		return 0x01;		//Error while opening source directory
+
+	if (!fs::create_directories(outputRoot, error) && error)	return 0x02;
+
+	for (; it != end; it.increment(error)) {
+		if (error)	return 0x01;
+
+		fs::path target = outputRoot / fs::relative(it->path(), inputRoot, error);
+		if (error)	return 0x01;
+
+		if (it->is_directory(error)) {
+			if (!fs::create_directories(target, error) && error)	return 0x02;
+			continue;
+		}
+
+		if (it->is_regular_file(error))
+			Add(it->path().string().c_str(), target.string().c_str());
+	}
+
+	return 0x00;
+}
+
+//
+void AESBatch::Clear() {
+	files.clear();
+}
+
+//
+size_t AESBatch::EncryptFiles() {
+	return Run(true);
+}
+
+//
+size_t AESBatch::DecryptFiles() {
+	return Run(false);
+}
+
+//
+const std::vector<AES_BATCH_FILE>& AESBatch::GetFiles() const {
+	return files;
+}
+
+//
+size_t AESBatch::Run(bool encrypt) {
+	if (files.empty())	return 0;
+
+	int workers = threadNum > 0 ? threadNum : (int)std::thread::hardware_concurrency();
+	if (workers < 1)	workers = 1;
+
+	//Files past AES_FILE_BUFFER_SIZE are split, so one large file keeps every worker busy: no more workers than chunks
+	size_t tasks = 0;
+	for (const AES_BATCH_FILE& file : files) {
+		std::error_code error;
+		uintmax_t size = std::filesystem::file_size(file.input, error);
+		tasks += (error || size <= AES_FILE_BUFFER_SIZE) ? 1 : (size_t)((size + AES_FILE_BUFFER_SIZE - 1) / AES_FILE_BUFFER_SIZE);
+	}
+	if ((size_t)workers > tasks)	workers = (int)tasks;
+
+	std::vector<AESBatchQueue> queues(workers);
+	std::vector<std::unique_ptr<AES_BATCH_STATE>> states(files.size());
+	std::atomic<size_t> pending(files.size());		//Tasks queued or running, the workers stop at 0
+
+	//Idle workers sleep until new chunks are queued or the last task is done
+	std::mutex idleLock;
+	std::condition_variable idle;
+	std::atomic<uint64_t> posted(0);				//Bumped under idleLock whenever tasks are queued
+
+	for (size_t f = 0; f < files.size(); f++) {
+		files[f].status = -1;
+		queues[f % workers].Push(AES_BATCH_TASK{ (uint32_t)f, -1 });
+	}
+
+	//Cipher one chunk in place (only the last chunk of a file is padded / unpadded)
+	auto Cipher = [&](uint8_t* buffer, size_t length, size_t* outLength, bool last) {
+		int code = encrypt
+			? aes.EncryptInto(buffer, length, buffer, AES_FILE_BUFFER_SIZE + 16, outLength, last)
+			: aes.DecryptInto(buffer, length, buffer, AES_FILE_BUFFER_SIZE + 16, outLength, last);
+		return code == 0x00 ? 0x00 : (code == 0x04 ? 0x03 : 0x01);
+	};
+
+	//Finish a file: close it and set its status
+	auto Finish = [&](uint32_t f, FILE* input, FILE* output, int result) {
+		if (fclose(output) != 0 && result == 0x00)	result = 0x01;
+		fclose(input);
+		files[f].status = AESBatch_ExitCode(result, encrypt);
+	};
+
+	//Open a file: small files (and streams that can't seek) are done right here, large ones are split into chunk tasks
+	auto Open = [&](int self, uint32_t f, uint8_t* buffer) {
+		if (buffer == NULL)						{ files[f].status = encrypt ? 0x05 : 0x06; return; }		//Out of memory
+
+		FILE* input = AES::OpenFile(files[f].input.c_str(), "rb");
+		if (input == NULL)						{ files[f].status = 0x01; return; }		//Error while opening source file
+
+		size_t length = aes.GetFileSizeBytes(input);
+		if (length < 1)							{ fclose(input); files[f].status = 0x02; return; }		//Empty input file
+		if (!encrypt && (length & 0x0F) != 0)	{ fclose(input); files[f].status = 0x03; return; }		//Bad file size
+
+		FILE* output = AES::OpenFile(files[f].output.c_str(), "wb");
+		if (output == NULL)						{ fclose(input); files[f].status = encrypt ? 0x03 : 0x04; return; }		//Error creating output file
+
+		long long chunks = (long long)((length + AES_FILE_BUFFER_SIZE - 1) / AES_FILE_BUFFER_SIZE);
+		bool split = chunks > 1;
+
+#ifdef AES_POSIX
+		struct stat inputStat, outputStat;
+		if (fstat(fileno(input), &inputStat) != 0 || fstat(fileno(output), &outputStat) != 0 ||
+			!S_ISREG(inputStat.st_mode) || !S_ISREG(outputStat.st_mode))
+			split = false;
+#else
+		//Split chunks seek the files, a stream that can't seek is done sequentially
+		if (_fseeki64(output, 0, SEEK_SET) != 0)
+			split = false;
+#endif
+
+		if (split) {
+			AES_BATCH_STATE* state = new AES_BATCH_STATE();
+			state->input = input;
+			state->output = output;
+			state->length = length;
+			state->chunks = chunks;
+			state->remaining = chunks;
+			states[f].reset(state);
+
+			//The chunks go to this worker's queue, idle workers steal them from there
+			pending += (size_t)chunks;
+			for (long long c = 0; c < chunks; c++)
+				queues[self].Push(AES_BATCH_TASK{ f, c });
+
+			{
+				std::lock_guard<std::mutex> guard(idleLock);
+				posted++;
+			}
+			idle.notify_all();
+			return;
+		}
+
+		//Sequential pass through one buffer
+		int result = 0x00;
+		size_t remaining = length;
+
+		while (remaining > 0 && result == 0x00) {
+			size_t chunk = remaining < AES_FILE_BUFFER_SIZE ? remaining : AES_FILE_BUFFER_SIZE;
+			size_t outLength = 0;
+
+			if (fread(buffer, 1, chunk, input) != chunk)	{ result = 0x01; break; }
+			remaining -= chunk;
+
+			result = Cipher(buffer, chunk, &outLength, remaining == 0);
+			if (result == 0x00 && outLength > 0 && fwrite(buffer, 1, outLength, output) != outLength)
+				result = 0x01;
+		}
+
+		Finish(f, input, output, result);
+	};
+
+	//Process one chunk of a split file at its own offset
+	auto Chunk = [&](uint32_t f, long long c, uint8_t* buffer) {
+		AES_BATCH_STATE* state = states[f].get();
+
+		int expected = 0x00;
+		if (buffer == NULL)
+			state->error.compare_exchange_strong(expected, 0x02);
+
+		//Chunks of a file that already failed are only counted off
+		if (state->error.load() == 0x00) {
+			uint64_t offset = (uint64_t)c * AES_FILE_BUFFER_SIZE;
+			size_t chunk = state->length - offset < AES_FILE_BUFFER_SIZE ? (size_t)(state->length - offset) : AES_FILE_BUFFER_SIZE;
+			size_t outLength = 0;
+			int result = 0x01;
+
+			if (AESBatch_ReadAt(*state, buffer, chunk, offset)) {
+				result = Cipher(buffer, chunk, &outLength, c == state->chunks - 1);
+				if (result == 0x00 && !AESBatch_WriteAt(*state, buffer, outLength, offset))
+					result = 0x01;
+			}
+
+			if (result != 0x00)
+				state->error.compare_exchange_strong(expected, result);
+		}
+
+		if (--state->remaining == 0) {
+			Finish(f, state->input, state->output, state->error.load());
+			states[f].reset();
+		}
+	};
+
+	auto Worker = [&](int self) {
+		uint8_t* buffer = (uint8_t*)malloc(AES_FILE_BUFFER_SIZE + 16);
+		AES_BATCH_TASK task;
+
+		while (pending.load() > 0) {
+			uint64_t seen = posted.load();
+			bool found = queues[self].Pop(&task);
+
+			//Out of work: steal the oldest task of the next busy worker
+			for (int i = 1; !found && i < workers; i++)
+				found = queues[(self + i) % workers].Steal(&task);
+
+			//Nothing to steal: wait for a split file's chunks or the end of the batch
+			if (!found) {
+				std::unique_lock<std::mutex> guard(idleLock);
+				idle.wait(guard, [&] { return posted.load() != seen || pending.load() == 0; });
+				continue;
+			}
+
+			if (task.chunk < 0)
+				Open(self, task.file, buffer);
+			else
+				Chunk(task.file, task.chunk, buffer);
+
+			if (--pending == 0) {
+				std::lock_guard<std::mutex> guard(idleLock);
+				idle.notify_all();
+			}
+		}
+
+		if (buffer != NULL) {
+			AES_SecureZero(buffer, AES_FILE_BUFFER_SIZE + 16);
+			free(buffer);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < workers; i++)
+		threads.emplace_back(Worker, i);
+	Worker(0);
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	size_t failed = 0;
+	for (const AES_BATCH_FILE& file : files)
+		if (file.status != 0x00)	failed++;
+
+	return failed;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "aes.h"
+
+/*
+*
+*	Encryption and decryption of many files on one shared thread pool
+*
+*	Every file starts as one task. A file up to AES_FILE_BUFFER_SIZE is done by that task, a larger one
+*	is split into AES_FILE_BUFFER_SIZE chunks that are read, encrypted and written at their own offset
+*	(pread / pwrite, or seek + read / write under a per-file lock without POSIX; only the last chunk is
+*	padded). Each worker keeps its own task queue and steals from the others when it runs dry (and sleeps
+*	when there is nothing to steal), so small files and the chunks of large files keep every thread busy.
+*	A batch starts no more workers than it has chunks, a single large file still runs on every thread.
+*
+*	Usage: Add / AddDirectory -> EncryptFiles or DecryptFiles -> GetFiles (status of each file)
+*
+*/
+
+/**
+*	One file of a batch
+*/
+struct AES_BATCH_FILE {
+	std::string input;						//Source file
+	std::string output;						//Destination file
+	int status = -1;						//Exit code of EncryptFileToFile / DecryptFileToFile, -1 before the batch ran
+};
+
+class AESBatch {
+
+private:
+
+	AES aes;								//Block cipher (shares the key schedule)
+
+	std::vector<AES_BATCH_FILE> files;		//Files in the order they were added
+
+	int threadNum = 0;						//Worker threads (0: one per hardware thread)
+
+public:
+
+	/**
+	*	Create an empty batch on an initialized AES object
+	*
+	*	@param <AES&> aes				AES object (copied, the key schedule is shared, its observer is not used)
+	*/
+	explicit AESBatch(const AES& aes);
+
+	/**
+	*	Set the number of worker threads
+	*
+	*	@param <int> threadNum			Number of threads (0: one per hardware thread)
+	*/
+	void SetThreadNum(int threadNum);
+
+	/**
+	*	Add a file
+	*
+	*	@param <char*> input			Source file
+	*	@param <char*> output			Destination file (its directory must exist)
+	*/
+	void Add(const char* input, const char* output);
+
+	/**
+	*	Add every regular file of a directory tree, the tree is mirrored under the output directory
+	*
+	*	@param <char*> inputDir			Source directory
+	*	@param <char*> outputDir		Destination directory (created with the subdirectories)
+	*
+	*	@returns <int>					0x00 on success, 0x01 the input directory can't be read, 0x02 an output directory can't be created, 0x0A NULL pointer
+	*/
+	int AddDirectory(const char* inputDir, const char* outputDir);
+
+	/**
+	*	Drop every file
+	*/
+	void Clear();
+
+	/**
+	*	Encrypt every file with #PKCS7 padding, each status is set to the exit code of EncryptFileToFile
+	*
+	*	@returns <size_t>				Number of files that failed
+	*/
+	size_t EncryptFiles();
+
+	/**
+	*	Decrypt every file and remove the padding, each status is set to the exit code of DecryptFileToFile
+	*
+	*	@returns <size_t>				Number of files that failed
+	*/
+	size_t DecryptFiles();
+
+	/**
+	*	Get the files and their status
+	*
+	*	@returns <std::vector>			Files in the order they were added
+	*/
+	const std::vector<AES_BATCH_FILE>& GetFiles() const;
+
+private:
+
+	/**
+	*	Run every file through the worker pool
+	*
+	*	@param <bool> encrypt			True: encrypt and pad, false: decrypt and remove the padding
+	*
+	*	@returns <size_t>				Number of files that failed
+	*/
+	size_t Run(bool encrypt);
+
+};
@@ -0,0 +1,129 @@
+#include <string.h>
+
+#include "aes_config.h"
+#include "aes_ni.h"
+#include "aes_bitslice.h"
+
+//
+void Bitslice_ExpandKey(const uint8_t* roundKeys, uint8_t rounds, uint16_t* bsKeys) {
+	for (uint8_t r = 0; r <= rounds; r++)
+		for (uint8_t k = 0; k < 8; k++) {
+			uint16_t plane = 0;
+			for (uint8_t i = 0; i < 16; i++)
+				plane |= (uint16_t)((roundKeys[r * 16 + i] >> k) & 0x01) << i;
+			bsKeys[r * 8 + k] = plane;
+		}
+}
+
+#ifdef AES_X86
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+//SSE2, 8 blocks per pass
+
+#define BS_VEC				__m128i
+#define BS_LANES			8
+#define BS_TARGET			AES_TARGET("sse2")
+#define BS_FN(name)			Bitslice128_##name
+#define BS_XOR(a, b)		_mm_xor_si128(a, b)
+#define BS_AND(a, b)		_mm_and_si128(a, b)
+#define BS_OR(a, b)			_mm_or_si128(a, b)
+#define BS_NOT(a)			_mm_xor_si128(a, _mm_set1_epi32(-1))
+#define BS_SRL16(a, n)		_mm_srli_epi16(a, n)
+#define BS_SLL16(a, n)		_mm_slli_epi16(a, n)
+#define BS_SET16(x)			_mm_set1_epi16((short)(x))
+#define BS_LOAD(p)			_mm_load_si128((const __m128i*)(p))
+#define BS_STORE(p, v)		_mm_store_si128((__m128i*)(p), v)
+
+#include "aes_bitslice_kernel.h"
+
+#undef BS_VEC
+#undef BS_LANES
+#undef BS_TARGET
+#undef BS_FN
+#undef BS_XOR
+#undef BS_AND
+#undef BS_OR
+#undef BS_NOT
+#undef BS_SRL16
+#undef BS_SLL16
+#undef BS_SET16
+#undef BS_LOAD
+#undef BS_STORE
+
+//AVX2, 16 blocks per pass
+
+#define BS_VEC				__m256i
+#define BS_LANES			16
+#define BS_TARGET			AES_TARGET("avx2")
+#define BS_FN(name)			Bitslice256_##name
+#define BS_XOR(a, b)		_mm256_xor_si256(a, b)
+#define BS_AND(a, b)		_mm256_and_si256(a, b)
+#define BS_OR(a, b)			_mm256_or_si256(a, b)
+#define BS_NOT(a)			_mm256_xor_si256(a, _mm256_set1_epi32(-1))
+#define BS_SRL16(a, n)		_mm256_srli_epi16(a, n)
+#define BS_SLL16(a, n)		_mm256_slli_epi16(a, n)
+#define BS_SET16(x)			_mm256_set1_epi16((short)(x))
+#define BS_LOAD(p)			_mm256_load_si256((const __m256i*)(p))
+#define BS_STORE(p, v)		_mm256_store_si256((__m256i*)(p), v)
+
+#include "aes_bitslice_kernel.h"
+
+//
+bool Bitslice_Supported() {
+	return (AES_CPUFeatures() & AES_CPU_SSE2) != 0;
+}
+
+//Pick the vector width, then the round count
+template<uint8_t Rounds>
+static void Bitslice_EncryptBlocksRounds(const uint16_t* bsKeys, const uint8_t* src, uint8_t* dst, size_t blockCount) {
+	if (AES_CPUFeatures() & AES_CPU_AVX2)
+		Bitslice256_EncryptBlocks<Rounds>(bsKeys, src, dst, blockCount);
+	else
+		Bitslice128_EncryptBlocks<Rounds>(bsKeys, src, dst, blockCount);
+}
+
+//
+template<uint8_t Rounds>
+static void Bitslice_DecryptBlocksRounds(const uint16_t* bsKeys, const uint8_t* src, uint8_t* dst, size_t blockCount) {
+	if (AES_CPUFeatures() & AES_CPU_AVX2)
+		Bitslice256_DecryptBlocks<Rounds>(bsKeys, src, dst, blockCount);
+	else
+		Bitslice128_DecryptBlocks<Rounds>(bsKeys, src, dst, blockCount);
+}
+
+//
+void Bitslice_EncryptBlocks(const uint16_t* bsKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount) {
+	switch (rounds) {
+	case 12:	Bitslice_EncryptBlocksRounds<12>(bsKeys, src, dst, blockCount);	break;
+	case 14:	Bitslice_EncryptBlocksRounds<14>(bsKeys, src, dst, blockCount);	break;
+	default:	Bitslice_EncryptBlocksRounds<10>(bsKeys, src, dst, blockCount);	break;
+	}
+}
+
+//
+void Bitslice_DecryptBlocks(const uint16_t* bsKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount) {
+	switch (rounds) {
+	case 12:	Bitslice_DecryptBlocksRounds<12>(bsKeys, src, dst, blockCount);	break;
+	case 14:	Bitslice_DecryptBlocksRounds<14>(bsKeys, src, dst, blockCount);	break;
+	default:	Bitslice_DecryptBlocksRounds<10>(bsKeys, src, dst, blockCount);	break;
+	}
+}
+
+#else
+
+//No SIMD kernel on this target
+
+//
+bool Bitslice_Supported() {
+	return false;
+}
+
+//
+void Bitslice_EncryptBlocks(const uint16_t* bsKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount) {}
+
+//
+void Bitslice_DecryptBlocks(const uint16_t* bsKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount) {}
+
+#endif
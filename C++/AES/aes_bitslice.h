@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+*
+*	Bitsliced constant-time backend (SSE2: 8 blocks, AVX2: 16 blocks per pass)
+*
+*	No table lookups and no branches depend on key or data. Key stages are kept
+*	as 8 bit planes of 16 bits each (one bit per state byte).
+*
+*/
+
+/**
+*	Check if the bitsliced backend can run (needs SSE2, uses AVX2 when present)
+*
+*	@returns <bool>					True if the backend is available
+*/
+bool Bitslice_Supported();
+
+/**
+*	Convert key stages to bit planes
+*
+*	@param <uint8_t*>roundKeys		(rounds + 1) * 16 byte key stages in state byte order
+*	@param <uint8_t>rounds			Number of rounds (10, 12 or 14)
+*	@param <uint16_t*>bsKeys		(rounds + 1) * 8 bitsliced key stages
+*/
+void Bitslice_ExpandKey(const uint8_t* roundKeys, uint8_t rounds, uint16_t* bsKeys);
+
+/**
+*	Encrypt consecutive 16 byte long blocks
+*
+*	@param <uint16_t*>bsKeys		Bitsliced key stages
+*	@param <uint8_t>rounds			Number of rounds (10, 12 or 14)
+*	@param <uint8_t*>src			Blocks to encrypt
+*	@param <uint8_t*>dst			Encrypted blocks (may be src)
+*	@param <size_t>blockCount		Number of blocks
+*/
+void Bitslice_EncryptBlocks(const uint16_t* bsKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount);
+
+/**
+*	Decrypt consecutive 16 byte long blocks
+*
+*	@param <uint16_t*>bsKeys		Bitsliced key stages (same as for encryption)
+*	@param <uint8_t>rounds			Number of rounds (10, 12 or 14)
+*	@param <uint8_t*>src			Blocks to decrypt
+*	@param <uint8_t*>dst			Decrypted blocks (may be src)
+*	@param <size_t>blockCount		Number of blocks
+*/
+void Bitslice_DecryptBlocks(const uint16_t* bsKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount);
@@ -0,0 +1,451 @@
+/*
+*
+*	Bitsliced AES round functions, included once per vector width by aes_bitslice.cpp
+*
+*	Expects:	BS_VEC, BS_LANES, BS_TARGET, BS_FN(name)
+*				BS_XOR, BS_AND, BS_OR, BS_NOT, BS_SRL16, BS_SLL16, BS_SET16, BS_LOAD, BS_STORE
+*
+*	Layout:		q[k] holds bit k of every state byte. Each 16 bit lane of q[k] is one block,
+*				bit i of the lane is state byte i (column i / 4, row i % 4).
+*
+*	Every step is a fixed sequence of logic operations and shifts, nothing is indexed by data.
+*
+*/
+
+//Rotate every 16 bit lane right
+#define BS_ROR16(x, n)		BS_OR(BS_SRL16(x, n), BS_SLL16(x, 16 - (n)))
+
+//Rotate rows inside every column (nibble) of the lanes: row r takes row r + n
+#define BS_ROTCOL1(x)		BS_OR(BS_AND(BS_SRL16(x, 1), BS_SET16(0x7777)), BS_AND(BS_SLL16(x, 3), BS_SET16(0x8888)))
+#define BS_ROTCOL2(x)		BS_OR(BS_AND(BS_SRL16(x, 2), BS_SET16(0x3333)), BS_AND(BS_SLL16(x, 2), BS_SET16(0xCCCC)))
+
+/**
+*	S-box on all bytes: Boyar-Peralta circuit (https://eprint.iacr.org/2009/191.pdf)
+*
+*	@param <BS_VEC*>q				8 bit planes
+*/
+BS_TARGET static inline void BS_FN(Sbox)(BS_VEC* q) {
+	BS_VEC x0, x1, x2, x3, x4, x5, x6, x7;
+	BS_VEC y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+	BS_VEC z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11, z12, z13, z14, z15, z16, z17;
+	BS_VEC t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	BS_VEC t20, t21, t22, t23, t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	BS_VEC t40, t41, t42, t43, t44, t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	BS_VEC t60, t61, t62, t63, t64, t65, t66, t67;
+
+	//The circuit numbers bits from the most significant one
+	x0 = q[7]; x1 = q[6]; x2 = q[5]; x3 = q[4];
+	x4 = q[3]; x5 = q[2]; x6 = q[1]; x7 = q[0];
+
+	//Top linear transformation
+	y14 = BS_XOR(x3, x5);
+	y13 = BS_XOR(x0, x6);
+	y9 = BS_XOR(x0, x3);
+	y8 = BS_XOR(x0, x5);
+	t0 = BS_XOR(x1, x2);
+	y1 = BS_XOR(t0, x7);
+	y4 = BS_XOR(y1, x3);
+	y12 = BS_XOR(y13, y14);
+	y2 = BS_XOR(y1, x0);
+	y5 = BS_XOR(y1, x6);
+	y3 = BS_XOR(y5, y8);
+	t1 = BS_XOR(x4, y12);
+	y15 = BS_XOR(t1, x5);
+	y20 = BS_XOR(t1, x1);
+	y6 = BS_XOR(y15, x7);
+	y10 = BS_XOR(y15, t0);
+	y11 = BS_XOR(y20, y9);
+	y7 = BS_XOR(x7, y11);
+	y17 = BS_XOR(y10, y11);
+	y19 = BS_XOR(y10, y8);
+	y16 = BS_XOR(t0, y11);
+	y21 = BS_XOR(y13, y16);
+	y18 = BS_XOR(x0, y16);
+
+	//Non-linear section (inversion in GF(2^8))
+	t2 = BS_AND(y12, y15);
+	t3 = BS_AND(y3, y6);
+	t4 = BS_XOR(t3, t2);
+	t5 = BS_AND(y4, x7);
+	t6 = BS_XOR(t5, t2);
+	t7 = BS_AND(y13, y16);
+	t8 = BS_AND(y5, y1);
+	t9 = BS_XOR(t8, t7);
+	t10 = BS_AND(y2, y7);
+	t11 = BS_XOR(t10, t7);
+	t12 = BS_AND(y9, y11);
+	t13 = BS_AND(y14, y17);
+	t14 = BS_XOR(t13, t12);
+	t15 = BS_AND(y8, y10);
+	t16 = BS_XOR(t15, t12);
+	t17 = BS_XOR(t4, t14);
+	t18 = BS_XOR(t6, t16);
+	t19 = BS_XOR(t9, t14);
+	t20 = BS_XOR(t11, t16);
+	t21 = BS_XOR(t17, y20);
+	t22 = BS_XOR(t18, y19);
+	t23 = BS_XOR(t19, y21);
+	t24 = BS_XOR(t20, y18);
+
+	t25 = BS_XOR(t21, t22);
+	t26 = BS_AND(t21, t23);
+	t27 = BS_XOR(t24, t26);
+	t28 = BS_AND(t25, t27);
+	t29 = BS_XOR(t28, t22);
+	t30 = BS_XOR(t23, t24);
+	t31 = BS_XOR(t22, t26);
+	t32 = BS_AND(t31, t30);
+	t33 = BS_XOR(t32, t24);
+	t34 = BS_XOR(t23, t33);
+	t35 = BS_XOR(t27, t33);
+	t36 = BS_AND(t24, t35);
+	t37 = BS_XOR(t36, t34);
+	t38 = BS_XOR(t27, t36);
+	t39 = BS_AND(t29, t38);
+	t40 = BS_XOR(t25, t39);
+
+	t41 = BS_XOR(t40, t37);
+	t42 = BS_XOR(t29, t33);
+	t43 = BS_XOR(t29, t40);
+	t44 = BS_XOR(t33, t37);
+	t45 = BS_XOR(t42, t41);
+	z0 = BS_AND(t44, y15);
+	z1 = BS_AND(t37, y6);
+	z2 = BS_AND(t33, x7);
+	z3 = BS_AND(t43, y16);
+	z4 = BS_AND(t40, y1);
+	z5 = BS_AND(t29, y7);
+	z6 = BS_AND(t42, y11);
+	z7 = BS_AND(t45, y17);
+	z8 = BS_AND(t41, y10);
+	z9 = BS_AND(t44, y12);
+	z10 = BS_AND(t37, y3);
+	z11 = BS_AND(t33, y4);
+	z12 = BS_AND(t43, y13);
+	z13 = BS_AND(t40, y5);
+	z14 = BS_AND(t29, y2);
+	z15 = BS_AND(t42, y9);
+	z16 = BS_AND(t45, y14);
+	z17 = BS_AND(t41, y8);
+
+	//Bottom linear transformation (includes the affine constant 0x63)
+	t46 = BS_XOR(z15, z16);
+	t47 = BS_XOR(z10, z11);
+	t48 = BS_XOR(z5, z13);
+	t49 = BS_XOR(z9, z10);
+	t50 = BS_XOR(z2, z12);
+	t51 = BS_XOR(z2, z5);
+	t52 = BS_XOR(z7, z8);
+	t53 = BS_XOR(z0, z3);
+	t54 = BS_XOR(z6, z7);
+	t55 = BS_XOR(z16, z17);
+	t56 = BS_XOR(z12, t48);
+	t57 = BS_XOR(t50, t53);
+	t58 = BS_XOR(z4, t46);
+	t59 = BS_XOR(z3, t54);
+	t60 = BS_XOR(t46, t57);
+	t61 = BS_XOR(z14, t57);
+	t62 = BS_XOR(t52, t58);
+	t63 = BS_XOR(t49, t58);
+	t64 = BS_XOR(z4, t59);
+	t65 = BS_XOR(t61, t62);
+	t66 = BS_XOR(z1, t63);
+	q[7] = BS_XOR(t59, t63);
+	q[1] = BS_XOR(t56, BS_NOT(t62));
+	q[0] = BS_XOR(t48, BS_NOT(t60));
+	t67 = BS_XOR(t64, t65);
+	q[4] = BS_XOR(t53, t66);
+	q[3] = BS_XOR(t51, t66);
+	q[2] = BS_XOR(t47, t65);
+	q[6] = BS_XOR(t64, BS_NOT(q[4]));
+	q[5] = BS_XOR(t55, BS_NOT(t67));
+}
+
+/**
+*	Inverse affine transformation (with the 0x63 constant) used around the S-box circuit
+*
+*	@param <BS_VEC*>q				8 bit planes
+*/
+BS_TARGET static inline void BS_FN(AffineInv)(BS_VEC* q) {
+	BS_VEC q0 = BS_NOT(q[0]), q1 = BS_NOT(q[1]), q2 = q[2], q3 = q[3];
+	BS_VEC q4 = q[4], q5 = BS_NOT(q[5]), q6 = BS_NOT(q[6]), q7 = q[7];
+
+	q[7] = BS_XOR(BS_XOR(q1, q4), q6);
+	q[6] = BS_XOR(BS_XOR(q0, q3), q5);
+	q[5] = BS_XOR(BS_XOR(q7, q2), q4);
+	q[4] = BS_XOR(BS_XOR(q6, q1), q3);
+	q[3] = BS_XOR(BS_XOR(q5, q0), q2);
+	q[2] = BS_XOR(BS_XOR(q4, q7), q1);
+	q[1] = BS_XOR(BS_XOR(q3, q6), q0);
+	q[0] = BS_XOR(BS_XOR(q2, q5), q7);
+}
+
+/**
+*	Inverse S-box on all bytes: sBoxInv(x) = B(sBox(B(x))), B being the inverse affine step
+*
+*	@param <BS_VEC*>q				8 bit planes
+*/
+BS_TARGET static inline void BS_FN(SboxInv)(BS_VEC* q) {
+	BS_FN(AffineInv)(q);
+	BS_FN(Sbox)(q);
+	BS_FN(AffineInv)(q);
+}
+
+/**
+*	Shift rows left: row r of every lane is rotated by 4 * r bits
+*
+*	@param <BS_VEC*>q				8 bit planes
+*/
+BS_TARGET static inline void BS_FN(ShiftRowsLeft)(BS_VEC* q) {
+	for (uint8_t k = 0; k < 8; k++) {
+		BS_VEC x = q[k];
+		q[k] = BS_OR(BS_OR(BS_AND(x, BS_SET16(0x1111)), BS_AND(BS_ROR16(x, 4), BS_SET16(0x2222))),
+			BS_OR(BS_AND(BS_ROR16(x, 8), BS_SET16(0x4444)), BS_AND(BS_ROR16(x, 12), BS_SET16(0x8888))));
+	}
+}
+
+/**
+*	Shift rows right
+*
+*	@param <BS_VEC*>q				8 bit planes
+*/
+BS_TARGET static inline void BS_FN(ShiftRowsRight)(BS_VEC* q) {
+	for (uint8_t k = 0; k < 8; k++) {
+		BS_VEC x = q[k];
+		q[k] = BS_OR(BS_OR(BS_AND(x, BS_SET16(0x1111)), BS_AND(BS_ROR16(x, 12), BS_SET16(0x2222))),
+			BS_OR(BS_AND(BS_ROR16(x, 8), BS_SET16(0x4444)), BS_AND(BS_ROR16(x, 4), BS_SET16(0x8888))));
+	}
+}
+
+/**
+*	Multiply every byte by {02} (bit planes are shifted, 0x1B is folded in from the top plane)
+*
+*	@param <BS_VEC*>q				8 bit planes (in place)
+*/
+BS_TARGET static inline void BS_FN(XTime)(BS_VEC* q) {
+	BS_VEC hi = q[7];
+	q[7] = q[6];
+	q[6] = q[5];
+	q[5] = q[4];
+	q[4] = BS_XOR(q[3], hi);
+	q[3] = BS_XOR(q[2], hi);
+	q[2] = q[1];
+	q[1] = BS_XOR(q[0], hi);
+	q[0] = hi;
+}
+
+/**
+*	Mix columns: out_r = {02}(a_r ^ a_r+1) ^ a_r+1 ^ a_r+2 ^ a_r+3
+*
+*	@param <BS_VEC*>q				8 bit planes
+*/
+BS_TARGET static inline void BS_FN(MixColumns)(BS_VEC* q) {
+	BS_VEC t[8], r1[8];
+
+	for (uint8_t k = 0; k < 8; k++) {
+		r1[k] = BS_ROTCOL1(q[k]);
+		t[k] = BS_XOR(q[k], r1[k]);
+	}
+
+	//a_r+2 ^ a_r+3 is t rotated by two rows
+	for (uint8_t k = 0; k < 8; k++)
+		q[k] = BS_XOR(r1[k], BS_ROTCOL2(t[k]));
+
+	BS_FN(XTime)(t);
+	for (uint8_t k = 0; k < 8; k++)
+		q[k] = BS_XOR(q[k], t[k]);
+}
+
+/**
+*	Inverse mix columns: a_r ^= {04}(a_r ^ a_r+2), then mix columns
+*
+*	@param <BS_VEC*>q				8 bit planes
+*/
+BS_TARGET static inline void BS_FN(MixColumnsInv)(BS_VEC* q) {
+	BS_VEC t[8];
+
+	for (uint8_t k = 0; k < 8; k++)
+		t[k] = BS_XOR(q[k], BS_ROTCOL2(q[k]));
+
+	BS_FN(XTime)(t);
+	BS_FN(XTime)(t);
+	for (uint8_t k = 0; k < 8; k++)
+		q[k] = BS_XOR(q[k], t[k]);
+
+	BS_FN(MixColumns)(q);
+}
+
+/**
+*	Add a key stage to every lane
+*
+*	@param <BS_VEC*>q				8 bit planes
+*	@param <BS_VEC*>key				8 broadcast key planes
+*/
+BS_TARGET static inline void BS_FN(AddRoundKey)(BS_VEC* q, const BS_VEC* key) {
+	for (uint8_t k = 0; k < 8; k++)
+		q[k] = BS_XOR(q[k], key[k]);
+}
+
+/**
+*	Broadcast the bitsliced key stages to every lane (once per call, not per group)
+*
+*	@param <uint16_t*>keys			(Rounds + 1) * 8 key plane patterns
+*	@param <BS_VEC*>rk				(Rounds + 1) * 8 broadcast key planes
+*/
+template<uint8_t Rounds>
+BS_TARGET static inline void BS_FN(LoadKeys)(const uint16_t* keys, BS_VEC* rk) {
+	for (uint8_t i = 0; i < (Rounds + 1) * 8; i++)
+		rk[i] = BS_SET16(keys[i]);
+}
+
+/**
+*	Transpose BS_LANES blocks into bit planes (MOVEMASK collects one bit of all 16 bytes)
+*
+*	@param <uint8_t*>blocks			BS_LANES * 16 bytes
+*	@param <BS_VEC*>q				8 bit planes
+*/
+BS_TARGET static inline void BS_FN(Pack)(const uint8_t* blocks, BS_VEC* q) {
+	alignas(32) uint16_t planes[8][BS_LANES];
+
+	for (uint8_t j = 0; j < BS_LANES; j++) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(blocks + j * 16));
+		for (int8_t k = 7; k >= 0; k--) {
+			planes[k][j] = (uint16_t)_mm_movemask_epi8(x);
+			x = _mm_add_epi8(x, x);
+		}
+	}
+
+	for (uint8_t k = 0; k < 8; k++)
+		q[k] = BS_LOAD(planes[k]);
+}
+
+/**
+*	Transpose bit planes back into BS_LANES blocks
+*
+*	@param <BS_VEC*>q				8 bit planes
+*	@param <uint8_t*>blocks			BS_LANES * 16 bytes
+*/
+BS_TARGET static inline void BS_FN(Unpack)(const BS_VEC* q, uint8_t* blocks) {
+	alignas(32) uint16_t planes[8][BS_LANES];
+
+	for (uint8_t k = 0; k < 8; k++)
+		BS_STORE(planes[k], q[k]);
+
+	for (uint8_t j = 0; j < BS_LANES; j++) {
+		__m128i w = _mm_set_epi16((short)planes[7][j], (short)planes[6][j], (short)planes[5][j], (short)planes[4][j],
+			(short)planes[3][j], (short)planes[2][j], (short)planes[1][j], (short)planes[0][j]);
+
+		//Bytes 0..7: low halves of the planes (state bytes 0..7), bytes 8..15: high halves (state bytes 8..15)
+		__m128i x = _mm_packus_epi16(_mm_and_si128(w, _mm_set1_epi16(0x00FF)), _mm_srli_epi16(w, 8));
+		for (int8_t i = 7; i >= 0; i--) {
+			int m = _mm_movemask_epi8(x);
+			blocks[j * 16 + i] = (uint8_t)m;
+			blocks[j * 16 + 8 + i] = (uint8_t)(m >> 8);
+			x = _mm_add_epi8(x, x);
+		}
+	}
+}
+
+/**
+*	Encrypt BS_LANES blocks in place
+*
+*	@param <BS_VEC*>rk				(Rounds + 1) * 8 broadcast key planes
+*	@param <uint8_t*>src			BS_LANES * 16 input bytes
+*	@param <uint8_t*>dst			BS_LANES * 16 output bytes (may be src)
+*/
+template<uint8_t Rounds>
+BS_TARGET static void BS_FN(EncryptGroup)(const BS_VEC* rk, const uint8_t* src, uint8_t* dst) {
+	BS_VEC q[8];
+
+	BS_FN(Pack)(src, q);
+	BS_FN(AddRoundKey)(q, rk);
+	for (uint8_t i = 1; i < Rounds; i++) {
+		BS_FN(Sbox)(q);
+		BS_FN(ShiftRowsLeft)(q);
+		BS_FN(MixColumns)(q);
+		BS_FN(AddRoundKey)(q, rk + i * 8);
+	}
+	BS_FN(Sbox)(q);
+	BS_FN(ShiftRowsLeft)(q);
+	BS_FN(AddRoundKey)(q, rk + Rounds * 8);
+	BS_FN(Unpack)(q, dst);
+}
+
+/**
+*	Decrypt BS_LANES blocks in place
+*
+*	@param <BS_VEC*>rk				(Rounds + 1) * 8 broadcast key planes
+*	@param <uint8_t*>src			BS_LANES * 16 input bytes
+*	@param <uint8_t*>dst			BS_LANES * 16 output bytes (may be src)
+*/
+template<uint8_t Rounds>
+BS_TARGET static void BS_FN(DecryptGroup)(const BS_VEC* rk, const uint8_t* src, uint8_t* dst) {
+	BS_VEC q[8];
+
+	BS_FN(Pack)(src, q);
+	BS_FN(AddRoundKey)(q, rk + Rounds * 8);
+	for (uint8_t i = Rounds - 1; i > 0; i--) {
+		BS_FN(ShiftRowsRight)(q);
+		BS_FN(SboxInv)(q);
+		BS_FN(AddRoundKey)(q, rk + i * 8);
+		BS_FN(MixColumnsInv)(q);
+	}
+	BS_FN(ShiftRowsRight)(q);
+	BS_FN(SboxInv)(q);
+	BS_FN(AddRoundKey)(q, rk);
+	BS_FN(Unpack)(q, dst);
+}
+
+/**
+*	Encrypt consecutive blocks, a partial last group is run zero padded
+*
+*	@param <uint16_t*>keys			(Rounds + 1) * 8 key plane patterns
+*	@param <uint8_t*>src			Blocks to encrypt
+*	@param <uint8_t*>dst			Output blocks (may be src)
+*	@param <size_t>blockCount		Number of blocks
+*/
+template<uint8_t Rounds>
+BS_TARGET static void BS_FN(EncryptBlocks)(const uint16_t* keys, const uint8_t* src, uint8_t* dst, size_t blockCount) {
+	BS_VEC rk[(Rounds + 1) * 8];
+	BS_FN(LoadKeys)<Rounds>(keys, rk);
+
+	size_t b = 0;
+	for (; b + BS_LANES <= blockCount; b += BS_LANES)
+		BS_FN(EncryptGroup)<Rounds>(rk, src + b * 16, dst + b * 16);
+
+	if (b < blockCount) {
+		uint8_t tail[BS_LANES * 16] = { 0 };
+		memcpy(tail, src + b * 16, (blockCount - b) * 16);
+		BS_FN(EncryptGroup)<Rounds>(rk, tail, tail);
+		memcpy(dst + b * 16, tail, (blockCount - b) * 16);
+	}
+}
+
+/**
+*	Decrypt consecutive blocks, a partial last group is run zero padded
+*
+*	@param <uint16_t*>keys			(Rounds + 1) * 8 key plane patterns
+*	@param <uint8_t*>src			Blocks to decrypt
+*	@param <uint8_t*>dst			Output blocks (may be src)
+*	@param <size_t>blockCount		Number of blocks
+*/
+template<uint8_t Rounds>
+BS_TARGET static void BS_FN(DecryptBlocks)(const uint16_t* keys, const uint8_t* src, uint8_t* dst, size_t blockCount) {
+	BS_VEC rk[(Rounds + 1) * 8];
+	BS_FN(LoadKeys)<Rounds>(keys, rk);
+
+	size_t b = 0;
+	for (; b + BS_LANES <= blockCount; b += BS_LANES)
+		BS_FN(DecryptGroup)<Rounds>(rk, src + b * 16, dst + b * 16);
+
+	if (b < blockCount) {
+		uint8_t tail[BS_LANES * 16] = { 0 };
+		memcpy(tail, src + b * 16, (blockCount - b) * 16);
+		BS_FN(DecryptGroup)<Rounds>(rk, tail, tail);
+		memcpy(dst + b * 16, tail, (blockCount - b) * 16);
+	}
+}
+
+#undef BS_ROR16
+#undef BS_ROTCOL1
+#undef BS_ROTCOL2
@@ -0,0 +1,485 @@
+#include "aes_config.h"
+#include "aes_container.h"
+#include "aes_gcm.h"
+
+#include <atomic>
+#include <mutex>
+
+#ifdef AES_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/random.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#include <bcrypt.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "bcrypt.lib")
+#endif
+#endif
+
+static const uint8_t containerMagic[8] = { 'A', 'E', 'S', 'C', 'H', 'U', 'N', 'K' };
+
+//
+static void Container_Store64(uint8_t* bytes, uint64_t value) {
+	for (int i = 0; i < 8; i++)
+		bytes[i] = (uint8_t)(value >> (8 * i));
+}
+
+//
+static uint64_t Container_Load64(const uint8_t* bytes) {
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--)
+		value = (value << 8) | bytes[i];
+	return value;
+}
+
+//Read a whole range at an offset (positioned reads, so chunks can be read from many threads)
+static bool Container_ReadAt(FILE* file, uint8_t* buffer, size_t length, uint64_t offset) {
+#ifdef AES_POSIX
+	int fd = fileno(file);
+	while (length > 0) {
+		ssize_t n = pread(fd, buffer, length, (off_t)offset);
+		if (n < 0 && errno == EINTR)	continue;
+		if (n <= 0)						return false;
+		buffer += n;
+		length -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+	return true;
+#else
+	//No positioned reads: seek and read under one lock
+	static std::mutex lock;
+	std::lock_guard<std::mutex> guard(lock);
+	if (_fseeki64(file, (long long)offset, SEEK_SET) != 0)	return false;
+	return fread(buffer, 1, length, file) == length;
+#endif
+}
+
+//File size in 64 bits (size_t and ftell can be 32-bit)
+static uint64_t Container_FileSize(FILE* file) {
+#ifdef AES_POSIX
+	struct stat fileStat;
+	return fstat(fileno(file), &fileStat) == 0 && fileStat.st_size > 0 ? (uint64_t)fileStat.st_size : 0;
+#else
+	long long size = _filelengthi64(_fileno(file));
+	return size > 0 ? (uint64_t)size : 0;
+#endif
+}
+
+//Fill a buffer from the operating system's CSPRNG (false if it is not available)
+static bool Container_Random(uint8_t* buffer, size_t length) {
+#if defined(__linux__)
+	while (length > 0) {
+		ssize_t n = getrandom(buffer, length, 0);
+		if (n < 0 && errno == EINTR)	continue;
+		if (n <= 0)						return false;
+		buffer += n;
+		length -= (size_t)n;
+	}
+	return true;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+	arc4random_buf(buffer, length);
+	return true;
+#elif defined(_WIN32)
+	return BCRYPT_SUCCESS(BCryptGenRandom(NULL, buffer, (ULONG)length, BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+#elif defined(AES_POSIX)
+	int fd = open("/dev/urandom", O_RDONLY);
+	if (fd < 0)		return false;
+	while (length > 0) {
+		ssize_t n = read(fd, buffer, length);
+		if (n < 0 && errno == EINTR)	continue;
+		if (n <= 0)						{ close(fd); return false; }
+		buffer += n;
+		length -= (size_t)n;
+	}
+	close(fd);
+	return true;
+#else
+	return false;
+#endif
+}
+
+//
+AESContainer::AESContainer(const AES& aes) : aes(aes) {
+	//Every thread already works on its own chunk, the cipher inside stays single-threaded
+	this->aes.SetThreadNum(1);
+	this->aes.SetObserver(NULL);
+}
+
+//
+AESContainer::~AESContainer() {
+	Close();
+}
+
+//
+bool AESContainer::SetFormat(AES_CONTAINER_MODE mode, uint32_t chunkSize) {
+	if (mode != AES_CONTAINER_CTR && mode != AES_CONTAINER_GCM)							return false;
+	if (chunkSize < 16 || chunkSize > AES_CONTAINER_MAX_CHUNK_SIZE || (chunkSize & 0x0F) != 0)	return false;
+	this->mode = mode;
+	this->chunkSize = chunkSize;
+	return true;
+}
+
+//
+void AESContainer::SetThreadNum(int threadNum) {
+	this->threadNum = threadNum < 0 ? 0 : threadNum;
+}
+
+//
+int AESContainer::EncryptFileToContainer(const char* inputFileName, const char* outputFileName) const {
+
+	if (inputFileName == NULL || outputFileName == NULL)	return 0x0A;
+
+	FILE* inputFile = AES::OpenFile(inputFileName, "rb");
+	if (inputFile == NULL)		return 0x01;
+
+	AES_CONTAINER_HEADER output = {};
+	output.version = AES_CONTAINER_VERSION;
+	output.mode = mode;
+	output.keyLength = (uint8_t)((aes.GetKeySchedule()->GetRounds() - 6) * 4);
+	output.chunkSize = chunkSize;
+	output.plaintextLength = Container_FileSize(inputFile);
+	output.chunkCount = (output.plaintextLength + chunkSize - 1) / chunkSize;
+	output.indexOffset = AES_CONTAINER_HEADER_SIZE + output.plaintextLength;
+
+	//A repeated nonce repeats the GCM IVs and the CTR keystream, so it only comes from the OS CSPRNG
+	if (!Container_Random(output.nonce, sizeof(output.nonce))) {
+		fclose(inputFile);
+		return 0x0B;
+	}
+
+	uint8_t outputBytes[AES_CONTAINER_HEADER_SIZE];
+	StoreHeader(output, outputBytes);
+
+	//One read and one write moves a group of chunks, the chunks of a group are encrypted in parallel
+	const uint64_t groupChunks = chunkSize < AES_FILE_BUFFER_SIZE ? AES_FILE_BUFFER_SIZE / chunkSize : 1;
+	uint8_t* buffer = (uint8_t*)malloc((size_t)(groupChunks * chunkSize));
+	uint8_t* index = (uint8_t*)malloc(output.chunkCount > 0 ? (size_t)(output.chunkCount * AES_CONTAINER_ENTRY_SIZE) : 1);
+
+	if (buffer == NULL || index == NULL) {
+		free(buffer);
+		free(index);
+		fclose(inputFile);
+		return 0x05;
+	}
+
+	FILE* outputFile = AES::OpenFile(outputFileName, "wb");
+	if (outputFile == NULL) {
+		free(buffer);
+		free(index);
+		fclose(inputFile);
+		return 0x03;
+	}
+
+	int result = fwrite(outputBytes, 1, AES_CONTAINER_HEADER_SIZE, outputFile) == AES_CONTAINER_HEADER_SIZE ? 0x00 : 0x04;
+
+	for (uint64_t first = 0; first < output.chunkCount && result == 0x00; first += groupChunks) {
+		const long long chunks = (long long)(output.chunkCount - first < groupChunks ? output.chunkCount - first : groupChunks);
+		const uint64_t offset = first * chunkSize;
+		const size_t bytes = (size_t)(output.plaintextLength - offset < chunks * (uint64_t)chunkSize ? output.plaintextLength - offset : chunks * (uint64_t)chunkSize);
+
+		if (fread(buffer, 1, bytes, inputFile) != bytes) {
+			result = 0x04;
+			break;
+		}
+
+		#pragma omp parallel num_threads(GetThreads((uint64_t)chunks))
+		{
+			AESGCM gcm(aes);
+
+			#pragma omp for schedule(static)
+			for (long long c = 0; c < chunks; c++) {
+				size_t position = (size_t)c * chunkSize;
+				size_t length = bytes - position < chunkSize ? bytes - position : chunkSize;
+				CryptChunk(gcm, output, outputBytes, first + c, buffer + position, length, index + (first + c) * AES_CONTAINER_ENTRY_SIZE, true);
+			}
+		}
+
+		if (fwrite(buffer, 1, bytes, outputFile) != bytes)
+			result = 0x04;
+	}
+
+	//The index trails the chunks, its offset was fixed in the header
+	size_t indexLength = (size_t)(output.chunkCount * AES_CONTAINER_ENTRY_SIZE);
+	if (result == 0x00 && fwrite(index, 1, indexLength, outputFile) != indexLength)
+		result = 0x04;
+
+	if (fclose(outputFile) != 0 && result == 0x00)	result = 0x04;
+	fclose(inputFile);
+
+	//The buffer held plaintext
+	AES_SecureZero(buffer, (size_t)(groupChunks * chunkSize));
+	free(buffer);
+	free(index);
+
+	return result;
+}
+
+//
+int AESContainer::DecryptContainerToFile(const char* inputFileName, const char* outputFileName) const {
+
+	if (inputFileName == NULL || outputFileName == NULL)	return 0x0A;
+
+	AESContainer reader(aes);
+	reader.SetThreadNum(threadNum);
+
+	int result = reader.Open(inputFileName);
+	if (result != 0x00)		return result;
+
+	const uint64_t length = reader.header.plaintextLength;
+	const uint64_t groupLength = reader.header.chunkSize < AES_FILE_BUFFER_SIZE ? (AES_FILE_BUFFER_SIZE / reader.header.chunkSize) * reader.header.chunkSize : reader.header.chunkSize;
+
+	uint8_t* buffer = (uint8_t*)malloc((size_t)groupLength);
+	if (buffer == NULL)		return 0x05;
+
+	FILE* outputFile = AES::OpenFile(outputFileName, "wb");
+	if (outputFile == NULL) {
+		free(buffer);
+		return 0x03;
+	}
+
+	//Whole groups of chunks, every chunk is read and decrypted straight into the buffer
+	for (uint64_t offset = 0; offset < length && result == 0x00; offset += groupLength) {
+		size_t bytes = (size_t)(length - offset < groupLength ? length - offset : groupLength);
+
+		result = reader.DecryptRange(offset, bytes, buffer);
+
+		if (result == 0x00 && fwrite(buffer, 1, bytes, outputFile) != bytes)
+			result = 0x04;
+	}
+
+	if (fclose(outputFile) != 0 && result == 0x00)	result = 0x04;
+
+	AES_SecureZero(buffer, (size_t)groupLength);
+	free(buffer);
+
+	return result;
+}
+
+//
+int AESContainer::Open(const char* fileName) {
+	Close();
+
+	if (fileName == NULL)	return 0x0A;
+
+	file = AES::OpenFile(fileName, "rb");
+	if (file == NULL)		return 0x01;
+
+	int result = Container_ReadAt(file, headerBytes, AES_CONTAINER_HEADER_SIZE, 0) ? LoadHeader(headerBytes, &header) : 0x02;
+
+	//Another key size can't decrypt it, a short file lost chunks or index entries
+	if (result == 0x00 && header.keyLength != (uint8_t)((aes.GetKeySchedule()->GetRounds() - 6) * 4))
+		result = 0x06;
+	if (result == 0x00 && Container_FileSize(file) != header.indexOffset + header.chunkCount * AES_CONTAINER_ENTRY_SIZE)
+		result = 0x06;
+
+	if (result != 0x00)		Close();
+
+	return result;
+}
+
+//
+void AESContainer::Close() {
+	if (file != NULL)	fclose(file);
+	file = NULL;
+	header = {};
+	memset(headerBytes, 0, AES_CONTAINER_HEADER_SIZE);
+}
+
+//
+const AES_CONTAINER_HEADER& AESContainer::GetHeader() const {
+	return header;
+}
+
+//
+int AESContainer::DecryptRange(uint64_t offset, size_t length, uint8_t* dst) const {
+
+	if (file == NULL)									return 0x09;
+	if (dst == NULL)									return 0x0A;
+	if (offset > header.plaintextLength || length > header.plaintextLength - offset)	return 0x08;
+	if (length == 0)									return 0x00;
+
+	//Every byte has its own keystream position: read and decrypt exactly the range
+	if (header.mode == AES_CONTAINER_CTR) {
+		if (!Container_ReadAt(file, dst, length, AES_CONTAINER_HEADER_SIZE + offset))	return 0x04;
+
+		uint8_t counter[16] = { 0 };
+		memcpy(counter, header.nonce, 8);
+
+		//A large range is split across threads by the CTR mode itself
+		AES cipher = aes;
+		cipher.SetThreadNum(threadNum);
+		cipher.DecryptCTR(dst, dst, length, counter, offset);
+		return 0x00;
+	}
+
+	const uint64_t first = offset / header.chunkSize;
+	const long long chunks = (long long)((offset + length - 1) / header.chunkSize - first + 1);
+
+	//Index entries of the range only (tags of the chunks to check)
+	uint8_t* entries = (uint8_t*)malloc((size_t)chunks * AES_CONTAINER_ENTRY_SIZE);
+	if (entries == NULL)	return 0x05;
+
+	if (!Container_ReadAt(file, entries, (size_t)chunks * AES_CONTAINER_ENTRY_SIZE, header.indexOffset + first * AES_CONTAINER_ENTRY_SIZE)) {
+		free(entries);
+		return 0x04;
+	}
+
+	std::atomic<int> error(0x00);
+
+	#pragma omp parallel num_threads(GetThreads((uint64_t)chunks))
+	{
+		AESGCM gcm(aes);
+		uint8_t* scratch = NULL;		//Chunks cut by the range are decrypted here, whole chunks in dst
+
+		#pragma omp for schedule(static)
+		for (long long c = 0; c < chunks; c++) {
+			if (error.load() != 0x00)	continue;
+
+			const uint64_t chunk = first + c;
+			const uint64_t chunkOffset = chunk * header.chunkSize;
+			const size_t chunkLength = (size_t)(header.plaintextLength - chunkOffset < header.chunkSize ? header.plaintextLength - chunkOffset : header.chunkSize);
+			const bool whole = chunkOffset >= offset && chunkOffset + chunkLength <= offset + length;
+
+			if (!whole && scratch == NULL)
+				scratch = (uint8_t*)malloc(header.chunkSize);
+
+			uint8_t* data = whole ? dst + (chunkOffset - offset) : scratch;
+			int code = 0x00;
+
+			if (data == NULL)
+				code = 0x05;
+			else if (!Container_ReadAt(file, data, chunkLength, AES_CONTAINER_HEADER_SIZE + chunkOffset))
+				code = 0x04;
+			else
+				code = CryptChunk(gcm, header, headerBytes, chunk, data, chunkLength, entries + c * AES_CONTAINER_ENTRY_SIZE, false);
+
+			if (code == 0x00 && !whole) {
+				uint64_t from = offset > chunkOffset ? offset : chunkOffset;
+				uint64_t to = offset + length < chunkOffset + chunkLength ? offset + length : chunkOffset + chunkLength;
+				memcpy(dst + (from - offset), scratch + (from - chunkOffset), (size_t)(to - from));
+			}
+
+			if (code != 0x00) {
+				int expected = 0x00;
+				error.compare_exchange_strong(expected, code);
+			}
+		}
+
+		if (scratch != NULL) {
+			AES_SecureZero(scratch, header.chunkSize);
+			free(scratch);
+		}
+	}
+
+	free(entries);
+
+	//Never hand out plaintext of a range that didn't verify
+	int result = error.load();
+	if (result != 0x00)
+		AES_SecureZero(dst, length);
+
+	return result;
+}
+
+//
+int AESContainer::DecryptRange(const char* fileName, uint64_t offset, size_t length, uint8_t* dst) const {
+	AESContainer reader(aes);
+	reader.SetThreadNum(threadNum);
+
+	int result = reader.Open(fileName);
+	return result == 0x00 ? reader.DecryptRange(offset, length, dst) : result;
+}
+
+//
+int AESContainer::GetThreads(uint64_t chunks) const {
+	int threads = 1;
+#ifdef _OPENMP
+	threads = threadNum > 0 ? threadNum : omp_get_max_threads();
+#endif
+	return (uint64_t)threads > chunks ? (int)chunks : threads;
+}
+
+//
+int AESContainer::CryptChunk(AESGCM& gcm, const AES_CONTAINER_HEADER& header, const uint8_t* headerBytes, uint64_t chunk, uint8_t* data, size_t length, uint8_t* entry, bool encrypt) const {
+
+	const uint64_t chunkOffset = chunk * header.chunkSize;
+
+	if (encrypt) {
+		Container_Store64(entry, AES_CONTAINER_HEADER_SIZE + chunkOffset);
+		Container_Store64(entry + 8, length);
+		memset(entry + 16, 0, 16);
+	}
+	else if (Container_Load64(entry) != AES_CONTAINER_HEADER_SIZE + chunkOffset || Container_Load64(entry + 8) != length)
+		return 0x06;
+
+	if (header.mode == AES_CONTAINER_CTR) {
+		uint8_t counter[16] = { 0 };
+		memcpy(counter, header.nonce, 8);
+		aes.EncryptCTR(data, data, length, counter, chunkOffset);
+		return 0x00;
+	}
+
+	//Unique IV per chunk, the chunk number sits in the last 8 bytes
+	uint8_t iv[12];
+	memcpy(iv, header.nonce, 12);
+	for (int i = 0; i < 8; i++)
+		iv[11 - i] ^= (uint8_t)(chunk >> (8 * i));
+
+	if (encrypt) {
+		gcm.Encrypt(iv, 12, headerBytes, AES_CONTAINER_HEADER_SIZE, data, data, length, entry + 16);
+		return 0x00;
+	}
+
+	return gcm.Decrypt(iv, 12, headerBytes, AES_CONTAINER_HEADER_SIZE, data, data, length, entry + 16) == 0x00 ? 0x00 : 0x07;
+}
+
+//
+void AESContainer::StoreHeader(const AES_CONTAINER_HEADER& header, uint8_t* bytes) {
+	memset(bytes, 0, AES_CONTAINER_HEADER_SIZE);
+	memcpy(bytes, containerMagic, 8);
+	bytes[8] = (uint8_t)header.version;
+	bytes[9] = (uint8_t)(header.version >> 8);
+	bytes[10] = header.mode;
+	bytes[11] = header.keyLength;
+	for (int i = 0; i < 4; i++)
+		bytes[12 + i] = (uint8_t)(header.chunkSize >> (8 * i));
+	Container_Store64(bytes + 16, header.plaintextLength);
+	Container_Store64(bytes + 24, header.chunkCount);
+	Container_Store64(bytes + 32, header.indexOffset);
+	memcpy(bytes + 40, header.nonce, 16);
+	//Bytes 56..63 reserved (zero)
+}
+
+//
+int AESContainer::LoadHeader(const uint8_t* bytes, AES_CONTAINER_HEADER* header) {
+	if (memcmp(bytes, containerMagic, 8) != 0)		return 0x02;
+
+	header->version = (uint16_t)(bytes[8] | (bytes[9] << 8));
+	if (header->version == 0 || header->version > AES_CONTAINER_VERSION)	return 0x02;
+
+	header->mode = (AES_CONTAINER_MODE)bytes[10];
+	header->keyLength = bytes[11];
+	header->chunkSize = (uint32_t)bytes[12] | ((uint32_t)bytes[13] << 8) | ((uint32_t)bytes[14] << 16) | ((uint32_t)bytes[15] << 24);
+	header->plaintextLength = Container_Load64(bytes + 16);
+	header->chunkCount = Container_Load64(bytes + 24);
+	header->indexOffset = Container_Load64(bytes + 32);
+	memcpy(header->nonce, bytes + 40, 16);
+
+	//Every field that places data has to agree with the others
+	if (header->mode != AES_CONTAINER_CTR && header->mode != AES_CONTAINER_GCM)	return 0x06;
+	if (header->keyLength != 16 && header->keyLength != 24 && header->keyLength != 32)	return 0x06;
+	if (header->chunkSize < 16 || header->chunkSize > AES_CONTAINER_MAX_CHUNK_SIZE || (header->chunkSize & 0x0F) != 0)	return 0x06;
+	if (header->plaintextLength > (UINT64_MAX >> 8))	return 0x06;
+	if (header->chunkCount != (header->plaintextLength + header->chunkSize - 1) / header->chunkSize)	return 0x06;
+	if (header->indexOffset != AES_CONTAINER_HEADER_SIZE + header->plaintextLength)	return 0x06;
+
+	return 0x00;
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "aes.h"
+
+class AESGCM;
+
+/*
+*
+*	Chunked container with random access
+*
+*	Layout (integers little-endian):
+*		header		AES_CONTAINER_HEADER_SIZE bytes: magic "AESCHUNK", version, cipher mode, key length, chunk size,
+*					plaintext length, chunk count, index offset, 16 byte random nonce
+*		chunks		chunk i is the ciphertext of plaintext bytes [i * chunkSize, (i + 1) * chunkSize), no padding
+*		index		AES_CONTAINER_ENTRY_SIZE bytes per chunk: offset, length, 16 byte GCM tag
+*
+*	Every chunk is encrypted on its own, so DecryptRange reads and decrypts only the chunks of the range:
+*		AES_CONTAINER_GCM	AES-GCM per chunk, IV = nonce[0..11] ^ chunk number, AAD = header (authenticated, a chunk can't be
+*							moved, dropped or changed and the header can't be edited)
+*		AES_CONTAINER_CTR	one CTR keystream over the whole plaintext, counter = nonce[0..7] || 0 (not authenticated,
+*							a range is read byte exact without touching the rest of its chunks)
+*
+*	Exit codes of every function:
+*		0x00 success, 0x01 can't open input, 0x02 not a container or unsupported version, 0x03 can't create output,
+*		0x04 read / write error, 0x05 out of memory, 0x06 corrupt header or index (or the key length differs),
+*		0x07 authentication failed, 0x08 range outside the plaintext, 0x09 no container open, 0x0A NULL pointer,
+*		0x0B no random nonce from the operating system
+*
+*/
+
+#define AES_CONTAINER_VERSION			1								//Format version written by this code (newer versions are rejected)
+#define AES_CONTAINER_HEADER_SIZE		64								//Bytes before the first chunk
+#define AES_CONTAINER_ENTRY_SIZE		32								//Bytes per index entry
+#define AES_CONTAINER_CHUNK_SIZE		( 64 * 1024 )					//Default chunk size: smallest read that has to be decrypted (GCM)
+#define AES_CONTAINER_MAX_CHUNK_SIZE	( 16 * 1024 * 1024 )			//Largest chunk size
+
+/**
+*	Cipher mode of the chunks
+*/
+enum AES_CONTAINER_MODE : uint8_t {
+	AES_CONTAINER_CTR = 1,			///< CTR keystream, no integrity check
+	AES_CONTAINER_GCM = 2			///< AES-GCM per chunk, every chunk is authenticated with the header
+};
+
+/**
+*	Container header (AES_CONTAINER_HEADER_SIZE bytes on disk)
+*/
+struct AES_CONTAINER_HEADER {
+	uint16_t version;				//Format version
+	AES_CONTAINER_MODE mode;		//Cipher mode of the chunks
+	uint8_t keyLength;				//AES key length in bytes (16, 24 or 32)
+	uint32_t chunkSize;				//Plaintext bytes per chunk (the last chunk may be shorter)
+	uint64_t plaintextLength;		//Total plaintext length
+	uint64_t chunkCount;			//Number of chunks (and index entries)
+	uint64_t indexOffset;			//File offset of the index
+	uint8_t nonce[16];				//Random per container, IVs and counters are derived from it
+};
+
+class AESContainer {
+
+private:
+
+	AES aes;								//Block cipher (shares the key schedule)
+
+	AES_CONTAINER_MODE mode = AES_CONTAINER_GCM;		//Cipher mode of new containers
+
+	uint32_t chunkSize = AES_CONTAINER_CHUNK_SIZE;		//Chunk size of new containers
+
+	int threadNum = 0;						//Threads working on separate chunks (0: OpenMP default)
+
+	FILE* file = NULL;						//Container opened for reading
+
+	AES_CONTAINER_HEADER header = {};		//Header of the open container
+
+	uint8_t headerBytes[AES_CONTAINER_HEADER_SIZE] = { 0 };		//Header of the open container as stored (AAD of the chunks)
+
+public:
+
+	/**
+	*	Create a container reader / writer on an initialized AES object
+	*
+	*	@param <AES&> aes				AES object (copied, the key schedule is shared)
+	*/
+	explicit AESContainer(const AES& aes);
+
+	AESContainer(const AESContainer&) = delete;
+	AESContainer& operator=(const AESContainer&) = delete;
+
+	/**
+	*	Close the open container
+	*/
+	~AESContainer();
+
+	/**
+	*	Set the format of new containers
+	*
+	*	@param <AES_CONTAINER_MODE> mode	Cipher mode of the chunks
+	*	@param <uint32_t> chunkSize		Plaintext bytes per chunk (multiple of 16, 16..AES_CONTAINER_MAX_CHUNK_SIZE)
+	*
+	*	@returns <bool>					False if the mode or chunk size is not supported (format is left unchanged)
+	*/
+	bool SetFormat(AES_CONTAINER_MODE mode, uint32_t chunkSize = AES_CONTAINER_CHUNK_SIZE);
+
+	/**
+	*	Set the number of threads encrypting and decrypting separate chunks
+	*
+	*	@param <int> threadNum			Number of threads (0: OpenMP default, 1: single-threaded)
+	*/
+	void SetThreadNum(int threadNum);
+
+	/**
+	*	Encrypt a file into a new container
+	*
+	*	@param <char*> inputFileName	Plaintext file
+	*	@param <char*> outputFileName	Container to create
+	*
+	*	@returns <int>					Exit code (see the top of this file)
+	*/
+	int EncryptFileToContainer(const char* inputFileName, const char* outputFileName) const;
+
+	/**
+	*	Decrypt a whole container into a file
+	*
+	*	@param <char*> inputFileName	Container
+	*	@param <char*> outputFileName	Plaintext file to create
+	*
+	*	@returns <int>					Exit code (see the top of this file)
+	*/
+	int DecryptContainerToFile(const char* inputFileName, const char* outputFileName) const;
+
+	/**
+	*	Open a container for DecryptRange (reads and checks only the header, a container that is already open is closed)
+	*
+	*	@param <char*> fileName			Container
+	*
+	*	@returns <int>					Exit code (see the top of this file)
+	*/
+	int Open(const char* fileName);
+
+	/**
+	*	Close the open container
+	*/
+	void Close();
+
+	/**
+	*	Get the header of the open container
+	*
+	*	@returns <AES_CONTAINER_HEADER&>	Header (zero if nothing is open)
+	*/
+	const AES_CONTAINER_HEADER& GetHeader() const;
+
+	/**
+	*	Decrypt a plaintext range of the open container, only its chunks and index entries are read (safe to call from many threads)
+	*
+	*	@param <uint64_t> offset		Plaintext offset
+	*	@param <size_t> length			Bytes to decrypt
+	*	@param <uint8_t*> dst			Plaintext (length bytes, zeroed on error)
+	*
+	*	@returns <int>					Exit code (see the top of this file)
+	*/
+	int DecryptRange(uint64_t offset, size_t length, uint8_t* dst) const;
+
+	/**
+	*	Decrypt a plaintext range of a container file (opens and closes it, use Open for many reads)
+	*
+	*	@param <char*> fileName			Container
+	*	@param <uint64_t> offset		Plaintext offset
+	*	@param <size_t> length			Bytes to decrypt
+	*	@param <uint8_t*> dst			Plaintext (length bytes, zeroed on error)
+	*
+	*	@returns <int>					Exit code (see the top of this file)
+	*/
+	int DecryptRange(const char* fileName, uint64_t offset, size_t length, uint8_t* dst) const;
+
+private:
+
+	/**
+	*	Number of threads for a job
+	*
+	*	@param <uint64_t> chunks		Independent chunks of the job
+	*
+	*	@returns <int>					Threads to start (at most one per chunk)
+	*/
+	int GetThreads(uint64_t chunks) const;
+
+	/**
+	*	Encrypt one chunk in place and fill its index entry, or check its index entry and decrypt it in place
+	*
+	*	@param <AESGCM&> gcm			AES-GCM of the calling thread (unused in CTR mode)
+	*	@param <AES_CONTAINER_HEADER&> header	Header of the container
+	*	@param <uint8_t*> headerBytes	Stored header (AAD)
+	*	@param <uint64_t> chunk			Chunk number
+	*	@param <uint8_t*> data			Chunk data (in place)
+	*	@param <size_t> length			Chunk length
+	*	@param <uint8_t*> entry			Index entry (written when encrypting, checked when decrypting)
+	*	@param <bool> encrypt			True: encrypt, false: decrypt
+	*
+	*	@returns <int>					0x00 success, 0x06 index entry doesn't match, 0x07 authentication failed
+	*/
+	int CryptChunk(AESGCM& gcm, const AES_CONTAINER_HEADER& header, const uint8_t* headerBytes, uint64_t chunk, uint8_t* data, size_t length, uint8_t* entry, bool encrypt) const;
+
+	/**
+	*	Serialize a header
+	*
+	*	@param <AES_CONTAINER_HEADER&> header	Header
+	*	@param <uint8_t*> bytes			AES_CONTAINER_HEADER_SIZE bytes
+	*/
+	static void StoreHeader(const AES_CONTAINER_HEADER& header, uint8_t* bytes);
+
+	/**
+	*	Parse and check a header
+	*
+	*	@param <uint8_t*> bytes			AES_CONTAINER_HEADER_SIZE bytes
+	*	@param <AES_CONTAINER_HEADER*> header	Parsed header
+	*
+	*	@returns <int>					0x00 success, 0x02 not a container or unsupported version, 0x06 inconsistent fields
+	*/
+	static int LoadHeader(const uint8_t* bytes, AES_CONTAINER_HEADER* header);
+};
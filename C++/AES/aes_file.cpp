@@ -0,0 +1,511 @@
+#include "aes_config.h"
+#include "aes.h"
+#include "aes_progress.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+#ifdef AES_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//
+static uint8_t* AES_AlignedAlloc(size_t size) {
+#ifdef _MSC_VER
+	return (uint8_t*)_aligned_malloc(size, AES_FILE_BUFFER_ALIGN);
+#else
+	void* buffer = NULL;
+	return posix_memalign(&buffer, AES_FILE_BUFFER_ALIGN, size) == 0 ? (uint8_t*)buffer : NULL;
+#endif
+}
+
+//
+static void AES_AlignedFree(uint8_t* buffer) {
+#ifdef _MSC_VER
+	_aligned_free(buffer);
+#else
+	free(buffer);
+#endif
+}
+
+/**
+*	One buffer of the pipeline ring
+*/
+struct AES_FILE_CHUNK {
+	uint8_t* data;			//AES_FILE_BUFFER_SIZE + 16 bytes (room for the padding block)
+	size_t length;			//Valid bytes
+	size_t input;			//Input bytes of the chunk (progress)
+	bool last;				//Last chunk of the file (gets or loses the padding)
+};
+
+/**
+*	Blocking queue of ring indices between two pipeline stages
+*/
+class AESChunkQueue {
+
+private:
+
+	std::deque<uint8_t> items;
+	std::mutex lock;
+	std::condition_variable ready;
+	bool closed = false;
+
+public:
+
+	//
+	void Push(uint8_t item) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			items.push_back(item);
+		}
+		ready.notify_one();
+	}
+
+	//Wait for the next item, false once the queue is closed and empty
+	bool Pop(uint8_t* item) {
+		std::unique_lock<std::mutex> guard(lock);
+		ready.wait(guard, [this] { return !items.empty() || closed; });
+		if (items.empty())	return false;
+		*item = items.front();
+		items.pop_front();
+		return true;
+	}
+
+	//No more items will be pushed
+	void Close() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			closed = true;
+		}
+		ready.notify_all();
+	}
+};
+
+//
+int AES::EncryptFileToFile(char* inputFileName, char* outputFileName) const {
+
+	if (inputFileName == NULL || outputFileName == NULL)	return 0x0A;
+
+	FILE* inputFile = OpenFile(inputFileName, "rb");
+	if (inputFile == NULL)		return 0x01;		//Error while opening source file
+
+	//Input file's length in bytes
+	size_t streamLen = GetFileSizeBytes(inputFile);
+	if (streamLen < 1)			{ fclose(inputFile); return 0x02; }
+
+	//Create output file
+	FILE* outputFile = OpenFile(outputFileName, "w+b");		//Read-write: AES_FILE_MMAP maps the output with PROT_WRITE
+	if (outputFile == NULL)		{ fclose(inputFile); return 0x03; }		//Error creating output file
+
+	int result = CryptFile(inputFile, outputFile, streamLen, true);
+
+	//Close files
+	if (fclose(outputFile) != 0 && result == 0x00)	result = 0x01;
+	fclose(inputFile);
+
+	switch (result) {
+	case 0x00:	return 0x00;
+	case 0x02:	return 0x05;		//Out of memory
+	case 0x05:	return 0x0B;		//Cancelled
+	default:	return 0x04;		//Read / write error
+	}
+}
+
+//
+size_t AES::DecryptFileToFile(char* inputFileName, char* outputFileName) const {
+
+	if (inputFileName == NULL || outputFileName == NULL)	return 0x0A;
+
+	FILE* inputFile = OpenFile(inputFileName, "rb");
+	if (inputFile == NULL)		return 0x01;			//Error while opening source file
+
+	size_t streamLen = GetFileSizeBytes(inputFile);
+
+	if (streamLen < 1)				{ fclose(inputFile); return 0x02; }		//Empty input file
+	if ((streamLen & 0x0F) != 0x00)	{ fclose(inputFile); return 0x03; }		//Bad file size
+
+	//Create output file
+	FILE* outputFile = OpenFile(outputFileName, "w+b");		//Read-write: AES_FILE_MMAP maps the output with PROT_WRITE
+	if (outputFile == NULL)		{ fclose(inputFile); return 0x04; }			//Error creating output file
+
+	int result = CryptFile(inputFile, outputFile, streamLen, false);
+
+	//Close files
+	if (fclose(outputFile) != 0 && result == 0x00)	result = 0x01;
+	fclose(inputFile);
+
+	switch (result) {
+	case 0x00:	return 0x00;
+	case 0x02:	return 0x06;		//Out of memory
+	case 0x03:	return 0x07;		//Bad padding
+	case 0x05:	return 0x0B;		//Cancelled
+	default:	return 0x05;		//Read / write error
+	}
+}
+
+//
+int AES::CryptFile(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt) const {
+
+	AESProgressTracker progress(observer.get(), length);
+
+	//The modes report whole file chunks, the streams they run must not report their own
+	AES cipher = *this;
+	cipher.observer.reset();
+
+	if (fileMode == AES_FILE_MMAP) {
+		int result = cipher.CryptFileMapped(inputFile, outputFile, length, encrypt, progress);
+		if (result != 0x04)		return result;
+	}
+
+	if (fileMode == AES_FILE_URING) {
+		int result = cipher.CryptFileUring(inputFile, outputFile, length, encrypt, progress);
+		if (result != 0x04)		return result;
+	}
+
+	if (fileMode == AES_FILE_PARALLEL) {
+		int result = cipher.CryptFileParallel(inputFile, outputFile, length, encrypt, progress);
+		if (result != 0x04)		return result;
+	}
+
+	return cipher.CryptFilePipeline(inputFile, outputFile, length, encrypt, progress);
+}
+
+#ifdef AES_POSIX
+
+//
+int AES::CryptFileMapped(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const {
+
+	int inputFd = fileno(inputFile);
+	int outputFd = fileno(outputFile);
+
+	//Pipes, sockets and devices go through the buffered path
+	struct stat inputStat, outputStat;
+	if (fstat(inputFd, &inputStat) != 0 || fstat(outputFd, &outputStat) != 0)	return 0x04;
+	if (!S_ISREG(inputStat.st_mode) || !S_ISREG(outputStat.st_mode))			return 0x04;
+	if ((uint64_t)inputStat.st_size != (uint64_t)length)						return 0x04;
+
+	size_t outputLength = encrypt ? PaddedLength(length, true) : length;
+
+	uint8_t* src = (uint8_t*)mmap(NULL, length, PROT_READ, MAP_SHARED, inputFd, 0);
+	if (src == MAP_FAILED)		return 0x04;
+
+	//Size the output before mapping it, pages past the end of file can't be written
+	if (ftruncate(outputFd, (off_t)outputLength) != 0) {
+		munmap(src, length);
+		return 0x04;
+	}
+
+#ifdef __linux__
+	//Reserve the blocks now so a full disk fails here instead of as SIGBUS on a page write
+	int reserve = posix_fallocate(outputFd, 0, (off_t)outputLength);
+	if (reserve != 0 && reserve != EINVAL && reserve != EOPNOTSUPP) {
+		munmap(src, length);
+		ftruncate(outputFd, 0);
+		return 0x01;
+	}
+#endif
+
+	uint8_t* dst = (uint8_t*)mmap(NULL, outputLength, PROT_READ | PROT_WRITE, MAP_SHARED, outputFd, 0);
+	if (dst == MAP_FAILED) {
+		munmap(src, length);
+		ftruncate(outputFd, 0);
+		return 0x04;
+	}
+
+	//Both files are walked front to back once: read ahead aggressively, drop pages behind
+	madvise(src, length, MADV_SEQUENTIAL);
+	madvise(dst, outputLength, MADV_SEQUENTIAL);
+
+	//Whole blocks go from page to page in AES_FILE_BUFFER_SIZE pieces (one progress report each), the padded last block is assembled on the stack
+	const uint64_t pieces = (length + AES_FILE_BUFFER_SIZE - 1) / AES_FILE_BUFFER_SIZE;
+	progress.SetChunks(pieces);
+
+	size_t resultLength = 0;
+	int result = 0x00;
+
+	for (size_t offset = 0; offset < length && result == 0x00; offset += AES_FILE_BUFFER_SIZE) {
+		size_t piece = length - offset < AES_FILE_BUFFER_SIZE ? length - offset : AES_FILE_BUFFER_SIZE;
+		bool last = offset + piece == length;
+		size_t pieceLength = 0;
+
+		//Page faults are taken inside the cipher, so the mapped mode reports them as cipher time
+		uint64_t start = progress.Now();
+		int code = encrypt
+			? EncryptInto(src + offset, piece, dst + offset, outputLength - offset, &pieceLength, last)
+			: DecryptInto(src + offset, piece, dst + offset, outputLength - offset, &pieceLength, last);
+		progress.AddCipher(progress.Now() - start);
+
+		if (code == 0x04)			result = 0x03;		//Bad padding
+		else if (code != 0x00)		result = 0x01;
+		else if (!progress.Chunk(piece))	result = 0x05;
+
+		resultLength += pieceLength;
+	}
+
+	if (munmap(dst, outputLength) != 0 && result == 0x00)	result = 0x01;
+	munmap(src, length);
+
+	//Decryption drops the padding at the end of the file
+	if (result == 0x00 && resultLength != outputLength && ftruncate(outputFd, (off_t)resultLength) != 0)
+		result = 0x01;
+
+	//A failed, cancelled or badly padded file leaves no full-length output behind
+	if (result != 0x00)
+		ftruncate(outputFd, 0);
+
+	return result;
+}
+
+//Read a whole range at an offset (continues short reads)
+static bool AES_ReadAt(int fd, uint8_t* buffer, size_t length, uint64_t offset) {
+	while (length > 0) {
+		ssize_t n = pread(fd, buffer, length, (off_t)offset);
+		if (n < 0 && errno == EINTR)	continue;
+		if (n <= 0)						return false;
+		buffer += n;
+		length -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+	return true;
+}
+
+//Write a whole range at an offset (continues short writes)
+static bool AES_WriteAt(int fd, const uint8_t* buffer, size_t length, uint64_t offset) {
+	while (length > 0) {
+		ssize_t n = pwrite(fd, buffer, length, (off_t)offset);
+		if (n < 0 && errno == EINTR)	continue;
+		if (n <= 0)						return false;
+		buffer += n;
+		length -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+	return true;
+}
+
+//
+int AES::CryptFileParallel(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const {
+
+	int inputFd = fileno(inputFile);
+	int outputFd = fileno(outputFile);
+
+	//Positioned reads and writes need seekable files
+	struct stat inputStat, outputStat;
+	if (fstat(inputFd, &inputStat) != 0 || fstat(outputFd, &outputStat) != 0)	return 0x04;
+	if (!S_ISREG(inputStat.st_mode) || !S_ISREG(outputStat.st_mode))			return 0x04;
+
+	const long long ranges = (long long)((length + AES_FILE_BUFFER_SIZE - 1) / AES_FILE_BUFFER_SIZE);
+	progress.SetChunks((uint64_t)ranges);
+
+	int threads = 1;
+#ifdef _OPENMP
+	threads = threadNum > 0 ? threadNum : omp_get_max_threads();
+#endif
+	if (threads > ranges)	threads = (int)ranges;
+
+	//Every thread already works on its own range, the cipher inside stays single-threaded
+	AES worker = *this;
+	worker.SetThreadNum(1);
+
+	std::atomic<long long> nextRange(0);
+	std::atomic<int> error(0x00);
+
+	#pragma omp parallel num_threads(threads)
+	{
+		uint8_t* buffer = AES_AlignedAlloc(AES_FILE_BUFFER_SIZE + 16);
+		if (buffer == NULL) {
+			int expected = 0x00;
+			error.compare_exchange_strong(expected, 0x02);
+		}
+
+		//Ranges are handed out in file order, a thread takes the next one as soon as it is done
+		long long r;
+		while (buffer != NULL && error.load() == 0x00 && (r = nextRange.fetch_add(1)) < ranges) {
+			uint64_t offset = (uint64_t)r * AES_FILE_BUFFER_SIZE;
+			size_t chunk = length - offset < AES_FILE_BUFFER_SIZE ? (size_t)(length - offset) : AES_FILE_BUFFER_SIZE;
+			bool last = r == ranges - 1;
+			size_t outLength = 0;
+			int code = 0x00;
+
+			uint64_t start = progress.Now();
+			bool read = AES_ReadAt(inputFd, buffer, chunk, offset);
+			progress.AddIO(progress.Now() - start);
+
+			if (!read)
+				code = 0x01;
+			else {
+				//Only the owner of the final range pads or unpads, the output offsets equal the input offsets
+				start = progress.Now();
+				code = encrypt
+					? worker.EncryptInto(buffer, chunk, buffer, AES_FILE_BUFFER_SIZE + 16, &outLength, last)
+					: worker.DecryptInto(buffer, chunk, buffer, AES_FILE_BUFFER_SIZE + 16, &outLength, last);
+				progress.AddCipher(progress.Now() - start);
+				code = code == 0x00 ? 0x00 : (code == 0x04 ? 0x03 : 0x01);
+			}
+
+			if (code == 0x00) {
+				start = progress.Now();
+				bool written = AES_WriteAt(outputFd, buffer, outLength, offset);
+				progress.AddIO(progress.Now() - start);
+
+				if (!written)						code = 0x01;
+				else if (!progress.Chunk(chunk))	code = 0x05;
+			}
+
+			if (code != 0x00) {
+				int expected = 0x00;
+				error.compare_exchange_strong(expected, code);
+			}
+		}
+
+		if (buffer != NULL) {
+			AES_SecureZero(buffer, AES_FILE_BUFFER_SIZE + 16);
+			AES_AlignedFree(buffer);
+		}
+	}
+
+	return error.load();
+}
+
+#else
+
+//No mapping API wired up on this platform, the buffered pipeline is used
+int AES::CryptFileMapped(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const {
+	return 0x04;
+}
+
+//No positioned I/O wired up on this platform, the buffered pipeline is used
+int AES::CryptFileParallel(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const {
+	return 0x04;
+}
+
+#endif
+
+//
+int AES::CryptFilePipeline(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const {
+
+	AES_FILE_CHUNK ring[AES_FILE_BUFFER_COUNT];
+	int result = 0x00;
+
+	for (uint8_t i = 0; i < AES_FILE_BUFFER_COUNT; i++) {
+		ring[i].data = AES_AlignedAlloc(AES_FILE_BUFFER_SIZE + 16);
+		if (ring[i].data == NULL)	result = 0x02;
+	}
+
+	if (result != 0x00) {
+		for (uint8_t i = 0; i < AES_FILE_BUFFER_COUNT; i++)
+			AES_AlignedFree(ring[i].data);
+		return result;
+	}
+
+	//The chunks are already large, stdio buffering would only add a copy
+	setvbuf(inputFile, NULL, _IONBF, 0);
+	setvbuf(outputFile, NULL, _IONBF, 0);
+
+	//free -> reader -> filled -> cipher -> done -> writer -> free
+	AESChunkQueue freeQueue, filledQueue, doneQueue;
+	std::atomic<int> error(0x00);
+
+	//Any stage failing stops the other two
+	auto abort = [&](int code) {
+		int expected = 0x00;
+		error.compare_exchange_strong(expected, code);
+		freeQueue.Close();
+		filledQueue.Close();
+		doneQueue.Close();
+	};
+
+	for (uint8_t i = 0; i < AES_FILE_BUFFER_COUNT; i++)
+		freeQueue.Push(i);
+
+	progress.SetChunks((length + AES_FILE_BUFFER_SIZE - 1) / AES_FILE_BUFFER_SIZE);
+
+	std::thread reader([&] {
+		size_t remaining = length;
+		uint8_t i;
+
+		while (remaining > 0 && freeQueue.Pop(&i)) {
+			size_t chunk = remaining < AES_FILE_BUFFER_SIZE ? remaining : AES_FILE_BUFFER_SIZE;
+
+			uint64_t start = progress.Now();
+			size_t read = fread(ring[i].data, 1, chunk, inputFile);
+			progress.AddIO(progress.Now() - start);
+
+			if (read != chunk) {
+				abort(0x01);
+				return;
+			}
+
+			remaining -= chunk;
+			ring[i].length = chunk;
+			ring[i].input = chunk;
+			ring[i].last = remaining == 0;
+			filledQueue.Push(i);
+		}
+		filledQueue.Close();
+	});
+
+	std::thread writer([&] {
+		uint8_t i;
+
+		while (doneQueue.Pop(&i)) {
+			uint64_t start = progress.Now();
+			bool written = ring[i].length == 0 || fwrite(ring[i].data, 1, ring[i].length, outputFile) == ring[i].length;
+			progress.AddIO(progress.Now() - start);
+
+			if (!written) {
+				abort(0x01);
+				return;
+			}
+			if (!progress.Chunk(ring[i].input)) {
+				abort(0x05);
+				return;
+			}
+			freeQueue.Push(i);
+		}
+	});
+
+	//Cipher stage on the calling thread, in place (a chunk above the parallel size limit is split across OpenMP threads)
+	uint8_t c;
+	while (filledQueue.Pop(&c)) {
+		size_t outLength = 0;
+
+		uint64_t start = progress.Now();
+		int code = encrypt
+			? EncryptInto(ring[c].data, ring[c].length, ring[c].data, AES_FILE_BUFFER_SIZE + 16, &outLength, ring[c].last)
+			: DecryptInto(ring[c].data, ring[c].length, ring[c].data, AES_FILE_BUFFER_SIZE + 16, &outLength, ring[c].last);
+		progress.AddCipher(progress.Now() - start);
+
+		if (code != 0x00) {
+			abort(code == 0x04 ? 0x03 : 0x01);
+			break;
+		}
+
+		ring[c].length = outLength;
+		doneQueue.Push(c);
+	}
+	doneQueue.Close();
+
+	reader.join();
+	writer.join();
+
+	result = error.load();
+
+	//The ring held plaintext
+	for (uint8_t i = 0; i < AES_FILE_BUFFER_COUNT; i++) {
+		AES_SecureZero(ring[i].data, AES_FILE_BUFFER_SIZE + 16);
+		AES_AlignedFree(ring[i].data);
+	}
+
+	return result;
+}
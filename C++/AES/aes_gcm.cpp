@@ -0,0 +1,607 @@
+#include "aes_config.h"
+#include "aes_ni.h"
+#include "aes_gcm.h"
+
+//Big-endian access to the counter and length fields
+#define GCM_GETU32(p)		(((uint32_t)(p)[0] << 24) ^ ((uint32_t)(p)[1] << 16) ^ ((uint32_t)(p)[2] << 8) ^ ((uint32_t)(p)[3]))
+#define GCM_PUTU32(p, v)	{ (p)[0] = (uint8_t)((v) >> 24); (p)[1] = (uint8_t)((v) >> 16); (p)[2] = (uint8_t)((v) >> 8); (p)[3] = (uint8_t)(v); }
+
+//Reduction of the 4 bits shifted out of the table multiplication
+static const uint64_t ghashLast4[16] = {
+	0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+	0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+//Build the 4-bit tables: entry i is H multiplied by the 4 bit polynomial i
+static void GHASH_InitTables(GHASH_KEY* key, const uint8_t* h) {
+	uint64_t vh = ((uint64_t)GCM_GETU32(h) << 32) | GCM_GETU32(h + 4);
+	uint64_t vl = ((uint64_t)GCM_GETU32(h + 8) << 32) | GCM_GETU32(h + 12);
+
+	key->hTableHigh[0] = 0;
+	key->hTableLow[0] = 0;
+	key->hTableHigh[8] = vh;
+	key->hTableLow[8] = vl;
+
+	for (uint8_t i = 4; i > 0; i >>= 1) {
+		uint64_t t = (vl & 0x01) * 0xe100000000000000ULL;
+		vl = (vh << 63) | (vl >> 1);
+		vh = (vh >> 1) ^ t;
+		key->hTableHigh[i] = vh;
+		key->hTableLow[i] = vl;
+	}
+
+	for (uint8_t i = 2; i <= 8; i *= 2)
+		for (uint8_t j = 1; j < i; j++) {
+			key->hTableHigh[i + j] = key->hTableHigh[i] ^ key->hTableHigh[j];
+			key->hTableLow[i + j] = key->hTableLow[i] ^ key->hTableLow[j];
+		}
+}
+
+//x = x * H with the 4-bit tables
+static void GHASH_MultTable(const GHASH_KEY* key, uint8_t* x) {
+	uint8_t lo = x[15] & 0x0F;
+	uint64_t zh = key->hTableHigh[lo];
+	uint64_t zl = key->hTableLow[lo];
+
+	for (int8_t i = 15; i >= 0; i--) {
+		lo = x[i] & 0x0F;
+		uint8_t hi = x[i] >> 4;
+
+		if (i != 15) {
+			uint8_t rem = (uint8_t)(zl & 0x0F);
+			zl = (zh << 60) | (zl >> 4);
+			zh = (zh >> 4) ^ (ghashLast4[rem] << 48) ^ key->hTableHigh[lo];
+			zl ^= key->hTableLow[lo];
+		}
+
+		uint8_t rem = (uint8_t)(zl & 0x0F);
+		zl = (zh << 60) | (zl >> 4);
+		zh = (zh >> 4) ^ (ghashLast4[rem] << 48) ^ key->hTableHigh[hi];
+		zl ^= key->hTableLow[hi];
+	}
+
+	GCM_PUTU32(x, (uint32_t)(zh >> 32));
+	GCM_PUTU32(x + 4, (uint32_t)zh);
+	GCM_PUTU32(x + 8, (uint32_t)(zl >> 32));
+	GCM_PUTU32(x + 12, (uint32_t)zl);
+}
+
+//
+static void GHASH_BlocksTable(const GHASH_KEY* key, uint8_t* x, const uint8_t* data, size_t blockCount) {
+	for (size_t b = 0; b < blockCount; b++) {
+		for (uint8_t i = 0; i < 16; i++)
+			x[i] ^= data[b * 16 + i];
+		GHASH_MultTable(key, x);
+	}
+}
+
+#ifdef AES_X86
+
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <smmintrin.h>
+
+//
+bool GHASH_ClmulSupported() {
+	return (AES_CPUFeatures() & (AES_CPU_PCLMUL | AES_CPU_SSSE3)) == (AES_CPU_PCLMUL | AES_CPU_SSSE3);
+}
+
+//Blocks are byte reversed for PCLMULQDQ, GHASH bit order is reflected inside the bytes
+#define GHASH_BSWAP_MASK	_mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+
+//Accumulate the unreduced 256 bit product a * h (schoolbook, three partial sums)
+#define GHASH_MUL_ACC(lo, mid, hi, a, h) \
+	lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(a, h, 0x00)); \
+	hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(a, h, 0x11)); \
+	mid = _mm_xor_si128(mid, _mm_xor_si128(_mm_clmulepi64_si128(a, h, 0x01), _mm_clmulepi64_si128(a, h, 0x10)));
+
+//Shift the 256 bit product left by one (bit reflection) and reduce modulo x^128 + x^7 + x^2 + x + 1
+AES_TARGET("pclmul,sse2")
+static inline __m128i GHASH_Reduce(__m128i lo, __m128i mid, __m128i hi) {
+	__m128i r0 = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+	__m128i r1 = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+	__m128i c0 = _mm_srli_epi32(r0, 31);
+	__m128i c1 = _mm_srli_epi32(r1, 31);
+	r0 = _mm_slli_epi32(r0, 1);
+	r1 = _mm_slli_epi32(r1, 1);
+	__m128i carry = _mm_srli_si128(c0, 12);
+	c1 = _mm_slli_si128(c1, 4);
+	c0 = _mm_slli_si128(c0, 4);
+	r0 = _mm_or_si128(r0, c0);
+	r1 = _mm_or_si128(_mm_or_si128(r1, c1), carry);
+
+	__m128i t0 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(r0, 31), _mm_slli_epi32(r0, 30)), _mm_slli_epi32(r0, 25));
+	__m128i t1 = _mm_srli_si128(t0, 4);
+	r0 = _mm_xor_si128(r0, _mm_slli_si128(t0, 12));
+
+	__m128i t2 = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(r0, 1), _mm_srli_epi32(r0, 2)), _mm_srli_epi32(r0, 7));
+	t2 = _mm_xor_si128(t2, t1);
+	r0 = _mm_xor_si128(r0, t2);
+
+	return _mm_xor_si128(r1, r0);
+}
+
+//
+AES_TARGET("pclmul,sse2")
+static inline __m128i GHASH_Mult(__m128i a, __m128i b) {
+	__m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+	GHASH_MUL_ACC(lo, mid, hi, a, b);
+	return GHASH_Reduce(lo, mid, hi);
+}
+
+//
+AES_TARGET("pclmul,ssse3,sse2")
+static void GHASH_InitClmul(GHASH_KEY* key, const uint8_t* h) {
+	const __m128i bswap = GHASH_BSWAP_MASK;
+	__m128i h1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)h), bswap);
+
+	//hPowers[7] = H, hPowers[0] = H^8
+	__m128i p = h1;
+	_mm_store_si128((__m128i*)key->hPowers[7], p);
+	for (int8_t i = 6; i >= 0; i--) {
+		p = GHASH_Mult(p, h1);
+		_mm_store_si128((__m128i*)key->hPowers[i], p);
+	}
+}
+
+//
+AES_TARGET("pclmul,ssse3,sse2")
+static void GHASH_BlocksClmul(const GHASH_KEY* key, uint8_t* x, const uint8_t* data, size_t blockCount) {
+	const __m128i bswap = GHASH_BSWAP_MASK;
+	__m128i hp[8];
+	for (uint8_t i = 0; i < 8; i++)
+		hp[i] = _mm_load_si128((const __m128i*)key->hPowers[i]);
+
+	__m128i X = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)x), bswap);
+
+	//Eight blocks per reduction: X = (X ^ d0) * H^8 ^ d1 * H^7 ^ ... ^ d7 * H
+	size_t b = 0;
+	for (; b + 8 <= blockCount; b += 8) {
+		__m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+		const __m128i* d = (const __m128i*)(data + b * 16);
+		__m128i a = _mm_xor_si128(_mm_shuffle_epi8(_mm_loadu_si128(d), bswap), X);
+		GHASH_MUL_ACC(lo, mid, hi, a, hp[0]);
+		for (uint8_t j = 1; j < 8; j++) {
+			a = _mm_shuffle_epi8(_mm_loadu_si128(d + j), bswap);
+			GHASH_MUL_ACC(lo, mid, hi, a, hp[j]);
+		}
+		X = GHASH_Reduce(lo, mid, hi);
+	}
+
+	for (; b < blockCount; b++)
+		X = GHASH_Mult(_mm_xor_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + b * 16)), bswap), X), hp[7]);
+
+	_mm_storeu_si128((__m128i*)x, _mm_shuffle_epi8(X, bswap));
+}
+
+//Apply one round instruction with key k to all eight states
+#define GCM_ROUND8(op, s, k) \
+	s[0] = op(s[0], k); s[1] = op(s[1], k); s[2] = op(s[2], k); s[3] = op(s[3], k); \
+	s[4] = op(s[4], k); s[5] = op(s[5], k); s[6] = op(s[6], k); s[7] = op(s[7], k);
+
+//Byte swapped 32 bit counter for the last word of a counter block
+#define GCM_BSWAP32(v)		(((v) >> 24) | (((v) >> 8) & 0xFF00) | (((v) << 8) & 0xFF0000) | ((v) << 24))
+
+//CTR keystream and GHASH in one loop: the GHASH multiplies of eight blocks are spread over the AES rounds of the next eight.
+//Decryption hashes the current ciphertext, encryption the ciphertext of the previous iteration.
+template<uint8_t Rounds>
+AES_TARGET("aes,pclmul,sse4.1,ssse3,sse2")
+static inline size_t AESNI_GCMBlocks(const uint8_t* encKeys, const GHASH_KEY* key, uint8_t* counter, const uint8_t* src, uint8_t* dst, size_t blockCount, uint8_t* x, bool encrypt) {
+	const __m128i bswap = GHASH_BSWAP_MASK;
+	const __m128i* rk = (const __m128i*)encKeys;
+	__m128i k[Rounds + 1];
+	for (uint8_t i = 0; i <= Rounds; i++)
+		k[i] = _mm_load_si128(rk + i);
+
+	__m128i hp[8];
+	for (uint8_t i = 0; i < 8; i++)
+		hp[i] = _mm_load_si128((const __m128i*)key->hPowers[i]);
+
+	__m128i X = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)x), bswap);
+	__m128i ctrBlock = _mm_loadu_si128((const __m128i*)counter);
+	uint32_t ctr = GCM_GETU32(counter + 12);
+
+	__m128i h[8];
+	bool pending = false;
+	size_t blcks = blockCount & ~(size_t)7;
+
+	for (size_t b = 0; b < blcks; b += 8) {
+		const __m128i* in = (const __m128i*)(src + b * 16);
+		__m128i* out = (__m128i*)(dst + b * 16);
+
+		__m128i s[8];
+		for (uint8_t j = 0; j < 8; j++) {
+			uint32_t c = ctr + j;
+			s[j] = _mm_xor_si128(_mm_insert_epi32(ctrBlock, (int)GCM_BSWAP32(c), 3), k[0]);
+		}
+		ctr += 8;
+
+		if (!encrypt)
+			for (uint8_t j = 0; j < 8; j++)
+				h[j] = _mm_shuffle_epi8(_mm_loadu_si128(in + j), bswap);
+
+		bool hash = !encrypt || pending;
+		__m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+		if (hash)
+			h[0] = _mm_xor_si128(h[0], X);
+
+		//The eight multiplies go into the first eight rounds, longer keys just run more plain rounds
+		AES_UNROLL
+		for (uint8_t i = 1; i < Rounds; i++) {
+			GCM_ROUND8(_mm_aesenc_si128, s, k[i]);
+			if (i <= 8 && hash) {
+				GHASH_MUL_ACC(lo, mid, hi, h[i - 1], hp[i - 1]);
+			}
+		}
+		GCM_ROUND8(_mm_aesenclast_si128, s, k[Rounds]);
+
+		for (uint8_t j = 0; j < 8; j++) {
+			__m128i c = _mm_xor_si128(s[j], _mm_loadu_si128(in + j));
+			_mm_storeu_si128(out + j, c);
+			if (encrypt)
+				h[j] = _mm_shuffle_epi8(c, bswap);
+		}
+
+		if (hash)
+			X = GHASH_Reduce(lo, mid, hi);
+		pending = encrypt;
+	}
+
+	//Encryption still owes the hash of the last eight ciphertext blocks
+	if (pending) {
+		__m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+		h[0] = _mm_xor_si128(h[0], X);
+		for (uint8_t j = 0; j < 8; j++) {
+			GHASH_MUL_ACC(lo, mid, hi, h[j], hp[j]);
+		}
+		X = GHASH_Reduce(lo, mid, hi);
+	}
+
+	_mm_storeu_si128((__m128i*)x, _mm_shuffle_epi8(X, bswap));
+	GCM_PUTU32(counter + 12, ctr);
+
+	return blcks;
+}
+
+//
+size_t AESNI_GCMEncryptBlocks(const uint8_t* encKeys, uint8_t rounds, const GHASH_KEY* key, uint8_t* counter, const uint8_t* src, uint8_t* dst, size_t blockCount, uint8_t* x) {
+	switch (rounds) {
+	case 12:	return AESNI_GCMBlocks<12>(encKeys, key, counter, src, dst, blockCount, x, true);
+	case 14:	return AESNI_GCMBlocks<14>(encKeys, key, counter, src, dst, blockCount, x, true);
+	default:	return AESNI_GCMBlocks<10>(encKeys, key, counter, src, dst, blockCount, x, true);
+	}
+}
+
+//
+size_t AESNI_GCMDecryptBlocks(const uint8_t* encKeys, uint8_t rounds, const GHASH_KEY* key, uint8_t* counter, const uint8_t* src, uint8_t* dst, size_t blockCount, uint8_t* x) {
+	switch (rounds) {
+	case 12:	return AESNI_GCMBlocks<12>(encKeys, key, counter, src, dst, blockCount, x, false);
+	case 14:	return AESNI_GCMBlocks<14>(encKeys, key, counter, src, dst, blockCount, x, false);
+	default:	return AESNI_GCMBlocks<10>(encKeys, key, counter, src, dst, blockCount, x, false);
+	}
+}
+
+#else
+
+//No carry-less multiply on this target, GHASH always uses the tables
+
+//
+bool GHASH_ClmulSupported() {
+	return false;
+}
+
+//
+static void GHASH_InitClmul(GHASH_KEY* key, const uint8_t* h) {
+	memset(key->hPowers, 0, sizeof(key->hPowers));
+}
+
+//
+static void GHASH_BlocksClmul(const GHASH_KEY* key, uint8_t* x, const uint8_t* data, size_t blockCount) {
+	GHASH_BlocksTable(key, x, data, blockCount);
+}
+
+//
+size_t AESNI_GCMEncryptBlocks(const uint8_t* encKeys, uint8_t rounds, const GHASH_KEY* key, uint8_t* counter, const uint8_t* src, uint8_t* dst, size_t blockCount, uint8_t* x) {
+	return 0;
+}
+
+//
+size_t AESNI_GCMDecryptBlocks(const uint8_t* encKeys, uint8_t rounds, const GHASH_KEY* key, uint8_t* counter, const uint8_t* src, uint8_t* dst, size_t blockCount, uint8_t* x) {
+	return 0;
+}
+
+#endif
+
+//
+void GHASH_Init(GHASH_KEY* key, const uint8_t* h) {
+	key->clmul = GHASH_ClmulSupported();
+	GHASH_InitTables(key, h);
+	if (key->clmul)
+		GHASH_InitClmul(key, h);
+	else
+		memset(key->hPowers, 0, sizeof(key->hPowers));
+}
+
+//
+void GHASH_Blocks(const GHASH_KEY* key, uint8_t* x, const uint8_t* data, size_t blockCount) {
+	if (key->clmul)
+		GHASH_BlocksClmul(key, x, data, blockCount);
+	else
+		GHASH_BlocksTable(key, x, data, blockCount);
+}
+
+//
+AESGCM::AESGCM(const AES& aes) : aes(aes) {
+	alignas(16) uint8_t h[16] = { 0 };
+	this->aes.EncryptBlock(h);
+	GHASH_Init(&ghashKey, h);
+}
+
+//
+bool AESGCM::SetClmul(bool clmul) {
+	if (clmul && !GHASH_ClmulSupported())	return false;
+	ghashKey.clmul = clmul;
+	return true;
+}
+
+//
+int AESGCM::Start(const uint8_t* iv, size_t ivLength) {
+	if (iv == NULL || ivLength < 1)		return 0x01;		//Define error	->	NULL or empty IV
+
+	memset(x, 0, 16);
+
+	if (ivLength == 12) {
+		//Recommended IV size: IV || 0^31 || 1
+		memcpy(j0, iv, 12);
+		j0[12] = j0[13] = j0[14] = 0;
+		j0[15] = 1;
+	}
+	else {
+		//Any other size is hashed together with its bit length
+		uint8_t block[16] = { 0 };
+		GHASH_Blocks(&ghashKey, x, iv, ivLength / 16);
+		if (ivLength & 0x0F) {
+			memcpy(block, iv + (ivLength & ~(size_t)0x0F), ivLength & 0x0F);
+			GHASH_Blocks(&ghashKey, x, block, 1);
+			memset(block, 0, 16);
+		}
+		uint64_t bits = (uint64_t)ivLength * 8;
+		GCM_PUTU32(block + 8, (uint32_t)(bits >> 32));
+		GCM_PUTU32(block + 12, (uint32_t)bits);
+		GHASH_Blocks(&ghashKey, x, block, 1);
+		memcpy(j0, x, 16);
+		memset(x, 0, 16);
+	}
+
+	memcpy(counter, j0, 16);
+	CounterInc32(counter, 1);
+
+	partialLength = 0;
+	aadLength = 0;
+	dataLength = 0;
+	phase = 1;
+
+	return 0x00;
+}
+
+//
+int AESGCM::UpdateAAD(const uint8_t* aad, size_t length) {
+	if (phase != 1)						return 0x02;		//Define error	->	Not started or data already processed
+	if (length < 1)						return 0x00;
+	if (aad == NULL)					return 0x01;		//Define error	->	NULL data
+
+	aadLength += length;
+
+	//Complete a partial block from the previous call
+	if (partialLength > 0) {
+		size_t take = (16 - partialLength < length ? 16 - partialLength : length);
+		memcpy(partial + partialLength, aad, take);
+		partialLength += take;
+		aad += take;
+		length -= take;
+		if (partialLength < 16)
+			return 0x00;
+		GHASH_Blocks(&ghashKey, x, partial, 1);
+		partialLength = 0;
+	}
+
+	GHASH_Blocks(&ghashKey, x, aad, length / 16);
+
+	partialLength = length & 0x0F;
+	memcpy(partial, aad + (length - partialLength), partialLength);
+
+	return 0x00;
+}
+
+//
+int AESGCM::EncryptUpdate(const uint8_t* src, uint8_t* dst, size_t length) {
+	return Update(src, dst, length, true);
+}
+
+//
+int AESGCM::DecryptUpdate(const uint8_t* src, uint8_t* dst, size_t length) {
+	return Update(src, dst, length, false);
+}
+
+//
+int AESGCM::Update(const uint8_t* src, uint8_t* dst, size_t length, bool encrypt) {
+	if (phase != 1 && phase != 2)								return 0x02;		//Define error	->	Not started or already finished
+	if (length > 0 && (src == NULL || dst == NULL))				return 0x01;		//Define error	->	NULL data
+	if (length > AES_GCM_MAX_LENGTH || dataLength + length > AES_GCM_MAX_LENGTH)	return 0x05;		//Define error	->	Counter would wrap
+
+	//The AAD ends with the first data
+	if (phase == 1) {
+		FlushPartial();
+		phase = 2;
+	}
+
+	dataLength += length;
+	size_t pos = 0;
+
+	//Use up the keystream block left over from the previous call
+	if (partialLength > 0) {
+		for (; partialLength < 16 && pos < length; pos++) {
+			uint8_t in = src[pos];
+			uint8_t out = in ^ keystream[partialLength];
+			dst[pos] = out;
+			partial[partialLength++] = encrypt ? out : in;
+		}
+		if (partialLength < 16)
+			return 0x00;
+		GHASH_Blocks(&ghashKey, x, partial, 1);
+		partialLength = 0;
+	}
+
+	size_t blcks = (length - pos) / 16;
+
+	//Fused AES-NI + PCLMULQDQ kernel, eight blocks at a time
+	if (blcks >= 8 && ghashKey.clmul && aes.GetEngine() == AES_ENGINE_AESNI) {
+		std::shared_ptr<const AESKeySchedule> ks = aes.GetKeySchedule();
+		const uint8_t* keys = ks->GetRoundKeys();
+		uint8_t rounds = ks->GetRounds();
+		size_t done = encrypt ? AESNI_GCMEncryptBlocks(keys, rounds, &ghashKey, counter, src + pos, dst + pos, blcks, x) : AESNI_GCMDecryptBlocks(keys, rounds, &ghashKey, counter, src + pos, dst + pos, blcks, x);
+		pos += done * 16;
+		blcks -= done;
+	}
+
+	//Any other engine: a batch of keystream, then GHASH over the same batch while it is in cache
+	alignas(64) uint8_t ks[AES_GCM_BATCH_BLOCKS * 16];
+	while (blcks > 0) {
+		size_t n = (blcks < AES_GCM_BATCH_BLOCKS ? blcks : AES_GCM_BATCH_BLOCKS);
+
+		for (size_t b = 0; b < n; b++) {
+			memcpy(ks + b * 16, counter, 16);
+			CounterInc32(counter, 1);
+		}
+		aes.EncryptBlocks(ks, n);
+
+		if (!encrypt)
+			GHASH_Blocks(&ghashKey, x, src + pos, n);
+
+		for (size_t i = 0; i < n * 16; i += 8) {
+			uint64_t a, k;
+			memcpy(&a, src + pos + i, 8);
+			memcpy(&k, ks + i, 8);
+			a ^= k;
+			memcpy(dst + pos + i, &a, 8);
+		}
+
+		if (encrypt)
+			GHASH_Blocks(&ghashKey, x, dst + pos, n);
+
+		pos += n * 16;
+		blcks -= n;
+	}
+
+	//Start a new keystream block for the tail
+	if (pos < length) {
+		memcpy(keystream, counter, 16);
+		CounterInc32(counter, 1);
+		aes.EncryptBlock(keystream);
+
+		for (; pos < length; pos++) {
+			uint8_t in = src[pos];
+			uint8_t out = in ^ keystream[partialLength];
+			dst[pos] = out;
+			partial[partialLength++] = encrypt ? out : in;
+		}
+	}
+
+	return 0x00;
+}
+
+//SP 800-38D tag lengths: 12..16 bytes, 8 and 4 only for restricted uses
+static inline bool GCM_ValidTagLength(size_t tagLength) {
+	return (tagLength >= 12 && tagLength <= 16) || tagLength == 8 || tagLength == 4;
+}
+
+//
+int AESGCM::EncryptFinal(uint8_t* tag, size_t tagLength) {
+	if (phase != 1 && phase != 2)			return 0x02;		//Define error	->	Not started or already finished
+	if (tag == NULL)						return 0x01;		//Define error	->	NULL tag
+	if (!GCM_ValidTagLength(tagLength))		return 0x04;		//Define error	->	Bad tag length
+
+	uint8_t fullTag[16];
+	ComputeTag(fullTag);
+	memcpy(tag, fullTag, tagLength);
+
+	return 0x00;
+}
+
+//
+int AESGCM::DecryptFinal(const uint8_t* tag, size_t tagLength) {
+	if (phase != 1 && phase != 2)			return 0x02;		//Define error	->	Not started or already finished
+	if (tag == NULL)						return 0x01;		//Define error	->	NULL tag
+	if (!GCM_ValidTagLength(tagLength))		return 0x04;		//Define error	->	Bad tag length
+
+	uint8_t fullTag[16];
+	ComputeTag(fullTag);
+
+	//Compare every byte, the time must not depend on the first mismatch
+	uint8_t diff = 0;
+	for (size_t i = 0; i < tagLength; i++)
+		diff |= fullTag[i] ^ tag[i];
+
+	return diff == 0 ? 0x00 : 0x03;			//Define error	->	Tag mismatch
+}
+
+//
+int AESGCM::Encrypt(const uint8_t* iv, size_t ivLength, const uint8_t* aad, size_t aadLength, const uint8_t* src, uint8_t* dst, size_t length, uint8_t* tag, size_t tagLength) {
+	int result = Start(iv, ivLength);
+	if (result == 0x00)		result = UpdateAAD(aad, aadLength);
+	if (result == 0x00)		result = EncryptUpdate(src, dst, length);
+	if (result == 0x00)		result = EncryptFinal(tag, tagLength);
+	return result;
+}
+
+//
+int AESGCM::Decrypt(const uint8_t* iv, size_t ivLength, const uint8_t* aad, size_t aadLength, const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* tag, size_t tagLength) {
+	int result = Start(iv, ivLength);
+	if (result == 0x00)		result = UpdateAAD(aad, aadLength);
+	if (result == 0x00)		result = DecryptUpdate(src, dst, length);
+	if (result == 0x00)		result = DecryptFinal(tag, tagLength);
+
+	//Never hand out unauthenticated plaintext
+	if (result == 0x03 && dst != NULL)
+		memset(dst, 0, length);
+
+	return result;
+}
+
+//
+void AESGCM::FlushPartial() {
+	if (partialLength == 0)		return;
+
+	memset(partial + partialLength, 0, 16 - partialLength);
+	GHASH_Blocks(&ghashKey, x, partial, 1);
+	partialLength = 0;
+}
+
+//
+void AESGCM::ComputeTag(uint8_t* tag) {
+	FlushPartial();
+
+	//Length block: AAD and ciphertext lengths in bits
+	uint8_t block[16];
+	uint64_t aadBits = aadLength * 8, dataBits = dataLength * 8;
+	GCM_PUTU32(block, (uint32_t)(aadBits >> 32));
+	GCM_PUTU32(block + 4, (uint32_t)aadBits);
+	GCM_PUTU32(block + 8, (uint32_t)(dataBits >> 32));
+	GCM_PUTU32(block + 12, (uint32_t)dataBits);
+	GHASH_Blocks(&ghashKey, x, block, 1);
+
+	memcpy(tag, j0, 16);
+	aes.EncryptBlock(tag);
+	for (uint8_t i = 0; i < 16; i++)
+		tag[i] ^= x[i];
+
+	phase = 3;
+}
+
+//
+void AESGCM::CounterInc32(uint8_t* counter, uint32_t value) {
+	uint32_t c = GCM_GETU32(counter + 12) + value;
+	GCM_PUTU32(counter + 12, c);
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "aes.h"
+
+/*
+*
+*	AES-GCM authenticated encryption (NIST SP 800-38D)
+*
+*	GHASH runs on PCLMULQDQ when available (8 blocks per reduction with H^1..H^8),
+*	otherwise on 4-bit tables (16 entries per key, not constant-time).
+*	With the AES-NI engine the CTR keystream and GHASH run in one fused 8-block loop.
+*
+*/
+
+#define AES_GCM_BATCH_BLOCKS	64						//Blocks encrypted and hashed together outside the fused kernel (1 KB, stays in L1 cache)
+#define AES_GCM_MAX_LENGTH		( (1ULL << 36) - 32 )	//Max plaintext length for one IV in bytes (2^32 - 2 counter blocks)
+
+/**
+*	Precomputed GHASH key (H = AES(0))
+*/
+struct GHASH_KEY {
+	alignas(16) uint8_t hPowers[8][16];		//H^8 .. H^1 byte reversed (PCLMULQDQ)
+	uint64_t hTableHigh[16];				//4-bit multiplication table of H, high halves
+	uint64_t hTableLow[16];					//4-bit multiplication table of H, low halves
+	bool clmul;								//True if PCLMULQDQ is used
+};
+
+/**
+*	Check if GHASH can use PCLMULQDQ
+*
+*	@returns <bool>					True if PCLMULQDQ and SSSE3 are available
+*/
+bool GHASH_ClmulSupported();
+
+/**
+*	Precompute the GHASH key
+*
+*	@param <GHASH_KEY*>key			Key to initialize
+*	@param <uint8_t*>h				16 byte hash subkey (AES encryption of the zero block)
+*/
+void GHASH_Init(GHASH_KEY* key, const uint8_t* h);
+
+/**
+*	Absorb whole blocks into a GHASH state
+*
+*	@param <GHASH_KEY*>key			GHASH key
+*	@param <uint8_t*>x				16 byte GHASH state
+*	@param <uint8_t*>data			Blocks to hash
+*	@param <size_t>blockCount		Number of blocks
+*/
+void GHASH_Blocks(const GHASH_KEY* key, uint8_t* x, const uint8_t* data, size_t blockCount);
+
+/**
+*	Encrypt and hash blocks in one pass with AES-NI and PCLMULQDQ (8 blocks per iteration)
+*
+*	@param <uint8_t*>encKeys		Encryption key stages in state byte order
+*	@param <uint8_t>rounds			Number of rounds (10, 12 or 14)
+*	@param <GHASH_KEY*>key			GHASH key (must use PCLMULQDQ)
+*	@param <uint8_t*>counter		Counter block, the last 32 bits are advanced by the processed blocks
+*	@param <uint8_t*>src			Plaintext
+*	@param <uint8_t*>dst			Ciphertext (may be src)
+*	@param <size_t>blockCount		Number of blocks
+*	@param <uint8_t*>x				16 byte GHASH state
+*
+*	@returns <size_t>				Number of processed blocks (multiple of 8)
+*/
+size_t AESNI_GCMEncryptBlocks(const uint8_t* encKeys, uint8_t rounds, const GHASH_KEY* key, uint8_t* counter, const uint8_t* src, uint8_t* dst, size_t blockCount, uint8_t* x);
+
+/**
+*	Hash and decrypt blocks in one pass with AES-NI and PCLMULQDQ (8 blocks per iteration)
+*
+*	@param <uint8_t*>encKeys		Encryption key stages in state byte order
+*	@param <uint8_t>rounds			Number of rounds (10, 12 or 14)
+*	@param <GHASH_KEY*>key			GHASH key (must use PCLMULQDQ)
+*	@param <uint8_t*>counter		Counter block, the last 32 bits are advanced by the processed blocks
+*	@param <uint8_t*>src			Ciphertext
+*	@param <uint8_t*>dst			Plaintext (may be src)
+*	@param <size_t>blockCount		Number of blocks
+*	@param <uint8_t*>x				16 byte GHASH state
+*
+*	@returns <size_t>				Number of processed blocks (multiple of 8)
+*/
+size_t AESNI_GCMDecryptBlocks(const uint8_t* encKeys, uint8_t rounds, const GHASH_KEY* key, uint8_t* counter, const uint8_t* src, uint8_t* dst, size_t blockCount, uint8_t* x);
+
+/**
+*	AES-GCM on top of an AES object (same key and engine)
+*
+*	Streaming use: Start -> UpdateAAD* -> EncryptUpdate* / DecryptUpdate* -> EncryptFinal / DecryptFinal
+*/
+class AESGCM {
+
+private:
+
+	AES aes;								//Block cipher (shares the key schedule)
+
+	GHASH_KEY ghashKey;						//Precomputed hash subkey
+
+	alignas(16) uint8_t j0[16] = { 0 };		//Pre-counter block (encrypted for the tag)
+
+	alignas(16) uint8_t counter[16] = { 0 };	//Next counter block
+
+	alignas(16) uint8_t x[16] = { 0 };		//GHASH state
+
+	uint8_t keystream[16] = { 0 };			//Keystream of the partially used block
+
+	uint8_t partial[16] = { 0 };			//AAD or ciphertext bytes of the partially hashed block
+
+	size_t partialLength = 0;				//Bytes in partial (0..15)
+
+	uint64_t aadLength = 0;					//AAD length in bytes
+
+	uint64_t dataLength = 0;				//Plaintext length in bytes
+
+	uint8_t phase = 0;						//0: not started, 1: AAD, 2: data, 3: finished
+
+public:
+
+	/**
+	*	Create AES-GCM on an initialized AES object
+	*
+	*	@param <AES&> aes				AES object (copied, the key schedule is shared)
+	*/
+	explicit AESGCM(const AES& aes);
+
+	/**
+	*	Select the GHASH implementation (PCLMULQDQ is the default where available, call before Start)
+	*
+	*	@param <bool> clmul				True: PCLMULQDQ, false: 4-bit tables
+	*
+	*	@returns <bool>					False if PCLMULQDQ is requested but not available
+	*/
+	bool SetClmul(bool clmul);
+
+	/**
+	*	Start a new message
+	*
+	*	@param <uint8_t*> iv			Initialization vector (12 bytes recommended, must never repeat for one key)
+	*	@param <size_t> ivLength		IV length in bytes
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL or empty IV
+	*/
+	int Start(const uint8_t* iv, size_t ivLength);
+
+	/**
+	*	Add additional authenticated data (only before the first EncryptUpdate / DecryptUpdate)
+	*
+	*	@param <uint8_t*> aad			Additional data
+	*	@param <size_t> length			Additional data length
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL data, 0x02 called out of order
+	*/
+	int UpdateAAD(const uint8_t* aad, size_t length);
+
+	/**
+	*	Encrypt the next part of the message
+	*
+	*	@param <uint8_t*> src			Plaintext
+	*	@param <uint8_t*> dst			Ciphertext (length bytes, may be src)
+	*	@param <size_t> length			Plaintext length
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL data, 0x02 called out of order, 0x05 message too long
+	*/
+	int EncryptUpdate(const uint8_t* src, uint8_t* dst, size_t length);
+
+	/**
+	*	Decrypt the next part of the message (the plaintext must not be used before DecryptFinal succeeds)
+	*
+	*	@param <uint8_t*> src			Ciphertext
+	*	@param <uint8_t*> dst			Plaintext (length bytes, may be src)
+	*	@param <size_t> length			Ciphertext length
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL data, 0x02 called out of order, 0x05 message too long
+	*/
+	int DecryptUpdate(const uint8_t* src, uint8_t* dst, size_t length);
+
+	/**
+	*	Finish encryption and get the authentication tag
+	*
+	*	@param <uint8_t*> tag			Tag output
+	*	@param <size_t> tagLength		Tag length in bytes (12..16, or 8 / 4 for restricted uses)
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL tag, 0x02 called out of order, 0x04 bad tag length
+	*/
+	int EncryptFinal(uint8_t* tag, size_t tagLength = 16);
+
+	/**
+	*	Finish decryption and check the authentication tag (constant-time compare)
+	*
+	*	@param <uint8_t*> tag			Expected tag
+	*	@param <size_t> tagLength		Tag length in bytes (12..16, or 8 / 4 for restricted uses)
+	*
+	*	@returns <int>					0x00 if the message is authentic, 0x03 tag mismatch, 0x01 / 0x02 / 0x04 as EncryptFinal
+	*/
+	int DecryptFinal(const uint8_t* tag, size_t tagLength = 16);
+
+	/**
+	*	Encrypt and authenticate a whole message
+	*
+	*	@param <uint8_t*> iv			Initialization vector
+	*	@param <size_t> ivLength		IV length in bytes
+	*	@param <uint8_t*> aad			Additional authenticated data (may be NULL if aadLength is 0)
+	*	@param <size_t> aadLength		Additional data length
+	*	@param <uint8_t*> src			Plaintext
+	*	@param <uint8_t*> dst			Ciphertext (length bytes, may be src)
+	*	@param <size_t> length			Plaintext length
+	*	@param <uint8_t*> tag			Tag output
+	*	@param <size_t> tagLength		Tag length in bytes (12..16, or 8 / 4 for restricted uses)
+	*
+	*	@returns <int>					0x00 on success, error code of the failing step otherwise
+	*/
+	int Encrypt(const uint8_t* iv, size_t ivLength, const uint8_t* aad, size_t aadLength, const uint8_t* src, uint8_t* dst, size_t length, uint8_t* tag, size_t tagLength = 16);
+
+	/**
+	*	Decrypt and verify a whole message (dst is zeroed if the tag does not match)
+	*
+	*	@param <uint8_t*> iv			Initialization vector
+	*	@param <size_t> ivLength		IV length in bytes
+	*	@param <uint8_t*> aad			Additional authenticated data (may be NULL if aadLength is 0)
+	*	@param <size_t> aadLength		Additional data length
+	*	@param <uint8_t*> src			Ciphertext
+	*	@param <uint8_t*> dst			Plaintext (length bytes, may be src)
+	*	@param <size_t> length			Ciphertext length
+	*	@param <uint8_t*> tag			Expected tag
+	*	@param <size_t> tagLength		Tag length in bytes (12..16, or 8 / 4 for restricted uses)
+	*
+	*	@returns <int>					0x00 if the message is authentic, 0x03 tag mismatch, other error codes as the streaming calls
+	*/
+	int Decrypt(const uint8_t* iv, size_t ivLength, const uint8_t* aad, size_t aadLength, const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* tag, size_t tagLength = 16);
+
+private:
+
+	/**
+	*	Encrypt or decrypt the next part of the message
+	*
+	*	@param <uint8_t*> src			Source data
+	*	@param <uint8_t*> dst			Destination data
+	*	@param <size_t> length			Data length
+	*	@param <bool> encrypt			True: GHASH the output, false: GHASH the input
+	*
+	*	@returns <int>					Error code as EncryptUpdate
+	*/
+	int Update(const uint8_t* src, uint8_t* dst, size_t length, bool encrypt);
+
+	/**
+	*	Hash the partial AAD / ciphertext block with zero padding
+	*/
+	void FlushPartial();
+
+	/**
+	*	Compute the full 16 byte tag
+	*
+	*	@param <uint8_t*> tag			16 byte tag output
+	*/
+	void ComputeTag(uint8_t* tag);
+
+	/**
+	*	Advance the last 32 bits of a counter block (big-endian, wraps around)
+	*
+	*	@param <uint8_t*> counter		Counter block
+	*	@param <uint32_t> value			Number of blocks to add
+	*/
+	static void CounterInc32(uint8_t* counter, uint32_t value);
+};
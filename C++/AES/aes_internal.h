@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef AES_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+*
+*	Helpers shared by the AES translation units, not part of the public interface (include after aes_config.h)
+*
+*/
+
+/**
+*	XOR 16 bytes of src into dst as one 128-bit operation (no alignment needed)
+*
+*	@param <uint8_t*> dst			Block to update
+*	@param <uint8_t*> src			Key stage, chaining value or block to XOR in
+*/
+#ifdef AES_SSE2
+static inline void AES_XorBlock(uint8_t* dst, const uint8_t* src) {
+	_mm_storeu_si128((__m128i*)dst, _mm_xor_si128(_mm_loadu_si128((const __m128i*)dst), _mm_loadu_si128((const __m128i*)src)));
+}
+#else
+static inline void AES_XorBlock(uint8_t* dst, const uint8_t* src) {
+	uint64_t d[2], s[2];
+	memcpy(d, dst, 16);
+	memcpy(s, src, 16);
+	d[0] ^= s[0];
+	d[1] ^= s[1];
+	memcpy(dst, d, 16);
+}
+#endif
@@ -0,0 +1,136 @@
+#include <random>
+
+#include "aes_key_cache.h"
+
+//splitmix64 finalizer
+static inline uint64_t KeyCache_Mix(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ULL;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBULL;
+	x ^= x >> 31;
+	return x;
+}
+
+//
+AESKeyCache::AESKeyCache(size_t capacity) {
+	this->capacity = capacity ? capacity : 1;
+
+	std::random_device random;
+	seed[0] = ((uint64_t)random() << 32) | random();
+	seed[1] = ((uint64_t)random() << 32) | random();
+
+	index.reserve(this->capacity);
+}
+
+//
+std::shared_ptr<const AESKeySchedule> AESKeyCache::Get(const uint8_t* key, size_t keyLength) {
+	if (key == NULL || (keyLength != 16 && keyLength != 24 && keyLength != 32))		return NULL;
+
+	uint64_t fingerprint = Fingerprint(key, keyLength);
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		auto it = index.find(fingerprint);
+		if (it != index.end() && it->second->schedule->MatchesKey(key, keyLength)) {
+			entries.splice(entries.begin(), entries, it->second);
+			hits++;
+			return it->second->schedule;
+		}
+	}
+
+	//Expand without holding the lock, other keys can be looked up meanwhile
+	misses++;
+	std::shared_ptr<const AESKeySchedule> schedule = AESKeySchedule::Create(key, keyLength);
+	std::shared_ptr<const AESKeySchedule> evicted;		//Released (and zeroized if unused) after the lock
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto it = index.find(fingerprint);
+	if (it != index.end()) {
+		//Another thread inserted the same key first
+		if (it->second->schedule->MatchesKey(key, keyLength)) {
+			entries.splice(entries.begin(), entries, it->second);
+			return it->second->schedule;
+		}
+
+		//Fingerprint collision, the newer key replaces the old one
+		evicted = it->second->schedule;
+		entries.erase(it->second);
+		index.erase(it);
+	}
+
+	entries.push_front(Entry{ fingerprint, schedule });
+	index[fingerprint] = entries.begin();
+
+	if (entries.size() > capacity) {
+		evicted = entries.back().schedule;
+		index.erase(entries.back().fingerprint);
+		entries.pop_back();
+	}
+
+	return schedule;
+}
+
+//
+std::shared_ptr<const AESKeySchedule> AESKeyCache::Get(const char* key) {
+	if (key == NULL)	return NULL;
+
+	uint8_t keyArr[16] = { 0 };
+
+	for (uint8_t i = 0; i < 16 && key[i] != '\0'; i++)
+		keyArr[i] = (uint8_t)key[i];
+
+	std::shared_ptr<const AESKeySchedule> schedule = Get(keyArr, 16);
+	AES_SecureZero(keyArr, sizeof(keyArr));
+
+	return schedule;
+}
+
+//
+void AESKeyCache::Clear() {
+	std::lock_guard<std::mutex> guard(lock);
+	index.clear();
+	entries.clear();
+}
+
+//
+size_t AESKeyCache::GetSize() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return entries.size();
+}
+
+//
+size_t AESKeyCache::GetCapacity() const {
+	return capacity;
+}
+
+//
+uint64_t AESKeyCache::GetHits() const {
+	return hits;
+}
+
+//
+uint64_t AESKeyCache::GetMisses() const {
+	return misses;
+}
+
+//
+void AESKeyCache::ResetCounters() {
+	hits = 0;
+	misses = 0;
+}
+
+//
+uint64_t AESKeyCache::Fingerprint(const uint8_t* key, size_t keyLength) const {
+	uint64_t h = seed[0] ^ keyLength;
+
+	for (size_t i = 0; i < keyLength; i += 8) {
+		uint64_t word;
+		memcpy(&word, key + i, 8);
+		h = KeyCache_Mix(h ^ word ^ seed[1]);
+	}
+
+	return h;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "aes.h"
+
+/*
+*
+*	Cache of expanded key schedules for services that switch keys on every request
+*
+*	Entries are found by a keyed 64 bit fingerprint of the key, the key itself is not stored
+*	separately (it is the first key stages of the schedule and is compared on every hit).
+*	The least recently used entry is dropped when the cache is full. Schedules are zeroized
+*	by their destructor, so an evicted key is wiped as soon as no AES object uses it anymore.
+*
+*/
+
+#define AES_KEY_CACHE_SIZE		64						//Default number of cached key schedules
+
+class AESKeyCache {
+
+private:
+
+	/**
+	*	One cached key schedule
+	*/
+	struct Entry {
+		uint64_t fingerprint;								//Keyed hash of the key
+		std::shared_ptr<const AESKeySchedule> schedule;		//Expanded key
+	};
+
+	std::list<Entry> entries;								//Most recently used first
+
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> index;		//Fingerprint -> entry
+
+	mutable std::mutex lock;								//Guards entries and index
+
+	size_t capacity;										//Max number of entries
+
+	uint64_t seed[2];										//Random fingerprint key (fingerprints differ between caches and runs)
+
+	std::atomic<uint64_t> hits{ 0 };						//Lookups served from the cache
+
+	std::atomic<uint64_t> misses{ 0 };						//Lookups that expanded the key
+
+public:
+
+	/**
+	*	Create an empty cache
+	*
+	*	@param <size_t> capacity		Max number of cached keys (at least 1)
+	*/
+	explicit AESKeyCache(size_t capacity = AES_KEY_CACHE_SIZE);
+
+	AESKeyCache(const AESKeyCache&) = delete;
+	AESKeyCache& operator=(const AESKeyCache&) = delete;
+
+	/**
+	*	Get the expanded schedule of a binary key, expand and insert it on a miss
+	*
+	*	@param <uint8_t*> key			Binary key
+	*	@param <size_t> keyLength		Key length in bytes: 16, 24 or 32
+	*
+	*	@returns <std::shared_ptr>		Key schedule, NULL if the key is missing or has an unsupported length
+	*/
+	std::shared_ptr<const AESKeySchedule> Get(const uint8_t* key, size_t keyLength);
+
+	/**
+	*	Get the expanded schedule of a text key (AES-128, up to 16 characters, zero padded as AES::Init)
+	*
+	*	@param <char*> key				Key used for encryption and decryption
+	*
+	*	@returns <std::shared_ptr>		Key schedule, NULL if the key is NULL
+	*/
+	std::shared_ptr<const AESKeySchedule> Get(const char* key);
+
+	/**
+	*	Drop every entry (schedules still used by AES objects stay valid)
+	*/
+	void Clear();
+
+	/**
+	*	Get the number of cached keys
+	*
+	*	@returns <size_t>				Number of entries
+	*/
+	size_t GetSize() const;
+
+	/**
+	*	Get the max number of cached keys
+	*
+	*	@returns <size_t>				Capacity
+	*/
+	size_t GetCapacity() const;
+
+	/**
+	*	Get the number of lookups served from the cache
+	*
+	*	@returns <uint64_t>				Hit counter
+	*/
+	uint64_t GetHits() const;
+
+	/**
+	*	Get the number of lookups that had to expand the key
+	*
+	*	@returns <uint64_t>				Miss counter
+	*/
+	uint64_t GetMisses() const;
+
+	/**
+	*	Reset the hit and miss counters
+	*/
+	void ResetCounters();
+
+private:
+
+	/**
+	*	Keyed fingerprint of a key
+	*
+	*	@param <uint8_t*> key			Binary key
+	*	@param <size_t> keyLength		Key length in bytes
+	*
+	*	@returns <uint64_t>				Fingerprint
+	*/
+	uint64_t Fingerprint(const uint8_t* key, size_t keyLength) const;
+
+};
@@ -0,0 +1,254 @@
+#include "aes_config.h"
+#include "aes.h"
+#include "aes_internal.h"
+
+//
+void AES::EncryptStreamOriginCBC(uint8_t* stream, size_t length, uint8_t* iv) const {
+	if (stream == NULL || iv == NULL)		return;
+
+	size_t blcks = length / 16;
+	if (blcks == 0)		return;
+
+	//Every block depends on the previous ciphertext, nothing to interleave within one stream
+	const uint8_t* chain = iv;
+	for (size_t b = 0; b < blcks; b++) {
+		AES_XorBlock(stream + b * 16, chain);
+		EncryptBlock(stream + b * 16);
+		chain = stream + b * 16;
+	}
+
+	memcpy(iv, chain, 16);
+}
+
+//
+void AES::EncryptStreamsCBC(uint8_t** streams, const size_t* lengths, uint8_t** ivs, size_t count) const {
+	if (streams == NULL || lengths == NULL || ivs == NULL)		return;
+
+	alignas(64) uint8_t lanes[AES_CBC_LANES * 16];
+	size_t laneStream[AES_CBC_LANES];
+	size_t lanePos[AES_CBC_LANES];
+	size_t active = 0;
+	size_t next = 0;
+
+	while (true) {
+
+		//Refill free lanes with the next streams that have at least one block
+		while (active < AES_CBC_LANES && next < count) {
+			if (streams[next] != NULL && ivs[next] != NULL && lengths[next] >= 16) {
+				laneStream[active] = next;
+				lanePos[active] = 0;
+				active++;
+			}
+			next++;
+		}
+
+		if (active == 0)	break;
+
+		//One block of every stream goes through the multi-block engine together
+		for (size_t l = 0; l < active; l++) {
+			uint8_t* block = streams[laneStream[l]] + lanePos[l];
+			memcpy(lanes + l * 16, block, 16);
+			AES_XorBlock(lanes + l * 16, lanePos[l] == 0 ? ivs[laneStream[l]] : block - 16);
+		}
+
+		EncryptBlocks(lanes, active);
+
+		for (size_t l = 0; l < active; ) {
+			size_t s = laneStream[l];
+			memcpy(streams[s] + lanePos[l], lanes + l * 16, 16);
+			lanePos[l] += 16;
+
+			if (lanePos[l] + 16 > lengths[s]) {
+
+				//Stream finished, the last lane takes its place
+				memcpy(ivs[s], streams[s] + lanePos[l] - 16, 16);
+				active--;
+				laneStream[l] = laneStream[active];
+				lanePos[l] = lanePos[active];
+				memcpy(lanes + l * 16, lanes + active * 16, 16);
+				continue;
+			}
+			l++;
+		}
+	}
+}
+
+//
+uint8_t* AES::EncryptCBC(uint8_t* src, size_t length, size_t* streamLength, const uint8_t* iv, bool attachPadding) const {
+	if (src == NULL || iv == NULL || length < 1)	return NULL;		//Define error	->	NULL src, iv or length
+
+	*streamLength = PaddedLength(length, attachPadding);
+
+	uint8_t* dstStream = (uint8_t*)malloc((*streamLength) * sizeof(uint8_t));
+	if (dstStream == NULL)	return dstStream;						//Define error	->	Mem. allocation falied
+
+	memcpy(dstStream, src, length);
+
+	if (attachPadding)
+		AttachPadding(dstStream, length);
+
+	uint8_t chain[16];
+	memcpy(chain, iv, 16);
+	EncryptStreamOriginCBC(dstStream, *streamLength, chain);
+
+	return dstStream;
+}
+
+//
+bool AES::DecryptStreamOriginCBC(uint8_t* stream, size_t length, uint8_t* iv) const {
+	if (stream == NULL || iv == NULL)		return false;		//Define error	->	NULL stream or iv
+
+	size_t blcks = length / 16;
+	if (blcks == 0)		return true;
+
+	//The chaining value for the next call is the last ciphertext block
+	uint8_t nextIv[16];
+	memcpy(nextIv, stream + (blcks - 1) * 16, 16);
+
+	if (UseChunks(length)) {
+		const size_t chunkBlcks = AES_PARALLEL_CHUNK_SIZE / 16;
+		const long long chunks = (long long)((blcks + chunkBlcks - 1) / chunkBlcks);
+
+		//Keep the ciphertext block before every chunk, the neighbouring thread decrypts it in place
+		uint8_t* prevs = (uint8_t*)malloc((size_t)chunks * 16);
+		if (prevs != NULL) {
+			memcpy(prevs, iv, 16);
+			for (long long c = 1; c < chunks; c++)
+				memcpy(prevs + c * 16, stream + ((size_t)c * chunkBlcks - 1) * 16, 16);
+
+			bool done = CryptChunks(blcks * 16, [&](size_t first, size_t bytes) {
+				DecryptBlocksCBC(stream + first, bytes / 16, prevs + (first / AES_PARALLEL_CHUNK_SIZE) * 16);
+			});
+
+			//A cancelled stream has gaps, the chain can't continue from it
+			free(prevs);
+			if (done)	memcpy(iv, nextIv, 16);
+			return done;
+		}
+	}
+
+	DecryptBlocksCBC(stream, blcks, iv);
+	memcpy(iv, nextIv, 16);
+	return true;
+}
+
+//
+uint8_t* AES::DecryptCBC(uint8_t* src, size_t length, size_t* streamLength, const uint8_t* iv, bool removePadding) const {
+	if (src == NULL || iv == NULL || length < 1) return NULL;		//Define error	->	NULL src, iv or length
+
+	if ((length & 0x0F) != 0)	return NULL;					//Define error	->	Bad stream size
+
+	uint8_t* dstStream = (uint8_t*)malloc(length);
+	if (dstStream == NULL)	return dstStream;		//Define error	->	Mem. allocation falied
+
+	memcpy(dstStream, src, length);
+
+	uint8_t chain[16];
+	memcpy(chain, iv, 16);
+	if (!DecryptStreamOriginCBC(dstStream, length, chain)) { free(dstStream); return NULL; }		//Define error	->	Cancelled
+
+	*streamLength = length;
+
+	//A malformed padding is rejected, a trusted length from it would reach past the buffer
+	if (removePadding && !CheckPadding(dstStream, length, streamLength)) {
+		AES_SecureZero(dstStream, length);
+		free(dstStream);
+		return NULL;											//Define error	->	Bad padding
+	}
+
+	return dstStream;
+}
+
+//
+void AES::DecryptBlocksCBC(uint8_t* blocks, size_t blockCount, const uint8_t* prev) const {
+	alignas(64) uint8_t cipher[AES_CBC_BATCH_BLOCKS * 16];
+	uint8_t chain[16];
+	memcpy(chain, prev, 16);
+
+	for (size_t b = 0; b < blockCount; b += AES_CBC_BATCH_BLOCKS) {
+		size_t n = (blockCount - b < AES_CBC_BATCH_BLOCKS ? blockCount - b : AES_CBC_BATCH_BLOCKS);
+		uint8_t* p = blocks + b * 16;
+
+		//Keep the ciphertext, the blocks are decrypted in place
+		memcpy(cipher, p, n * 16);
+		DecryptBlocks(p, n);
+
+		AES_XorBlock(p, chain);
+		for (size_t i = 1; i < n; i++)
+			AES_XorBlock(p + i * 16, cipher + (i - 1) * 16);
+
+		memcpy(chain, cipher + (n - 1) * 16, 16);
+	}
+}
+
+//
+bool AES::EncryptCTR(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* counter, uint64_t offset) const {
+	if (src == NULL || dst == NULL || counter == NULL)		return false;		//Define error	->	NULL src, dst or counter
+	if (length < 1)											return true;
+
+	//Every chunk seeks to its own keystream position, CTR has no dependency between blocks
+	if (UseChunks(length))
+		return CryptChunks(length, [&](size_t first, size_t bytes) { CryptCTRRange(src + first, dst + first, bytes, counter, offset + first); });
+
+	CryptCTRRange(src, dst, length, counter, offset);
+	return true;
+}
+
+//
+bool AES::DecryptCTR(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* counter, uint64_t offset) const {
+	return EncryptCTR(src, dst, length, counter, offset);
+}
+
+//
+void AES::CryptCTRRange(const uint8_t* src, uint8_t* dst, size_t length, const uint8_t* counter, uint64_t offset) const {
+	alignas(64) uint8_t keystream[AES_CTR_BATCH_BLOCKS * 16];
+	uint8_t ctr[16];
+
+	memcpy(ctr, counter, 16);
+	CounterAdd(ctr, offset / 16);
+
+	size_t skip = (size_t)(offset & 0x0F);		//Keystream bytes to drop from the first block
+	size_t pos = 0;
+
+	while (pos < length) {
+
+		//Encrypt a batch of counter blocks with the wide multi-block engines
+		size_t batchBlcks = (skip + length - pos + 15) / 16;
+		if (batchBlcks > AES_CTR_BATCH_BLOCKS)
+			batchBlcks = AES_CTR_BATCH_BLOCKS;
+
+		for (size_t b = 0; b < batchBlcks; b++) {
+			memcpy(keystream + b * 16, ctr, 16);
+			CounterAdd(ctr, 1);
+		}
+		EncryptBlocks(keystream, batchBlcks);
+
+		size_t n = batchBlcks * 16 - skip;
+		if (n > length - pos)
+			n = length - pos;
+
+		const uint8_t* ks = keystream + skip;
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			uint64_t a, k;
+			memcpy(&a, src + pos + i, 8);
+			memcpy(&k, ks + i, 8);
+			a ^= k;
+			memcpy(dst + pos + i, &a, 8);
+		}
+		for (; i < n; i++)
+			dst[pos + i] = src[pos + i] ^ ks[i];
+
+		pos += n;
+		skip = 0;
+	}
+}
+
+//
+void AES::CounterAdd(uint8_t* counter, uint64_t value) {
+	for (int8_t i = 15; i >= 0 && value != 0; i--) {
+		uint64_t sum = (uint64_t)counter[i] + (value & 0xFF);
+		counter[i] = (uint8_t)sum;
+		value = (value >> 8) + (sum >> 8);
+	}
+}
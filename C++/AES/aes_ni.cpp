@@ -0,0 +1,235 @@
+#include "aes_config.h"
+#include "aes_ni.h"
+
+#ifdef AES_X86
+
+#include <wmmintrin.h>
+#include <emmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+//
+static uint32_t AES_DetectCPUFeatures() {
+	unsigned int regs[4] = { 0 };
+	uint32_t features = 0;
+
+#ifdef _MSC_VER
+	__cpuid((int*)regs, 0);
+	unsigned int maxLeaf = regs[0];
+	__cpuid((int*)regs, 1);
+#else
+	unsigned int maxLeaf = __get_cpuid_max(0, NULL);
+	if (maxLeaf < 1)	return 0;
+	__cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+	if (regs[3] & (1 << 26))	features |= AES_CPU_SSE2;
+	if (regs[2] & (1 << 9))		features |= AES_CPU_SSSE3;
+	if (regs[2] & (1 << 19))	features |= AES_CPU_SSE41;
+	if (regs[2] & (1 << 25))	features |= AES_CPU_AESNI;
+	if (regs[2] & (1 << 1))		features |= AES_CPU_PCLMUL;
+
+	//AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0 bits 1 and 2)
+	bool osYmm = false;
+	if (regs[2] & (1 << 27)) {
+#ifdef _MSC_VER
+		osYmm = (_xgetbv(0) & 0x06) == 0x06;
+#else
+		unsigned int xcr0Low, xcr0High;
+		__asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+		osYmm = (xcr0Low & 0x06) == 0x06;
+#endif
+	}
+
+	if (osYmm && maxLeaf >= 7) {
+#ifdef _MSC_VER
+		__cpuidex((int*)regs, 7, 0);
+#else
+		__cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+		if (regs[1] & (1 << 5))		features |= AES_CPU_AVX2;
+	}
+
+	return features;
+}
+
+//
+uint32_t AES_CPUFeatures() {
+	static const uint32_t features = AES_DetectCPUFeatures();
+	return features;
+}
+
+//
+bool AESNI_Supported() {
+	return (AES_CPUFeatures() & (AES_CPU_AESNI | AES_CPU_SSE41)) == (AES_CPU_AESNI | AES_CPU_SSE41);
+}
+
+//One key stage: rotate, substitute and rcon come from AESKEYGENASSIST, the rest is the word xor chain
+AES_TARGET("aes,sse2")
+static inline __m128i AESNI_ExpandStep(__m128i key, __m128i assist) {
+	assist = _mm_shuffle_epi32(assist, 0xFF);
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, assist);
+}
+
+//AESKEYGENASSIST needs the rcon value as an immediate
+#define AESNI_EXPAND(k, i, rcon)	k[i] = AESNI_ExpandStep(k[i - 1], _mm_aeskeygenassist_si128(k[i - 1], rcon))
+
+//
+AES_TARGET("aes,sse2")
+void AESNI_ExpandKey(const uint8_t* key, uint8_t* encKeys, uint8_t* decKeys) {
+	__m128i k[11];
+
+	k[0] = _mm_loadu_si128((const __m128i*)key);
+	AESNI_EXPAND(k, 1, 0x01);
+	AESNI_EXPAND(k, 2, 0x02);
+	AESNI_EXPAND(k, 3, 0x04);
+	AESNI_EXPAND(k, 4, 0x08);
+	AESNI_EXPAND(k, 5, 0x10);
+	AESNI_EXPAND(k, 6, 0x20);
+	AESNI_EXPAND(k, 7, 0x40);
+	AESNI_EXPAND(k, 8, 0x80);
+	AESNI_EXPAND(k, 9, 0x1B);
+	AESNI_EXPAND(k, 10, 0x36);
+
+	__m128i* enc = (__m128i*)encKeys;
+	__m128i* dec = (__m128i*)decKeys;
+
+	for (uint8_t i = 0; i < 11; i++)
+		_mm_store_si128(enc + i, k[i]);
+
+	//Equivalent inverse cipher: reverse order, InvMixColumns on the middle stages
+	_mm_store_si128(dec, k[10]);
+	for (uint8_t i = 1; i < 10; i++)
+		_mm_store_si128(dec + i, _mm_aesimc_si128(k[10 - i]));
+	_mm_store_si128(dec + 10, k[0]);
+}
+
+//Eight independent blocks per round hide the AESENC / AESDEC latency
+#define AESNI_INTERLEAVE	8
+
+//Apply one round instruction with key k to all eight states
+#define AESNI_ROUND8(op, s, k) \
+	s[0] = op(s[0], k); s[1] = op(s[1], k); s[2] = op(s[2], k); s[3] = op(s[3], k); \
+	s[4] = op(s[4], k); s[5] = op(s[5], k); s[6] = op(s[6], k); s[7] = op(s[7], k);
+
+//Rounds is a template parameter so the key stages stay in registers and the round loops unroll
+template<uint8_t Rounds>
+AES_TARGET("aes,sse2")
+static void AESNI_EncryptBlocksRounds(const uint8_t* encKeys, const uint8_t* src, uint8_t* dst, size_t blockCount) {
+	const __m128i* rk = (const __m128i*)encKeys;
+	__m128i k[Rounds + 1];
+	for (uint8_t i = 0; i <= Rounds; i++)
+		k[i] = _mm_load_si128(rk + i);
+
+	size_t b = 0;
+	for (; b + AESNI_INTERLEAVE <= blockCount; b += AESNI_INTERLEAVE) {
+		const __m128i* in = (const __m128i*)(src + b * 16);
+		__m128i* out = (__m128i*)(dst + b * 16);
+		__m128i s[AESNI_INTERLEAVE];
+		for (uint8_t j = 0; j < AESNI_INTERLEAVE; j++)
+			s[j] = _mm_xor_si128(_mm_loadu_si128(in + j), k[0]);
+		AES_UNROLL
+		for (uint8_t i = 1; i < Rounds; i++) {
+			AESNI_ROUND8(_mm_aesenc_si128, s, k[i]);
+		}
+		AESNI_ROUND8(_mm_aesenclast_si128, s, k[Rounds]);
+		for (uint8_t j = 0; j < AESNI_INTERLEAVE; j++)
+			_mm_storeu_si128(out + j, s[j]);
+	}
+
+	//Tail, one block at a time
+	for (; b < blockCount; b++) {
+		__m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + b * 16)), k[0]);
+		AES_UNROLL
+		for (uint8_t i = 1; i < Rounds; i++)
+			s = _mm_aesenc_si128(s, k[i]);
+		s = _mm_aesenclast_si128(s, k[Rounds]);
+		_mm_storeu_si128((__m128i*)(dst + b * 16), s);
+	}
+}
+
+//
+template<uint8_t Rounds>
+AES_TARGET("aes,sse2")
+static void AESNI_DecryptBlocksRounds(const uint8_t* decKeys, const uint8_t* src, uint8_t* dst, size_t blockCount) {
+	const __m128i* rk = (const __m128i*)decKeys;
+	__m128i k[Rounds + 1];
+	for (uint8_t i = 0; i <= Rounds; i++)
+		k[i] = _mm_load_si128(rk + i);
+
+	size_t b = 0;
+	for (; b + AESNI_INTERLEAVE <= blockCount; b += AESNI_INTERLEAVE) {
+		const __m128i* in = (const __m128i*)(src + b * 16);
+		__m128i* out = (__m128i*)(dst + b * 16);
+		__m128i s[AESNI_INTERLEAVE];
+		for (uint8_t j = 0; j < AESNI_INTERLEAVE; j++)
+			s[j] = _mm_xor_si128(_mm_loadu_si128(in + j), k[0]);
+		AES_UNROLL
+		for (uint8_t i = 1; i < Rounds; i++) {
+			AESNI_ROUND8(_mm_aesdec_si128, s, k[i]);
+		}
+		AESNI_ROUND8(_mm_aesdeclast_si128, s, k[Rounds]);
+		for (uint8_t j = 0; j < AESNI_INTERLEAVE; j++)
+			_mm_storeu_si128(out + j, s[j]);
+	}
+
+	//Tail, one block at a time
+	for (; b < blockCount; b++) {
+		__m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + b * 16)), k[0]);
+		AES_UNROLL
+		for (uint8_t i = 1; i < Rounds; i++)
+			s = _mm_aesdec_si128(s, k[i]);
+		s = _mm_aesdeclast_si128(s, k[Rounds]);
+		_mm_storeu_si128((__m128i*)(dst + b * 16), s);
+	}
+}
+
+//
+void AESNI_EncryptBlocks(const uint8_t* encKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount) {
+	switch (rounds) {
+	case 12:	AESNI_EncryptBlocksRounds<12>(encKeys, src, dst, blockCount);	break;
+	case 14:	AESNI_EncryptBlocksRounds<14>(encKeys, src, dst, blockCount);	break;
+	default:	AESNI_EncryptBlocksRounds<10>(encKeys, src, dst, blockCount);	break;
+	}
+}
+
+//
+void AESNI_DecryptBlocks(const uint8_t* decKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount) {
+	switch (rounds) {
+	case 12:	AESNI_DecryptBlocksRounds<12>(decKeys, src, dst, blockCount);	break;
+	case 14:	AESNI_DecryptBlocksRounds<14>(decKeys, src, dst, blockCount);	break;
+	default:	AESNI_DecryptBlocksRounds<10>(decKeys, src, dst, blockCount);	break;
+	}
+}
+
+#else
+
+//No hardware backend on this target, callers fall back to the software engines
+
+//
+uint32_t AES_CPUFeatures() {
+	return 0;
+}
+
+//
+bool AESNI_Supported() {
+	return false;
+}
+
+//
+void AESNI_ExpandKey(const uint8_t* key, uint8_t* encKeys, uint8_t* decKeys) {}
+
+//
+void AESNI_EncryptBlocks(const uint8_t* encKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount) {}
+
+//
+void AESNI_DecryptBlocks(const uint8_t* decKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount) {}
+
+#endif
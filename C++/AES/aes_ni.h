@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+*
+*	AES-NI hardware backend (AESENC / AESDEC / AESKEYGENASSIST)
+*
+*	Round keys are stored in state byte order, 16 byte aligned.
+*	Decryption keys are in reverse order with AESIMC applied (equivalent inverse cipher).
+*
+*/
+
+//CPU feature flags returned by AES_CPUFeatures
+#define AES_CPU_SSE2		0x01
+#define AES_CPU_SSSE3		0x02
+#define AES_CPU_SSE41		0x04
+#define AES_CPU_AESNI		0x08
+#define AES_CPU_PCLMUL		0x10
+#define AES_CPU_AVX2		0x20
+
+/**
+*	Query the CPU features used by the hardware and SIMD backends (CPUID is only queried once)
+*
+*	@returns <uint32_t>				AES_CPU_* flags, 0 on non-x86 targets
+*/
+uint32_t AES_CPUFeatures();
+
+/**
+*	Check if the CPU supports AES-NI
+*
+*	@returns <bool>					True if AES-NI can be used
+*/
+bool AESNI_Supported();
+
+/**
+*	Expand a 128 bit key with AESKEYGENASSIST
+*
+*	@param <uint8_t*>key			16 byte long key
+*	@param <uint8_t*>encKeys		11 * 16 byte encryption key stages (16 byte aligned)
+*	@param <uint8_t*>decKeys		11 * 16 byte decryption key stages (16 byte aligned)
+*/
+void AESNI_ExpandKey(const uint8_t* key, uint8_t* encKeys, uint8_t* decKeys);
+
+/**
+*	Encrypt consecutive 16 byte long blocks
+*
+*	@param <uint8_t*>encKeys		Encryption key stages
+*	@param <uint8_t>rounds			Number of rounds (10, 12 or 14)
+*	@param <uint8_t*>src			Blocks to encrypt
+*	@param <uint8_t*>dst			Encrypted blocks (may be src)
+*	@param <size_t>blockCount		Number of blocks
+*/
+void AESNI_EncryptBlocks(const uint8_t* encKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount);
+
+/**
+*	Decrypt consecutive 16 byte long blocks
+*
+*	@param <uint8_t*>decKeys		Decryption key stages
+*	@param <uint8_t>rounds			Number of rounds (10, 12 or 14)
+*	@param <uint8_t*>src			Blocks to decrypt
+*	@param <uint8_t*>dst			Decrypted blocks (may be src)
+*	@param <size_t>blockCount		Number of blocks
+*/
+void AESNI_DecryptBlocks(const uint8_t* decKeys, uint8_t rounds, const uint8_t* src, uint8_t* dst, size_t blockCount);
@@ -0,0 +1,59 @@
+#include <chrono>
+
+#include "aes_progress.h"
+
+//
+static uint64_t Progress_Clock() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+AESProgressTracker::AESProgressTracker(AESObserver* observer, uint64_t bytesTotal) : observer(observer) {
+	progress.bytesTotal = bytesTotal;
+	start = observer ? Progress_Clock() : 0;
+	windowStart = start;
+}
+
+//
+void AESProgressTracker::SetChunks(uint64_t chunksTotal) {
+	std::lock_guard<std::mutex> guard(lock);
+	progress.chunksTotal = chunksTotal;
+}
+
+//
+bool AESProgressTracker::Chunk(uint64_t bytes) {
+	if (observer == NULL)	return !Cancelled();
+
+	std::lock_guard<std::mutex> guard(lock);
+	if (Cancelled())		return false;
+
+	uint64_t now = Progress_Clock();
+
+	progress.bytesDone += bytes;
+	progress.chunksDone++;
+	progress.seconds = (double)(now - start) * 1e-9;
+	progress.ioSeconds = (double)ioNanoseconds.load() * 1e-9;
+	progress.cipherSeconds = (double)cipherNanoseconds.load() * 1e-9;
+	progress.averageMBps = progress.seconds > 0 ? (double)progress.bytesDone / progress.seconds * 1e-6 : 0;
+
+	//The current rate only moves once a window is full, before that it is the average
+	windowBytes += bytes;
+	double window = (double)(now - windowStart) * 1e-9;
+	if (window >= AES_PROGRESS_WINDOW) {
+		progress.currentMBps = (double)windowBytes / window * 1e-6;
+		windowStart = now;
+		windowBytes = 0;
+	}
+	else if (progress.currentMBps == 0)
+		progress.currentMBps = progress.averageMBps;
+
+	if (!observer->OnProgress(progress))
+		cancelled = true;
+
+	return !Cancelled();
+}
+
+//
+uint64_t AESProgressTracker::Now() const {
+	return observer ? Progress_Clock() : 0;
+}
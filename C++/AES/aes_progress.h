@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+#include <mutex>
+
+/*
+*
+*	Progress, throughput and cancellation of long operations
+*
+*	An AESObserver set with AES::SetObserver is called once per finished chunk (AES_FILE_BUFFER_SIZE or
+*	AES_FILE_URING_CHUNK bytes of a file, AES_PARALLEL_CHUNK_SIZE bytes of an ECB, CTR or CBC decryption stream), never
+*	per block. Returning false cancels the operation: the file functions stop after the chunks in flight and
+*	return their cancelled code (0x0B), a stream skips its remaining chunks and reports it (EncryptInto /
+*	DecryptInto and the streaming Update return 0x0B, Encrypt / Decrypt / DecryptCBC free their buffer and return
+*	NULL, EncryptStream / DecryptStream / EncryptCTR / DecryptCTR / DecryptStreamOriginCBC return false).
+*
+*	Calls come from the worker threads of the operation but never at the same time.
+*
+*/
+
+#define AES_PROGRESS_WINDOW		0.5						//Seconds of data behind the current throughput
+
+/**
+*	Snapshot passed to the observer
+*/
+struct AES_PROGRESS {
+	uint64_t bytesDone;				//Input bytes finished (written for the file functions)
+	uint64_t bytesTotal;			//Input length
+	uint64_t chunksDone;			//Chunks finished
+	uint64_t chunksTotal;			//Chunks of the operation
+	double seconds;					//Time since the start
+	double ioSeconds;				//Time spent reading and writing, summed over threads (page faults of AES_FILE_MMAP count as cipher time)
+	double cipherSeconds;			//Time spent in the cipher, summed over threads
+	double currentMBps;				//Throughput of the last AES_PROGRESS_WINDOW seconds (10^6 bytes / s)
+	double averageMBps;				//Throughput since the start
+};
+
+/**
+*	Receiver of the progress reports
+*/
+class AESObserver {
+
+public:
+
+	virtual ~AESObserver() = default;
+
+	/**
+	*	A chunk was finished
+	*
+	*	@param <AES_PROGRESS&> progress	Progress so far
+	*
+	*	@returns <bool>					True to continue, false to cancel the operation
+	*/
+	virtual bool OnProgress(const AES_PROGRESS& progress) = 0;
+};
+
+/**
+*	Progress bookkeeping of one operation (used by the AES class, safe to call from any thread)
+*/
+class AESProgressTracker {
+
+private:
+
+	AESObserver* observer;					//NULL: nothing is measured or reported
+
+	std::mutex lock;						//Serializes the observer calls and guards progress
+
+	AES_PROGRESS progress = {};				//Last snapshot
+
+	uint64_t start;							//Start time in ns
+
+	uint64_t windowStart;					//Start of the current throughput window in ns
+
+	uint64_t windowBytes = 0;				//Bytes finished in the current window
+
+	std::atomic<uint64_t> ioNanoseconds{ 0 };
+
+	std::atomic<uint64_t> cipherNanoseconds{ 0 };
+
+	std::atomic<bool> cancelled{ false };
+
+public:
+
+	/**
+	*	Start tracking an operation
+	*
+	*	@param <AESObserver*> observer	Receiver of the reports (NULL: tracking is off)
+	*	@param <uint64_t> bytesTotal	Input length
+	*/
+	AESProgressTracker(AESObserver* observer, uint64_t bytesTotal);
+
+	AESProgressTracker(const AESProgressTracker&) = delete;
+	AESProgressTracker& operator=(const AESProgressTracker&) = delete;
+
+	/**
+	*	Check if an observer is attached
+	*
+	*	@returns <bool>					True if the timings are used
+	*/
+	bool Enabled() const { return observer != NULL; }
+
+	/**
+	*	Set the number of chunks the operation is split into
+	*
+	*	@param <uint64_t> chunksTotal	Number of chunks
+	*/
+	void SetChunks(uint64_t chunksTotal);
+
+	/**
+	*	Add time spent reading or writing
+	*
+	*	@param <uint64_t> nanoseconds	Duration
+	*/
+	void AddIO(uint64_t nanoseconds) { if (observer)	ioNanoseconds += nanoseconds; }
+
+	/**
+	*	Add time spent in the cipher
+	*
+	*	@param <uint64_t> nanoseconds	Duration
+	*/
+	void AddCipher(uint64_t nanoseconds) { if (observer)	cipherNanoseconds += nanoseconds; }
+
+	/**
+	*	Report a finished chunk to the observer
+	*
+	*	@param <uint64_t> bytes			Input bytes of the chunk
+	*
+	*	@returns <bool>					False if the operation was cancelled
+	*/
+	bool Chunk(uint64_t bytes);
+
+	/**
+	*	Check for a cancel request
+	*
+	*	@returns <bool>					True once the observer returned false
+	*/
+	bool Cancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+	/**
+	*	Monotonic clock for the timings (0 when tracking is off)
+	*
+	*	@returns <uint64_t>				Time in ns
+	*/
+	uint64_t Now() const;
+};
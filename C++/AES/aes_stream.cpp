@@ -0,0 +1,232 @@
+#include "aes_stream.h"
+
+//
+AESEncryptor::AESEncryptor(const AES& aes, const uint8_t* iv, bool attachPadding) : aes(aes), attachPadding(attachPadding) {
+	Reset(iv);
+}
+
+//
+AESEncryptor::~AESEncryptor() {
+	AES_SecureZero(buffer, sizeof(buffer));
+	AES_SecureZero(iv, sizeof(iv));
+}
+
+//
+void AESEncryptor::Reset(const uint8_t* iv) {
+	AES_SecureZero(buffer, sizeof(buffer));
+	bufferLength = 0;
+	finished = false;
+
+	cbc = iv != NULL;
+	if (cbc)
+		memcpy(this->iv, iv, 16);
+}
+
+//
+size_t AESEncryptor::GetUpdateSize(size_t length) const {
+	return (bufferLength + length) & ~(size_t)0x0F;
+}
+
+//
+int AESEncryptor::Update(const uint8_t* src, size_t length, uint8_t* dst, size_t* dstLength) {
+	if (dstLength == NULL || (length > 0 && (src == NULL || dst == NULL)))	return 0x01;		//Define error	->	NULL pointer
+	if (finished)															return 0x02;		//Define error	->	Called after Final
+
+	size_t emit = GetUpdateSize(length);
+	*dstLength = emit;
+
+	//Not a whole block yet, keep collecting
+	if (emit == 0) {
+		memcpy(buffer + bufferLength, src, length);
+		bufferLength += length;
+		return 0x00;
+	}
+
+	//Complete the buffered block first
+	if (bufferLength > 0) {
+		size_t fill = 16 - bufferLength;
+		memcpy(buffer + bufferLength, src, fill);
+		Process(buffer, dst, 16);
+		src += fill;
+		length -= fill;
+		dst += 16;
+		emit -= 16;
+	}
+
+	//The rest of the whole blocks go straight from src to dst
+	if (!Process(src, dst, emit)) {
+
+		//Cancelled by the observer: the output has gaps, the message can only be dropped
+		AES_SecureZero(buffer, sizeof(buffer));
+		bufferLength = 0;
+		finished = true;
+		*dstLength = 0;
+		return 0x0B;
+	}
+
+	bufferLength = length - emit;
+	memcpy(buffer, src + emit, bufferLength);
+
+	return 0x00;
+}
+
+//
+int AESEncryptor::Final(uint8_t* dst, size_t* dstLength) {
+	if (dst == NULL || dstLength == NULL)	return 0x01;		//Define error	->	NULL pointer
+	if (finished)							return 0x02;		//Define error	->	Called after Final
+
+	*dstLength = 0;
+
+	if (!attachPadding) {
+		if (bufferLength != 0)				return 0x03;		//Define error	->	Incomplete block without padding
+		finished = true;
+		return 0x00;
+	}
+
+	//Padding the data with #PKCS7 (a full block if the data is already aligned)
+	AES::AttachPadding(buffer, bufferLength);
+	Process(buffer, dst, 16);
+
+	AES_SecureZero(buffer, sizeof(buffer));
+	bufferLength = 0;
+	finished = true;
+	*dstLength = 16;
+
+	return 0x00;
+}
+
+//
+bool AESEncryptor::Process(const uint8_t* src, uint8_t* dst, size_t length) {
+	if (length == 0)	return true;
+
+	if (!cbc)
+		return aes.EncryptStream(src, dst, length);
+
+	//CBC chains block by block in place
+	if (src != dst)
+		memcpy(dst, src, length);
+	aes.EncryptStreamOriginCBC(dst, length, iv);
+	return true;
+}
+
+//
+AESDecryptor::AESDecryptor(const AES& aes, const uint8_t* iv, bool removePadding) : aes(aes), removePadding(removePadding) {
+	Reset(iv);
+}
+
+//
+AESDecryptor::~AESDecryptor() {
+	AES_SecureZero(buffer, sizeof(buffer));
+	AES_SecureZero(iv, sizeof(iv));
+}
+
+//
+void AESDecryptor::Reset(const uint8_t* iv) {
+	AES_SecureZero(buffer, sizeof(buffer));
+	bufferLength = 0;
+	finished = false;
+
+	cbc = iv != NULL;
+	if (cbc)
+		memcpy(this->iv, iv, 16);
+}
+
+//
+size_t AESDecryptor::GetUpdateSize(size_t length) const {
+	size_t total = bufferLength + length;
+	size_t keep = total & 0x0F;
+
+	//With padding the last whole block may be the padding block, it is decrypted by Final
+	if (removePadding && keep == 0 && total > 0)
+		keep = 16;
+
+	return total - keep;
+}
+
+//
+int AESDecryptor::Update(const uint8_t* src, size_t length, uint8_t* dst, size_t* dstLength) {
+	if (dstLength == NULL || (length > 0 && (src == NULL || dst == NULL)))	return 0x01;		//Define error	->	NULL pointer
+	if (finished)															return 0x02;		//Define error	->	Called after Final
+
+	size_t emit = GetUpdateSize(length);
+	*dstLength = emit;
+
+	if (emit == 0) {
+		memcpy(buffer + bufferLength, src, length);
+		bufferLength += length;
+		return 0x00;
+	}
+
+	//Complete (or release the held back) buffered block first
+	if (bufferLength > 0) {
+		size_t fill = 16 - bufferLength;
+		memcpy(buffer + bufferLength, src, fill);
+		Process(buffer, dst, 16);
+		src += fill;
+		length -= fill;
+		dst += 16;
+		emit -= 16;
+	}
+
+	if (!Process(src, dst, emit)) {
+
+		//Cancelled by the observer: the output has gaps, the message can only be dropped
+		AES_SecureZero(buffer, sizeof(buffer));
+		bufferLength = 0;
+		finished = true;
+		*dstLength = 0;
+		return 0x0B;
+	}
+
+	bufferLength = length - emit;
+	memcpy(buffer, src + emit, bufferLength);
+
+	return 0x00;
+}
+
+//
+int AESDecryptor::Final(uint8_t* dst, size_t* dstLength) {
+	if (dst == NULL || dstLength == NULL)	return 0x01;		//Define error	->	NULL pointer
+	if (finished)							return 0x02;		//Define error	->	Called after Final
+
+	*dstLength = 0;
+
+	if (!removePadding) {
+		if (bufferLength != 0)				return 0x03;		//Define error	->	Message is not a multiple of 16 bytes
+		finished = true;
+		return 0x00;
+	}
+
+	if (bufferLength != 16)					return 0x03;		//Define error	->	Message is not a multiple of 16 bytes
+
+	uint8_t block[16];
+	Process(buffer, block, 16);
+
+	AES_SecureZero(buffer, sizeof(buffer));
+	bufferLength = 0;
+	finished = true;
+
+	size_t blockLength = 0;
+	if (!AES::CheckPadding(block, 16, &blockLength)) {
+		AES_SecureZero(block, sizeof(block));
+		return 0x04;										//Define error	->	Bad padding
+	}
+
+	memcpy(dst, block, blockLength);
+	*dstLength = blockLength;
+	AES_SecureZero(block, sizeof(block));
+
+	return 0x00;
+}
+
+//
+bool AESDecryptor::Process(const uint8_t* src, uint8_t* dst, size_t length) {
+	if (length == 0)	return true;
+
+	if (!cbc)
+		return aes.DecryptStream(src, dst, length);
+
+	if (src != dst)
+		memcpy(dst, src, length);
+	return aes.DecryptStreamOriginCBC(dst, length, iv);
+}
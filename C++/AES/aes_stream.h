@@ -0,0 +1,195 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "aes.h"
+
+/*
+*
+*	Incremental encryption and decryption with #PKCS7 padding (ECB, or CBC when an IV is given)
+*
+*	Input can arrive in fragments of any size. Partial blocks are kept in a 16 byte buffer,
+*	the padding is added or checked only by Final. Memory use does not depend on the message length.
+*
+*	Streaming use: Update* -> Final (-> Reset for the next message)
+*
+*/
+
+/**
+*	Streaming encryptor
+*/
+class AESEncryptor {
+
+private:
+
+	AES aes;								//Block cipher (shares the key schedule)
+
+	uint8_t buffer[16] = { 0 };				//Bytes of the incomplete block
+
+	size_t bufferLength = 0;				//Bytes in buffer (0..15)
+
+	uint8_t iv[16] = { 0 };					//CBC chaining value (last ciphertext block)
+
+	bool cbc = false;						//True: CBC, false: ECB
+
+	bool attachPadding = true;				//Pad the message in Final
+
+	bool finished = false;					//Final was called
+
+public:
+
+	/**
+	*	Create an encryptor on an initialized AES object
+	*
+	*	@param <AES&> aes				AES object (copied, the key schedule is shared)
+	*	@param <uint8_t*> iv			16 byte initialization vector for CBC, NULL for ECB
+	*	@param <bool> attachPadding		Pad the message in Final (without padding the message must be a multiple of 16 bytes)
+	*/
+	explicit AESEncryptor(const AES& aes, const uint8_t* iv = NULL, bool attachPadding = true);
+
+	/**
+	*	Zeroize the buffered data
+	*/
+	~AESEncryptor();
+
+	/**
+	*	Start a new message with the same key
+	*
+	*	@param <uint8_t*> iv			16 byte initialization vector for CBC, NULL for ECB
+	*/
+	void Reset(const uint8_t* iv = NULL);
+
+	/**
+	*	Get the most bytes the next Update can write
+	*
+	*	@param <size_t> length			Input length of the next Update
+	*
+	*	@returns <size_t>				Output size (at most length + 15)
+	*/
+	size_t GetUpdateSize(size_t length) const;
+
+	/**
+	*	Encrypt the next fragment of the message, only whole blocks are written
+	*
+	*	@param <uint8_t*> src			Plaintext fragment
+	*	@param <size_t> length			Fragment length (any size)
+	*	@param <uint8_t*> dst			Ciphertext (GetUpdateSize(length) bytes, must not overlap src)
+	*	@param <size_t*> dstLength		Bytes written
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL pointer, 0x02 called after Final, 0x0B cancelled by the observer (the message is dropped, Reset starts a new one)
+	*/
+	int Update(const uint8_t* src, size_t length, uint8_t* dst, size_t* dstLength);
+
+	/**
+	*	Finish the message: pad and encrypt the buffered bytes
+	*
+	*	@param <uint8_t*> dst			Ciphertext (16 bytes with padding, nothing is written without padding)
+	*	@param <size_t*> dstLength		Bytes written
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL pointer, 0x02 called after Final, 0x03 incomplete block without padding
+	*/
+	int Final(uint8_t* dst, size_t* dstLength);
+
+private:
+
+	/**
+	*	Encrypt whole blocks
+	*
+	*	@param <uint8_t*> src			Plaintext
+	*	@param <uint8_t*> dst			Ciphertext (may be src)
+	*	@param <size_t> length			Multiple of 16 bytes
+	*
+	*	@returns <bool>					False if the observer cancelled
+	*/
+	bool Process(const uint8_t* src, uint8_t* dst, size_t length);
+};
+
+/**
+*	Streaming decryptor (holds back the last block until Final, it may be the padding)
+*/
+class AESDecryptor {
+
+private:
+
+	AES aes;								//Block cipher (shares the key schedule)
+
+	uint8_t buffer[16] = { 0 };				//Bytes of the incomplete or held back block
+
+	size_t bufferLength = 0;				//Bytes in buffer (0..16)
+
+	uint8_t iv[16] = { 0 };					//CBC chaining value (last ciphertext block)
+
+	bool cbc = false;						//True: CBC, false: ECB
+
+	bool removePadding = true;				//Check and strip the padding in Final
+
+	bool finished = false;					//Final was called
+
+public:
+
+	/**
+	*	Create a decryptor on an initialized AES object
+	*
+	*	@param <AES&> aes				AES object (copied, the key schedule is shared)
+	*	@param <uint8_t*> iv			16 byte initialization vector for CBC, NULL for ECB
+	*	@param <bool> removePadding		Check and strip the padding in Final
+	*/
+	explicit AESDecryptor(const AES& aes, const uint8_t* iv = NULL, bool removePadding = true);
+
+	/**
+	*	Zeroize the buffered data
+	*/
+	~AESDecryptor();
+
+	/**
+	*	Start a new message with the same key
+	*
+	*	@param <uint8_t*> iv			16 byte initialization vector for CBC, NULL for ECB
+	*/
+	void Reset(const uint8_t* iv = NULL);
+
+	/**
+	*	Get the most bytes the next Update can write
+	*
+	*	@param <size_t> length			Input length of the next Update
+	*
+	*	@returns <size_t>				Output size (at most length + 15)
+	*/
+	size_t GetUpdateSize(size_t length) const;
+
+	/**
+	*	Decrypt the next fragment of the message, only whole blocks are written
+	*
+	*	@param <uint8_t*> src			Ciphertext fragment
+	*	@param <size_t> length			Fragment length (any size)
+	*	@param <uint8_t*> dst			Plaintext (GetUpdateSize(length) bytes, must not overlap src)
+	*	@param <size_t*> dstLength		Bytes written
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL pointer, 0x02 called after Final, 0x0B cancelled by the observer (the message is dropped, Reset starts a new one)
+	*/
+	int Update(const uint8_t* src, size_t length, uint8_t* dst, size_t* dstLength);
+
+	/**
+	*	Finish the message: decrypt the held back block and strip its padding
+	*
+	*	@param <uint8_t*> dst			Plaintext (up to 15 bytes with padding, nothing is written without padding)
+	*	@param <size_t*> dstLength		Bytes written
+	*
+	*	@returns <int>					0x00 on success, 0x01 NULL pointer, 0x02 called after Final, 0x03 message is not a multiple of 16 bytes, 0x04 bad padding
+	*/
+	int Final(uint8_t* dst, size_t* dstLength);
+
+private:
+
+	/**
+	*	Decrypt whole blocks
+	*
+	*	@param <uint8_t*> src			Ciphertext
+	*	@param <uint8_t*> dst			Plaintext (may be src)
+	*	@param <size_t> length			Multiple of 16 bytes
+	*
+	*	@returns <bool>					False if the observer cancelled
+	*/
+	bool Process(const uint8_t* src, uint8_t* dst, size_t length);
+};
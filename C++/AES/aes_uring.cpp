@@ -0,0 +1,390 @@
+#include "aes_config.h"
+#include "aes.h"
+#include "aes_progress.h"
+
+#ifdef AES_URING
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <vector>
+
+//Older C libraries don't name the io_uring syscalls (same numbers on every architecture)
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup		425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter		426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register	427
+#endif
+
+/**
+*	Minimal io_uring instance over the raw syscalls
+*
+*	Only what the file mode needs: one submission ring, one completion ring, optional registered buffers.
+*	Submissions are only made from the owning thread, so the rings need no locking, only the acquire /
+*	release ordering against the kernel.
+*/
+class AESUring {
+
+private:
+
+	int ringFd = -1;
+
+	uint8_t* sqRing = (uint8_t*)MAP_FAILED;			//Submission ring (head, tail, mask, index array)
+	size_t sqRingSize = 0;
+
+	uint8_t* cqRing = (uint8_t*)MAP_FAILED;			//Completion ring, the same mapping as sqRing with IORING_FEAT_SINGLE_MMAP
+	size_t cqRingSize = 0;
+
+	io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;	//Submission entries
+	size_t sqesSize = 0;
+
+	uint32_t* sqHead = NULL;
+	uint32_t* sqTail = NULL;
+	uint32_t sqMask = 0;
+	uint32_t* sqArray = NULL;
+
+	uint32_t* cqHead = NULL;
+	uint32_t* cqTail = NULL;
+	uint32_t cqMask = 0;
+	io_uring_cqe* cqes = NULL;
+
+	uint32_t toSubmit = 0;							//Entries queued since the last Submit
+
+public:
+
+	AESUring() = default;
+
+	AESUring(const AESUring&) = delete;
+	AESUring& operator=(const AESUring&) = delete;
+
+	//Unmapping and closing the ring cancels anything still queued
+	~AESUring() {
+		if (sqes != MAP_FAILED)								munmap(sqes, sqesSize);
+		if (cqRing != MAP_FAILED && cqRing != sqRing)		munmap(cqRing, cqRingSize);
+		if (sqRing != MAP_FAILED)							munmap(sqRing, sqRingSize);
+		if (ringFd >= 0)									close(ringFd);
+	}
+
+	/**
+	*	Create the rings
+	*
+	*	@param <uint32_t> entries		Submission ring size (the completion ring is twice as large)
+	*
+	*	@returns <bool>					False if io_uring is not available (old kernel, seccomp, io_uring_disabled)
+	*/
+	bool Open(uint32_t entries) {
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+
+		ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+		if (ringFd < 0)		return false;
+
+		sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if ((params.features & IORING_FEAT_SINGLE_MMAP) && cqRingSize > sqRingSize)
+			sqRingSize = cqRingSize;
+
+		sqRing = (uint8_t*)mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+		if (sqRing == MAP_FAILED)	return false;
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			cqRing = sqRing;
+		else {
+			cqRing = (uint8_t*)mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+			if (cqRing == MAP_FAILED)	return false;
+		}
+
+		sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = (io_uring_sqe*)mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED)		return false;
+
+		sqHead = (uint32_t*)(sqRing + params.sq_off.head);
+		sqTail = (uint32_t*)(sqRing + params.sq_off.tail);
+		sqMask = *(uint32_t*)(sqRing + params.sq_off.ring_mask);
+		sqArray = (uint32_t*)(sqRing + params.sq_off.array);
+
+		cqHead = (uint32_t*)(cqRing + params.cq_off.head);
+		cqTail = (uint32_t*)(cqRing + params.cq_off.tail);
+		cqMask = *(uint32_t*)(cqRing + params.cq_off.ring_mask);
+		cqes = (io_uring_cqe*)(cqRing + params.cq_off.cqes);
+
+		return true;
+	}
+
+	/**
+	*	Pin buffers for READ_FIXED / WRITE_FIXED
+	*
+	*	@param <iovec*> buffers			Buffer i is used with buf_index i
+	*	@param <uint32_t> count			Number of buffers
+	*
+	*	@returns <bool>					False if the buffers can't be pinned (RLIMIT_MEMLOCK), plain reads and writes still work
+	*/
+	bool RegisterBuffers(const iovec* buffers, uint32_t count) {
+		return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+	}
+
+	/**
+	*	Queue an entry (sent by the next Submit)
+	*
+	*	@returns <io_uring_sqe*>		Cleared entry to fill, NULL if the submission ring is full
+	*/
+	io_uring_sqe* Queue() {
+		uint32_t tail = *sqTail;
+		if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > sqMask)	return NULL;
+
+		uint32_t index = tail & sqMask;
+		sqArray[index] = index;
+		memset(&sqes[index], 0, sizeof(io_uring_sqe));
+
+		__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+		toSubmit++;
+
+		return &sqes[index];
+	}
+
+	/**
+	*	Send the queued entries and wait for completions
+	*
+	*	@param <uint32_t> waitFor		Completions to wait for (0: don't block)
+	*
+	*	@returns <bool>					False on a ring error (errno is set)
+	*/
+	bool Submit(uint32_t waitFor) {
+		for (;;) {
+			int sent = (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+			if (sent >= 0) {
+				toSubmit -= (uint32_t)sent;
+				if (toSubmit == 0)	return true;
+				continue;
+			}
+
+			if (errno != EINTR && errno != EAGAIN)		return false;
+		}
+	}
+
+	/**
+	*	Take the next completion
+	*
+	*	@param <io_uring_cqe*> cqe		Completion (user_data and res)
+	*
+	*	@returns <bool>					False if no completion is ready
+	*/
+	bool Reap(io_uring_cqe* cqe) {
+		uint32_t head = *cqHead;
+		if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))	return false;
+
+		*cqe = cqes[head & cqMask];
+		__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+		return true;
+	}
+};
+
+/**
+*	One buffer of the io_uring mode, it is either reading, in the cipher or writing
+*/
+struct AES_URING_SLOT {
+	uint8_t* data;			//AES_FILE_URING_CHUNK + 16 bytes (room for the padding block)
+	uint64_t offset;		//File offset of the chunk (the same in the input and the output)
+	size_t length;			//Bytes to read, then bytes to write
+	size_t done;			//Bytes already transferred (short reads and writes are continued)
+	size_t input;			//Input bytes of the chunk (progress)
+	bool writing;			//Read finished, the chunk is being written
+	bool last;				//Last chunk of the file (gets or loses the padding)
+	iovec transfer;			//Transfer of READV / WRITEV when the buffers are not registered
+};
+
+//
+int AES::CryptFileUring(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const {
+
+	int inputFd = fileno(inputFile);
+	int outputFd = fileno(outputFile);
+
+	//Transfers use file offsets, so pipes and devices go through the pipeline
+	struct stat inputStat, outputStat;
+	if (fstat(inputFd, &inputStat) != 0 || fstat(outputFd, &outputStat) != 0)	return 0x04;
+	if (!S_ISREG(inputStat.st_mode) || !S_ISREG(outputStat.st_mode))			return 0x04;
+
+	//No more buffers than chunks
+	uint64_t chunks = (length + AES_FILE_URING_CHUNK - 1) / AES_FILE_URING_CHUNK;
+	uint32_t depth = chunks < fileQueueDepth ? (uint32_t)chunks : fileQueueDepth;
+	progress.SetChunks(chunks);
+
+	AESUring ring;
+	if (!ring.Open(depth))		return 0x04;
+
+	std::vector<AES_URING_SLOT> slots(depth);
+	std::vector<iovec> buffers(depth);
+	std::vector<uint32_t> freeSlots;
+	int result = 0x00;
+
+	for (uint32_t i = 0; i < depth; i++) {
+		void* data = NULL;
+		if (posix_memalign(&data, AES_FILE_BUFFER_ALIGN, AES_FILE_URING_CHUNK + 16) != 0)	result = 0x02;
+
+		slots[i].data = (uint8_t*)data;
+		buffers[i].iov_base = data;
+		buffers[i].iov_len = AES_FILE_URING_CHUNK + 16;
+		freeSlots.push_back(depth - 1 - i);
+	}
+
+	if (result != 0x00) {
+		for (uint32_t i = 0; i < depth; i++)
+			free(slots[i].data);
+		return result;
+	}
+
+	//Pinned buffers save the page lookups on every transfer, READV / WRITEV if the memlock limit is too low
+	bool fixed = ring.RegisterBuffers(buffers.data(), depth);
+
+	//Queue the next transfer of a slot (the rest of it after a short read or write)
+	auto Transfer = [&](uint32_t i) {
+		AES_URING_SLOT& slot = slots[i];
+		io_uring_sqe* sqe = ring.Queue();			//Never full: one entry per slot at most
+
+		sqe->fd = slot.writing ? outputFd : inputFd;
+		sqe->off = slot.offset + slot.done;
+		sqe->user_data = i;
+
+		if (fixed) {
+			sqe->opcode = slot.writing ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+			sqe->addr = (uint64_t)(uintptr_t)(slot.data + slot.done);
+			sqe->len = (uint32_t)(slot.length - slot.done);
+			sqe->buf_index = (uint16_t)i;
+		}
+		else {
+			slot.transfer.iov_base = slot.data + slot.done;
+			slot.transfer.iov_len = slot.length - slot.done;
+			sqe->opcode = slot.writing ? IORING_OP_WRITEV : IORING_OP_READV;
+			sqe->addr = (uint64_t)(uintptr_t)&slot.transfer;
+			sqe->len = 1;
+		}
+	};
+
+	uint64_t nextOffset = 0;
+	uint32_t inFlight = 0;
+
+	for (;;) {
+		//Keep every free buffer reading while there is input left (stop reading after an error, only drain)
+		while (result == 0x00 && nextOffset < length && !freeSlots.empty()) {
+			uint32_t i = freeSlots.back();
+			freeSlots.pop_back();
+
+			size_t chunk = length - nextOffset < AES_FILE_URING_CHUNK ? (size_t)(length - nextOffset) : AES_FILE_URING_CHUNK;
+
+			slots[i].offset = nextOffset;
+			slots[i].length = chunk;
+			slots[i].input = chunk;
+			slots[i].done = 0;
+			slots[i].writing = false;
+			slots[i].last = nextOffset + chunk == length;
+			nextOffset += chunk;
+
+			Transfer(i);
+			inFlight++;
+		}
+
+		if (inFlight == 0)	break;
+
+		//Waiting for the device is the I/O time of this mode
+		uint64_t start = progress.Now();
+		bool submitted = ring.Submit(1);
+		progress.AddIO(progress.Now() - start);
+
+		if (!submitted) {
+			//The kernel may still own the buffers: leave them to the ring teardown instead of freeing them
+			return 0x01;
+		}
+
+		//Completions in the order the device finished them
+		io_uring_cqe cqe;
+		while (ring.Reap(&cqe)) {
+			uint32_t i = (uint32_t)cqe.user_data;
+			AES_URING_SLOT& slot = slots[i];
+			inFlight--;
+
+			if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+				Transfer(i);
+				inFlight++;
+				continue;
+			}
+
+			//Error or unexpected end of file
+			if (cqe.res <= 0) {
+				if (result == 0x00)		result = 0x01;
+				freeSlots.push_back(i);
+				continue;
+			}
+
+			slot.done += (size_t)cqe.res;
+
+			if (slot.done < slot.length) {
+				Transfer(i);
+				inFlight++;
+				continue;
+			}
+
+			if (slot.writing || result != 0x00) {
+				if (slot.writing && result == 0x00 && !progress.Chunk(slot.input))
+					result = 0x05;		//Cancelled: no new reads, the transfers in flight drain
+				freeSlots.push_back(i);
+				continue;
+			}
+
+			//Read complete: cipher in place while the other transfers continue, then write it back at the same offset
+			size_t outLength = 0;
+			start = progress.Now();
+			int code = encrypt
+				? EncryptInto(slot.data, slot.length, slot.data, AES_FILE_URING_CHUNK + 16, &outLength, slot.last)
+				: DecryptInto(slot.data, slot.length, slot.data, AES_FILE_URING_CHUNK + 16, &outLength, slot.last);
+			progress.AddCipher(progress.Now() - start);
+
+			if (code != 0x00) {
+				result = code == 0x04 ? 0x03 : 0x01;
+				freeSlots.push_back(i);
+				continue;
+			}
+
+			slot.length = outLength;
+			slot.done = 0;
+			slot.writing = true;
+
+			//Decrypting a last chunk of only padding writes nothing
+			if (outLength == 0) {
+				if (!progress.Chunk(slot.input))	result = 0x05;
+				freeSlots.push_back(i);
+				continue;
+			}
+
+			Transfer(i);
+			inFlight++;
+		}
+	}
+
+	//Every transfer finished, the buffers held plaintext
+	for (uint32_t i = 0; i < depth; i++) {
+		AES_SecureZero(slots[i].data, AES_FILE_URING_CHUNK + 16);
+		free(slots[i].data);
+	}
+
+	return result;
+}
+
+#else
+
+//No io_uring on this platform, the buffered pipeline is used
+int AES::CryptFileUring(FILE* inputFile, FILE* outputFile, size_t length, bool encrypt, AESProgressTracker& progress) const {
+	return 0x04;
+}
+
+#endif
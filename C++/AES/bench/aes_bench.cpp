@@ -0,0 +1,403 @@
+/*
+
+	Benchmarks of the AES class: cycles / byte, MB/s and latency percentiles
+
+	Build (from C++/AES):
+		g++ -O2 -std=c++17 -fopenmp -I. bench/aes_bench.cpp aes*.cpp -o aes_bench -lpthread
+		cl /O2 /std:c++17 /openmp /I. bench\aes_bench.cpp aes*.cpp
+
+	Usage:
+		aes_bench [--format json|csv] [--filter TEXT] [--engine reference|ttable|aesni|bitslice]
+		          [--max-size BYTES] [--min-time SECONDS] [--file-size BYTES]
+		          [--tmpfs DIR] [--disk DIR] [--threads N]
+
+	Results go to stdout (JSON by default), progress to stderr. Sizes accept K, M and G suffixes.
+	Cycles are TSC reference cycles on x86 (they don't follow frequency scaling). Elsewhere there is no
+	cycle counter: cycle_counter is "none" and cycles_per_byte is 0, use the nanosecond fields.
+
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "aes.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define BENCH_TSC
+#endif
+
+/**
+*	Settings from the command line
+*/
+struct BENCH_OPTIONS {
+	bool csv = false;							//CSV instead of JSON
+	std::string filter;							//Only run benchmarks whose group/name contains this
+	AES_ENGINE engine = AES::DefaultEngine();	//Engine of the stream, padding and file benchmarks
+	size_t maxSize = (size_t)1 << 30;			//Largest message of the stream benchmarks (1 GB)
+	double minTime = 0.25;						//Seconds measured per benchmark (at least BENCH_MIN_SAMPLES samples)
+	size_t fileSize = (size_t)64 << 20;			//File size of the file benchmarks
+	std::string tmpfs = "/dev/shm";				//Memory backed directory ("" to skip)
+	std::string disk = ".";						//Disk backed directory ("" to skip)
+	int threads = 0;							//SetThreadNum of the AES objects
+};
+
+/**
+*	One line of the report
+*/
+struct BENCH_RESULT {
+	std::string group;			//block, stream, padded, key, file
+	std::string name;			//Operation
+	std::string engine;			//Round engine
+	size_t bytes;				//Bytes per operation
+	size_t samples;				//Measured samples
+	double mbps;				//Throughput at the median (10^6 bytes / s)
+	double cyclesPerByte;		//Cycles per byte at the median
+	double p50;					//Latency percentiles of one operation in ns
+	double p90;
+	double p99;
+};
+
+#define BENCH_MIN_SAMPLES		3					//Samples taken however long they run
+#define BENCH_MAX_SAMPLES		10000				//Samples taken however short they are
+#define BENCH_MIN_WORK			( 64 * 1024 )		//Small operations are repeated until a sample covers this many bytes
+
+static const char* engineNames[] = { "reference", "ttable", "aesni", "bitslice" };
+
+//
+static uint64_t Bench_Cycles() {
+#ifdef BENCH_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+//
+static uint64_t Bench_Nanoseconds() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Percentile of sorted samples
+static double Bench_Percentile(const std::vector<double>& sorted, double p) {
+	size_t i = (size_t)(p * (double)(sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
+//"64K", "16M", "1G" -> bytes
+static size_t Bench_ParseSize(const char* text) {
+	char* end = NULL;
+	double value = strtod(text, &end);
+	switch (end ? *end : '\0') {
+	case 'k': case 'K':		value *= 1024.0;				break;
+	case 'm': case 'M':		value *= 1024.0 * 1024.0;		break;
+	case 'g': case 'G':		value *= 1024.0 * 1024.0 * 1024.0;	break;
+	}
+	return (size_t)value;
+}
+
+//16 -> "16", 4096 -> "4K", 2^30 -> "1G"
+static std::string Bench_SizeName(size_t bytes) {
+	char text[32];
+	if (bytes >= ((size_t)1 << 30) && bytes % ((size_t)1 << 30) == 0)	snprintf(text, sizeof(text), "%zuG", bytes >> 30);
+	else if (bytes >= ((size_t)1 << 20) && bytes % ((size_t)1 << 20) == 0)	snprintf(text, sizeof(text), "%zuM", bytes >> 20);
+	else if (bytes >= 1024 && bytes % 1024 == 0)						snprintf(text, sizeof(text), "%zuK", bytes >> 10);
+	else																snprintf(text, sizeof(text), "%zu", bytes);
+	return text;
+}
+
+/**
+*	Measure an operation
+*
+*	@param <BENCH_OPTIONS&> options		Settings (filter, min time)
+*	@param <std::vector&> results		Report, one line is appended
+*	@param <char*> group				Benchmark group
+*	@param <std::string> name			Operation
+*	@param <AES_ENGINE> engine			Engine used by the operation
+*	@param <size_t> bytes				Bytes per operation
+*	@param <std::function> operation	Operation to measure (called once per repetition)
+*/
+static void Bench_Run(const BENCH_OPTIONS& options, std::vector<BENCH_RESULT>& results, const char* group, const std::string& name,
+	AES_ENGINE engine, size_t bytes, const std::function<void()>& operation) {
+
+	std::string id = std::string(group) + "/" + name;
+	if (!options.filter.empty() && id.find(options.filter) == std::string::npos)	return;
+
+	fprintf(stderr, "%-40s %-10s ", id.c_str(), engineNames[engine]);
+	fflush(stderr);
+
+	//Short operations are timed in batches so the clock reads don't dominate
+	size_t repeat = bytes < BENCH_MIN_WORK ? BENCH_MIN_WORK / (bytes ? bytes : 1) : 1;
+
+	//Warm up (page faults, caches, branch predictors)
+	for (size_t r = 0; r < repeat; r++)
+		operation();
+
+	std::vector<double> nanoseconds, cycles;
+	uint64_t start = Bench_Nanoseconds();
+
+	while (nanoseconds.size() < BENCH_MAX_SAMPLES &&
+		(nanoseconds.size() < BENCH_MIN_SAMPLES || (double)(Bench_Nanoseconds() - start) < options.minTime * 1e9)) {
+
+		uint64_t t0 = Bench_Nanoseconds();
+		uint64_t c0 = Bench_Cycles();
+
+		for (size_t r = 0; r < repeat; r++)
+			operation();
+
+		uint64_t c1 = Bench_Cycles();
+		uint64_t t1 = Bench_Nanoseconds();
+
+		nanoseconds.push_back((double)(t1 - t0) / (double)repeat);
+		cycles.push_back((double)(c1 - c0) / (double)repeat);
+	}
+
+	std::sort(nanoseconds.begin(), nanoseconds.end());
+	std::sort(cycles.begin(), cycles.end());
+
+	BENCH_RESULT result;
+	result.group = group;
+	result.name = name;
+	result.engine = engineNames[engine];
+	result.bytes = bytes;
+	result.samples = nanoseconds.size();
+	result.p50 = Bench_Percentile(nanoseconds, 0.50);
+	result.p90 = Bench_Percentile(nanoseconds, 0.90);
+	result.p99 = Bench_Percentile(nanoseconds, 0.99);
+	result.mbps = result.p50 > 0 ? (double)bytes * 1e3 / result.p50 : 0;
+	result.cyclesPerByte = bytes ? Bench_Percentile(cycles, 0.50) / (double)bytes : 0;
+
+	fprintf(stderr, "%12.1f MB/s %10.2f c/B %14.0f ns p50\n", result.mbps, result.cyclesPerByte, result.p50);
+	results.push_back(result);
+}
+
+//Single block calls on every engine the CPU supports (the reference engine covers SubBytes / MixColumns)
+static void Bench_Blocks(const BENCH_OPTIONS& options, std::vector<BENCH_RESULT>& results, const AES& keyed) {
+	std::vector<uint8_t> buffer(BENCH_MIN_WORK, 0x5A);
+
+	for (uint8_t e = AES_ENGINE_REFERENCE; e <= AES_ENGINE_BITSLICE; e++) {
+		AES aes = keyed;
+		if (!aes.SetEngine((AES_ENGINE)e))	continue;
+
+		size_t offset = 0;
+		Bench_Run(options, results, "block", "EncryptBlock", (AES_ENGINE)e, 16, [&] {
+			aes.EncryptBlock(buffer.data() + offset);
+			offset = (offset + 16) % buffer.size();
+		});
+		Bench_Run(options, results, "block", "DecryptBlock", (AES_ENGINE)e, 16, [&] {
+			aes.DecryptBlock(buffer.data() + offset);
+			offset = (offset + 16) % buffer.size();
+		});
+	}
+}
+
+//In-place streams and the padded allocating API from 16 bytes to maxSize (x4 steps)
+static void Bench_Streams(const BENCH_OPTIONS& options, std::vector<BENCH_RESULT>& results, const AES& aes) {
+	for (size_t size = 16; size <= options.maxSize; size *= 4) {
+		std::vector<uint8_t> buffer(size, 0xA5);
+		std::string sizeName = Bench_SizeName(size);
+
+		Bench_Run(options, results, "stream", "EncryptStreamOrigin/" + sizeName, aes.GetEngine(), size, [&] {
+			aes.EncryptStreamOrigin(buffer.data(), size);
+		});
+		Bench_Run(options, results, "stream", "DecryptStreamOrigin/" + sizeName, aes.GetEngine(), size, [&] {
+			aes.DecryptStreamOrigin(buffer.data(), size);
+		});
+
+		//Encrypt allocates the padded copy, the ciphertext is kept for Decrypt
+		size_t encryptedLength = 0;
+		uint8_t* encrypted = aes.Encrypt(buffer.data(), size, &encryptedLength, true);
+		if (encrypted == NULL)	continue;
+
+		Bench_Run(options, results, "padded", "Encrypt/" + sizeName, aes.GetEngine(), size, [&] {
+			size_t length = 0;
+			free(aes.Encrypt(buffer.data(), size, &length, true));
+		});
+		Bench_Run(options, results, "padded", "Decrypt/" + sizeName, aes.GetEngine(), size, [&] {
+			size_t length = 0;
+			free(aes.Decrypt(encrypted, encryptedLength, &length, true));
+		});
+
+		free(encrypted);
+	}
+}
+
+//Key expansion through Init and ChangeSecretKey
+static void Bench_Keys(const BENCH_OPTIONS& options, std::vector<BENCH_RESULT>& results) {
+	AES aes;
+	aes.SetEngine(options.engine);
+
+	char keyText[17] = "bench-key-000000";
+	uint8_t key[32];
+	for (uint8_t i = 0; i < 32; i++)
+		key[i] = (uint8_t)(i * 7 + 1);
+
+	uint32_t counter = 0;
+
+	//Change the key every call so nothing can be reused between calls
+	Bench_Run(options, results, "key", "Init/text", aes.GetEngine(), 16, [&] {
+		keyText[15] = (char)('0' + (counter++ & 0x3F));
+		aes.Init(keyText);
+	});
+	Bench_Run(options, results, "key", "ChangeSecretKey", aes.GetEngine(), 16, [&] {
+		keyText[15] = (char)('0' + (counter++ & 0x3F));
+		aes.ChangeSecretKey(keyText);
+	});
+
+	for (size_t keyLength = 16; keyLength <= 32; keyLength += 8) {
+		Bench_Run(options, results, "key", "Init/" + std::to_string(keyLength * 8), aes.GetEngine(), keyLength, [&] {
+			key[0] = (uint8_t)counter++;
+			aes.Init(key, keyLength);
+		});
+	}
+}
+
+//EncryptFileToFile / DecryptFileToFile in every file mode, in one directory
+static void Bench_Files(const BENCH_OPTIONS& options, std::vector<BENCH_RESULT>& results, const AES& keyed, const std::string& dir, const char* place) {
+	if (dir.empty())	return;
+
+	std::string plainName = dir + "/aes_bench_plain.bin";
+	std::string cipherName = dir + "/aes_bench_cipher.bin";
+	std::string outName = dir + "/aes_bench_out.bin";
+
+	FILE* file = fopen(plainName.c_str(), "wb");
+	if (file == NULL) {
+		fprintf(stderr, "file/%s: can't write to %s, skipped\n", place, dir.c_str());
+		return;
+	}
+
+	std::vector<uint8_t> chunk((size_t)1 << 20);
+	for (size_t i = 0; i < chunk.size(); i++)
+		chunk[i] = (uint8_t)(i * 131 + 7);
+	for (size_t written = 0; written < options.fileSize; written += chunk.size())
+		fwrite(chunk.data(), 1, std::min(chunk.size(), options.fileSize - written), file);
+	fclose(file);
+
+	static const char* modeNames[] = { "pipeline", "mmap", "uring", "parallel" };
+
+	for (uint8_t m = AES_FILE_PIPELINE; m <= AES_FILE_PARALLEL; m++) {
+		AES aes = keyed;
+		aes.SetFileMode((AES_FILE_MODE)m);
+
+		//Ciphertext for the decryption benchmark
+		if (aes.EncryptFileToFile((char*)plainName.c_str(), (char*)cipherName.c_str()) != 0x00) {
+			fprintf(stderr, "file/%s/%s: encryption failed, skipped\n", place, modeNames[m]);
+			continue;
+		}
+
+		std::string name = std::string(place) + "/" + modeNames[m] + "/" + Bench_SizeName(options.fileSize);
+
+		Bench_Run(options, results, "file", "EncryptFileToFile/" + name, aes.GetEngine(), options.fileSize, [&] {
+			aes.EncryptFileToFile((char*)plainName.c_str(), (char*)outName.c_str());
+		});
+		Bench_Run(options, results, "file", "DecryptFileToFile/" + name, aes.GetEngine(), options.fileSize, [&] {
+			aes.DecryptFileToFile((char*)cipherName.c_str(), (char*)outName.c_str());
+		});
+	}
+
+	remove(plainName.c_str());
+	remove(cipherName.c_str());
+	remove(outName.c_str());
+}
+
+//
+static void Bench_Print(const BENCH_OPTIONS& options, const std::vector<BENCH_RESULT>& results) {
+	if (options.csv) {
+		printf("group,name,engine,bytes,samples,mb_per_s,cycles_per_byte,p50_ns,p90_ns,p99_ns\n");
+		for (const BENCH_RESULT& r : results)
+			printf("%s,%s,%s,%zu,%zu,%.3f,%.4f,%.1f,%.1f,%.1f\n", r.group.c_str(), r.name.c_str(), r.engine.c_str(),
+				r.bytes, r.samples, r.mbps, r.cyclesPerByte, r.p50, r.p90, r.p99);
+		return;
+	}
+
+	printf("{\n");
+#ifdef BENCH_TSC
+	printf("  \"cycle_counter\": \"tsc\",\n");
+#else
+	printf("  \"cycle_counter\": \"none\",\n");
+#endif
+	int threads = options.threads > 0 ? options.threads : 1;
+#ifdef _OPENMP
+	if (options.threads <= 0)	threads = omp_get_max_threads();
+#endif
+
+	printf("  \"engine\": \"%s\",\n", engineNames[options.engine]);
+	printf("  \"threads\": %d,\n", threads);
+	printf("  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BENCH_RESULT& r = results[i];
+		printf("    { \"group\": \"%s\", \"name\": \"%s\", \"engine\": \"%s\", \"bytes\": %zu, \"samples\": %zu, "
+			"\"mb_per_s\": %.3f, \"cycles_per_byte\": %.4f, \"p50_ns\": %.1f, \"p90_ns\": %.1f, \"p99_ns\": %.1f }%s\n",
+			r.group.c_str(), r.name.c_str(), r.engine.c_str(), r.bytes, r.samples,
+			r.mbps, r.cyclesPerByte, r.p50, r.p90, r.p99, i + 1 < results.size() ? "," : "");
+	}
+	printf("  ]\n}\n");
+}
+
+//
+int main(int argc, char** argv) {
+	BENCH_OPTIONS options;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (arg == "--help" || arg == "-h" || value == NULL) {
+			fprintf(stderr, "usage: %s [--format json|csv] [--filter TEXT] [--engine reference|ttable|aesni|bitslice]\n"
+				"       [--max-size BYTES] [--min-time SECONDS] [--file-size BYTES] [--tmpfs DIR] [--disk DIR] [--threads N]\n", argv[0]);
+			return arg == "--help" || arg == "-h" ? 0 : 1;
+		}
+
+		if (arg == "--format")			options.csv = strcmp(value, "csv") == 0;
+		else if (arg == "--filter")		options.filter = value;
+		else if (arg == "--max-size")	options.maxSize = Bench_ParseSize(value);
+		else if (arg == "--min-time")	options.minTime = atof(value);
+		else if (arg == "--file-size")	options.fileSize = Bench_ParseSize(value);
+		else if (arg == "--tmpfs")		options.tmpfs = value;
+		else if (arg == "--disk")		options.disk = value;
+		else if (arg == "--threads")	options.threads = atoi(value);
+		else if (arg == "--engine") {
+			for (uint8_t e = AES_ENGINE_REFERENCE; e <= AES_ENGINE_BITSLICE; e++)
+				if (strcmp(value, engineNames[e]) == 0)	options.engine = (AES_ENGINE)e;
+		}
+		else {
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return 1;
+		}
+		i++;
+	}
+
+	AES aes;
+	uint8_t key[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+	aes.Init(key, sizeof(key));
+	aes.SetThreadNum(options.threads);
+
+	if (!aes.SetEngine(options.engine)) {
+		fprintf(stderr, "engine %s is not supported by this CPU\n", engineNames[options.engine]);
+		return 1;
+	}
+
+	std::vector<BENCH_RESULT> results;
+
+	Bench_Blocks(options, results, aes);
+	Bench_Streams(options, results, aes);
+	Bench_Keys(options, results);
+	Bench_Files(options, results, aes, options.tmpfs, "tmpfs");
+	Bench_Files(options, results, aes, options.disk, "disk");
+
+	Bench_Print(options, results);
+
+	return 0;
+}
@@ -0,0 +1,907 @@
+/*
+
+	Known-answer tests of the AES class: published vectors on every round engine this CPU supports
+
+	Build (from C++/AES):
+		g++ -O2 -std=c++17 -fopenmp -I. kat/aes_kat.cpp aes*.cpp -o aes_kat -lpthread
+		cl /O2 /std:c++17 /openmp /I. kat\aes_kat.cpp aes*.cpp
+
+	Usage:
+		aes_kat
+
+	Every failing check is printed, the exit code is 0 only if all of them pass.
+
+	Vectors:
+		FIPS-197 Appendix B and C.1 - C.3 (AES-128, AES-192, AES-256 single block)
+		SP 800-38A F.1.1 / F.1.2 (ECB-AES128 with a PKCS#7 block, EncryptInto / DecryptInto)
+		SP 800-38A F.2.1 / F.2.2 (CBC-AES128, one shot, chained and multi-buffer)
+		F.1.1 and F.2.1 through AESEncryptor / AESDecryptor in uneven fragments
+		SP 800-38A F.5.1 (CTR-AES128, at every starting offset)
+		GCM specification (McGrew, Viega) test cases 1 - 4, 6 - 8, 13, 14, 16 (AESGCM one shot and split, 96 bit and long IV)
+		GCM 128, 129 and 4109 byte messages with AAD, 4109 bytes also with AES-192 and AES-256 (tags from OpenSSL, ciphertext against EncryptCTR)
+	GCM runs with the PCLMULQDQ GHASH (where available) and with the table GHASH.
+
+	Round trips (default engine, temporary files in the working directory):
+		EncryptFileToFile / DecryptFileToFile on 1 byte to 3 * AES_FILE_BUFFER_SIZE + 4109 bytes, against Encrypt in memory, in every AES_FILE_MODE
+		AESBatch over files below, at and past AES_FILE_BUFFER_SIZE (split into chunks), plus one with a bad padding
+		AESContainer in GCM and CTR mode: whole file, DecryptRange across chunk borders, CTR chunks against EncryptCTR,
+		a changed GCM chunk rejected with 0x07, a fresh nonce for every container
+
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "aes.h"
+#include "aes_gcm.h"
+#include "aes_key_cache.h"
+#include "aes_stream.h"
+#include "aes_batch.h"
+#include "aes_container.h"
+
+#define KAT_BATCH_BLOCKS		67								//Copies of a block pushed through EncryptBlocks (wide engine paths and their tail)
+#define KAT_STREAM_BLOCKS		( 3 * AES_PARALLEL_CHUNK_SIZE / 16 + 5 )		//Copies of a block pushed through the stream functions (several parallel chunks)
+#define KAT_THREADS				8								//Threads sharing one key schedule
+
+static const char* engineNames[] = { "reference", "ttable", "aesni", "bitslice" };
+static const char* fileModeNames[] = { "pipeline", "mmap", "uring", "parallel" };
+
+/**
+*	Single block vector
+*/
+struct KAT_BLOCK {
+	const char* name;
+	const char* key;
+	const char* plaintext;
+	const char* ciphertext;
+};
+
+static const KAT_BLOCK blockVectors[] = {
+	{ "FIPS-197 B",   "2b7e151628aed2a6abf7158809cf4f3c",                                 "3243f6a8885a308d313198a2e0370734", "3925841d02dc09fbdc118597196a0b32" },
+	{ "FIPS-197 C.1", "000102030405060708090a0b0c0d0e0f",                                 "00112233445566778899aabbccddeeff", "69c4e0d86a7b0430d8cdb78070b4c55a" },
+	{ "FIPS-197 C.2", "000102030405060708090a0b0c0d0e0f1011121314151617",                 "00112233445566778899aabbccddeeff", "dda97ca4864cdfe06eaf70a0ec0d7191" },
+	{ "FIPS-197 C.3", "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f", "00112233445566778899aabbccddeeff", "8ea2b7ca516745bfeafc49904b496089" }
+};
+
+/**
+*	Block cipher mode vector (iv is the initial counter block in CTR)
+*/
+struct KAT_MODE {
+	const char* name;
+	const char* key;
+	const char* iv;
+	const char* plaintext;
+	const char* ciphertext;
+};
+
+#define KAT_38A_KEY			"2b7e151628aed2a6abf7158809cf4f3c"
+#define KAT_38A_PT			"6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e5130c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710"
+
+static const KAT_MODE ctrVectors[] = {
+	{ "SP 800-38A F.5.1", KAT_38A_KEY, "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff", KAT_38A_PT,
+		"874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee" },
+
+	//Not from the standard (OpenSSL output): the counter carries out of the low 64 bits
+	{ "CTR carry", KAT_38A_KEY, "f0f1f2f3f4f5f6f7fffffffffffffffe", KAT_38A_PT,
+		"5686d7956a24e7d4968796d166a11c59df031b44140d6a4432cadd3b454ea8c8ff330cda77af57630c17a6f1e76a897631932c0252f25df089f0d40e0b73961a" }
+};
+
+//The last ECB block is E(16 x 0x10), the PKCS#7 padding of a whole-block message (OpenSSL)
+static const KAT_MODE ecbVectors[] = {
+	{ "SP 800-38A F.1.1", KAT_38A_KEY, "", KAT_38A_PT,
+		"3ad77bb40d7a3660a89ecaf32466ef97f5d3d58503b9699de785895a96fdbaaf43b1cd7f598ece23881b00e3ed0306887b0c785e27e8ad3f8223207104725dd4a254be88e037ddd9d79fb6411c3f9df8" }
+};
+
+static const KAT_MODE cbcVectors[] = {
+	{ "SP 800-38A F.2.1", KAT_38A_KEY, "000102030405060708090a0b0c0d0e0f", KAT_38A_PT,
+		"7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b273bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7" }
+};
+
+/**
+*	GCM vector (empty strings for an empty plaintext or AAD)
+*/
+struct KAT_GCM {
+	const char* name;
+	const char* key;
+	const char* iv;
+	const char* aad;
+	const char* plaintext;
+	const char* ciphertext;
+	const char* tag;
+};
+
+#define KAT_GCM_KEY			"feffe9928665731c6d6a8f9467308308"
+#define KAT_GCM_IV			"cafebabefacedbaddecaf888"
+#define KAT_GCM_AAD			"feedfacedeadbeeffeedfacedeadbeefabaddad2"
+#define KAT_GCM_PT			"d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39"
+
+static const KAT_GCM gcmVectors[] = {
+	{ "GCM TC1",  "00000000000000000000000000000000", "000000000000000000000000", "", "",
+		"", "58e2fccefa7e3061367f1d57a4e7455a" },
+	{ "GCM TC2",  "00000000000000000000000000000000", "000000000000000000000000", "", "00000000000000000000000000000000",
+		"0388dace60b6a392f328c2b971b2fe78", "ab6e47d42cec13bdf53a67b21257bddf" },
+	{ "GCM TC3",  KAT_GCM_KEY, KAT_GCM_IV, "", KAT_GCM_PT "1aafd255",
+		"42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985", "4d5c2af327cd64a62cf35abd2ba6fab4" },
+	{ "GCM TC4",  KAT_GCM_KEY, KAT_GCM_IV, KAT_GCM_AAD, KAT_GCM_PT,
+		"42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091", "5bc94fbc3221a5db94fae95ae7121a47" },
+	{ "GCM TC6",  KAT_GCM_KEY, "9313225df88406e555909c5aff5269aa6a7a9538534f7da1e4c303d2a318a728c3c0c95156809539fcf0e2429a6b525416aedbf5a0de6a57a637b39b", KAT_GCM_AAD, KAT_GCM_PT,
+		"8ce24998625615b603a033aca13fb894be9112a5c3a211a8ba262a3cca7e2ca701e4a9a4fba43c90ccdcb281d48c7c6fd62875d2aca417034c34aee5", "619cc5aefffe0bfa462af43c1699d050" },
+	{ "GCM TC7",  "000000000000000000000000000000000000000000000000", "000000000000000000000000", "", "",
+		"", "cd33b28ac773f74ba00ed1f312572435" },
+	{ "GCM TC8",  "000000000000000000000000000000000000000000000000", "000000000000000000000000", "", "00000000000000000000000000000000",
+		"98e7247c07f0fe411c267e4384b0f600", "2ff58d80033927ab8ef4d4587514f0fb" },
+	{ "GCM TC13", "0000000000000000000000000000000000000000000000000000000000000000", "000000000000000000000000", "", "",
+		"", "530f8afbc74536b9a963b4f1c4cb738b" },
+	{ "GCM TC14", "0000000000000000000000000000000000000000000000000000000000000000", "000000000000000000000000", "", "00000000000000000000000000000000",
+		"cea7403d4d606b6e074ec5d3baf39d18", "d0d1c8a799996bf0265b98b5d48ab919" },
+	{ "GCM TC16", KAT_GCM_KEY KAT_GCM_KEY, KAT_GCM_IV, KAT_GCM_AAD, KAT_GCM_PT,
+		"522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662", "76fc6ece0f4e1768cddf8853bb2d551b" }
+};
+
+/**
+*	Long GCM message: KAT_GCM_IV, KAT_GCM_AAD and plaintext bytes 0, 1, 2, ... (8 blocks and more reach the fused AES-NI kernel)
+*/
+struct KAT_GCM_LONG {
+	const char* name;
+	const char* key;
+	size_t length;
+	const char* tag;
+};
+
+static const KAT_GCM_LONG gcmLongVectors[] = {
+	{ "GCM 128 bytes",          KAT_GCM_KEY,                      128,  "cb2196c034388e01aa8384c24c2428dc" },
+	{ "GCM 129 bytes",          KAT_GCM_KEY,                      129,  "18c79fb59a276b4d4fdf6145c6a551bd" },
+	{ "GCM 4109 bytes",         KAT_GCM_KEY,                      4109, "e7a2e963d17a5ead0e1731a3a7281abd" },
+	{ "GCM-192 4109 bytes",     KAT_GCM_KEY "feffe9928665731c",   4109, "bcd1281960018478686632e482eac64e" },
+	{ "GCM-256 4109 bytes",     KAT_GCM_KEY KAT_GCM_KEY,          4109, "3d08299c2e98cf4423b6da398bce1697" }
+};
+
+/**
+*	Pass / fail counters
+*/
+struct KAT_RESULT {
+	int checks = 0;
+	int failures = 0;
+};
+
+//Hex string -> bytes
+static std::vector<uint8_t> Kat_Hex(const char* hex) {
+	std::vector<uint8_t> bytes;
+	for (size_t i = 0; hex[i] != '\0' && hex[i + 1] != '\0'; i += 2) {
+		unsigned int byte = 0;
+		sscanf(hex + i, "%2x", &byte);
+		bytes.push_back((uint8_t)byte);
+	}
+	return bytes;
+}
+
+//Compare a result with the expected bytes, print the mismatch
+static void Kat_Check(KAT_RESULT& result, const char* name, const char* engine, const char* what, const uint8_t* got, const std::vector<uint8_t>& expected) {
+	result.checks++;
+	if (memcmp(got, expected.data(), expected.size()) == 0)	return;
+
+	result.failures++;
+	printf("FAIL %s [%s] %s: got ", name, engine, what);
+	for (size_t i = 0; i < expected.size(); i++)	printf("%02x", got[i]);
+	printf("\n");
+}
+
+//Count a check that has no bytes to compare, print it if it failed
+static bool Kat_Expect(KAT_RESULT& result, bool passed, const char* name, const char* engine, const char* what) {
+	result.checks++;
+	if (passed)		return true;
+
+	result.failures++;
+	printf("FAIL %s [%s] %s\n", name, engine, what);
+	return false;
+}
+
+//First block of a batch that differs from the expected block (block 0 if none does, so the check passes)
+static const uint8_t* Kat_FirstMismatch(const std::vector<uint8_t>& blocks, const std::vector<uint8_t>& expected) {
+	for (size_t b = 0; b < blocks.size() / 16; b++)
+		if (memcmp(blocks.data() + b * 16, expected.data(), 16) != 0)	return blocks.data() + b * 16;
+	return blocks.data();
+}
+
+//Single block vectors through EncryptBlock / DecryptBlock and the multi-block paths
+static void Kat_Blocks(KAT_RESULT& result, AES_ENGINE engine) {
+	for (const KAT_BLOCK& v : blockVectors) {
+		std::vector<uint8_t> key = Kat_Hex(v.key), plaintext = Kat_Hex(v.plaintext), ciphertext = Kat_Hex(v.ciphertext);
+
+		AES aes;
+		aes.Init(key.data(), key.size());
+		aes.SetEngine(engine);
+
+		uint8_t block[16];
+		memcpy(block, plaintext.data(), 16);
+		aes.EncryptBlock(block);
+		Kat_Check(result, v.name, engineNames[engine], "EncryptBlock", block, ciphertext);
+
+		aes.DecryptBlock(block);
+		Kat_Check(result, v.name, engineNames[engine], "DecryptBlock", block, plaintext);
+
+		//Every copy must come out the same, the wide kernels and their tail included
+		std::vector<uint8_t> blocks(KAT_BATCH_BLOCKS * 16);
+		for (size_t b = 0; b < KAT_BATCH_BLOCKS; b++)
+			memcpy(blocks.data() + b * 16, plaintext.data(), 16);
+
+		aes.EncryptBlocks(blocks.data(), KAT_BATCH_BLOCKS);
+		Kat_Check(result, v.name, engineNames[engine], "EncryptBlocks", Kat_FirstMismatch(blocks, ciphertext), ciphertext);
+
+		aes.DecryptBlocks(blocks.data(), KAT_BATCH_BLOCKS);
+		Kat_Check(result, v.name, engineNames[engine], "DecryptBlocks", Kat_FirstMismatch(blocks, plaintext), plaintext);
+	}
+}
+
+//Single block vectors through the stream functions, split across threads
+static void Kat_Streams(KAT_RESULT& result, AES_ENGINE engine) {
+	for (const KAT_BLOCK& v : blockVectors) {
+		std::vector<uint8_t> key = Kat_Hex(v.key), plaintext = Kat_Hex(v.plaintext), ciphertext = Kat_Hex(v.ciphertext);
+
+		AES aes;
+		aes.Init(key.data(), key.size());
+		aes.SetEngine(engine);
+		aes.SetThreadNum(4);
+		aes.SetParallelMinSize(16);
+
+		std::vector<uint8_t> src(KAT_STREAM_BLOCKS * 16), dst(KAT_STREAM_BLOCKS * 16);
+		for (size_t b = 0; b < KAT_STREAM_BLOCKS; b++)
+			memcpy(src.data() + b * 16, plaintext.data(), 16);
+
+		aes.EncryptStream(src.data(), dst.data(), dst.size());
+		Kat_Check(result, v.name, engineNames[engine], "EncryptStream", Kat_FirstMismatch(dst, ciphertext), ciphertext);
+
+		aes.DecryptStreamOrigin(dst.data(), dst.size());
+		Kat_Check(result, v.name, engineNames[engine], "DecryptStreamOrigin", Kat_FirstMismatch(dst, plaintext), plaintext);
+	}
+}
+
+//Single block vectors on threads that share one key schedule
+static void Kat_Shared(KAT_RESULT& result, AES_ENGINE engine) {
+	for (const KAT_BLOCK& v : blockVectors) {
+		std::vector<uint8_t> key = Kat_Hex(v.key), plaintext = Kat_Hex(v.plaintext), ciphertext = Kat_Hex(v.ciphertext);
+
+		AES owner;
+		owner.Init(key.data(), key.size());
+		AES aes(owner.GetKeySchedule());
+		aes.SetEngine(engine);
+
+		//Each thread counts its blocks that differ
+		std::atomic<int> mismatches{ 0 };
+		std::vector<std::thread> threads;
+		for (int t = 0; t < KAT_THREADS; t++)
+			threads.emplace_back([&]() {
+				for (int i = 0; i < 1000; i++) {
+					uint8_t block[16];
+					memcpy(block, plaintext.data(), 16);
+					aes.EncryptBlock(block);
+					if (memcmp(block, ciphertext.data(), 16) != 0)	mismatches++;
+					aes.DecryptBlock(block);
+					if (memcmp(block, plaintext.data(), 16) != 0)	mismatches++;
+				}
+			});
+		for (std::thread& thread : threads)
+			thread.join();
+
+		Kat_Expect(result, mismatches == 0, v.name, engineNames[engine], "blocks on threads sharing the key schedule");
+	}
+}
+
+//CTR vectors from every starting offset, and a parallel stream against the serial one
+static void Kat_CTR(KAT_RESULT& result, AES_ENGINE engine) {
+	for (const KAT_MODE& v : ctrVectors) {
+		std::vector<uint8_t> key = Kat_Hex(v.key), counter = Kat_Hex(v.iv), plaintext = Kat_Hex(v.plaintext), ciphertext = Kat_Hex(v.ciphertext);
+
+		AES aes;
+		aes.Init(key.data(), key.size());
+		aes.SetEngine(engine);
+
+		std::vector<uint8_t> out(plaintext.size());
+		aes.EncryptCTR(plaintext.data(), out.data(), plaintext.size(), counter.data());
+		Kat_Check(result, v.name, engineNames[engine], "EncryptCTR", out.data(), ciphertext);
+
+		for (size_t offset = 1; offset < ciphertext.size(); offset++) {
+			std::vector<uint8_t> expected(plaintext.begin() + offset, plaintext.end());
+			aes.DecryptCTR(ciphertext.data() + offset, out.data(), ciphertext.size() - offset, counter.data(), offset);
+			Kat_Check(result, v.name, engineNames[engine], "DecryptCTR at an offset", out.data(), expected);
+		}
+	}
+
+	//Chunks on four threads must join into the serial keystream
+	std::vector<uint8_t> key = Kat_Hex(KAT_38A_KEY), counter = Kat_Hex(ctrVectors[0].iv);
+	std::vector<uint8_t> src(KAT_STREAM_BLOCKS * 16 + 7), serial(src.size()), parallel(src.size());
+	for (size_t i = 0; i < src.size(); i++)
+		src[i] = (uint8_t)i;
+
+	AES aes;
+	aes.Init(key.data(), key.size());
+	aes.SetEngine(engine);
+	aes.SetThreadNum(1);
+	aes.EncryptCTR(src.data(), serial.data(), src.size(), counter.data());
+
+	aes.SetThreadNum(4);
+	aes.SetParallelMinSize(16);
+	aes.EncryptCTR(src.data(), parallel.data(), src.size(), counter.data());
+	Kat_Check(result, "CTR stream", engineNames[engine], "parallel EncryptCTR", parallel.data(), serial);
+
+	//NULL pointers are errors, an empty stream is not
+	const uint8_t* constSrc = src.data();
+	Kat_Expect(result, !aes.EncryptCTR(NULL, serial.data(), 16, counter.data()), "CTR stream", engineNames[engine], "EncryptCTR rejected a NULL src");
+	Kat_Expect(result, !aes.DecryptCTR(constSrc, NULL, 16, counter.data()), "CTR stream", engineNames[engine], "DecryptCTR rejected a NULL dst");
+	Kat_Expect(result, !aes.EncryptCTR(constSrc, serial.data(), 16, NULL), "CTR stream", engineNames[engine], "EncryptCTR rejected a NULL counter");
+	Kat_Expect(result, aes.EncryptCTR(constSrc, serial.data(), 0, counter.data()), "CTR stream", engineNames[engine], "EncryptCTR accepted an empty stream");
+}
+
+//CBC vectors one shot, chained over two calls and as lanes of EncryptStreamsCBC, and a parallel decryption
+static void Kat_CBC(KAT_RESULT& result, AES_ENGINE engine) {
+	for (const KAT_MODE& v : cbcVectors) {
+		std::vector<uint8_t> key = Kat_Hex(v.key), iv = Kat_Hex(v.iv), plaintext = Kat_Hex(v.plaintext), ciphertext = Kat_Hex(v.ciphertext);
+
+		AES aes;
+		aes.Init(key.data(), key.size());
+		aes.SetEngine(engine);
+
+		size_t length = 0;
+		uint8_t* out = aes.EncryptCBC(plaintext.data(), plaintext.size(), &length, iv.data(), false);
+		if (Kat_Expect(result, out != NULL, v.name, engineNames[engine], "EncryptCBC returned a buffer"))
+			Kat_Check(result, v.name, engineNames[engine], "EncryptCBC", out, ciphertext);
+		free(out);
+
+		out = aes.DecryptCBC(ciphertext.data(), ciphertext.size(), &length, iv.data(), false);
+		if (Kat_Expect(result, out != NULL, v.name, engineNames[engine], "DecryptCBC returned a buffer"))
+			Kat_Check(result, v.name, engineNames[engine], "DecryptCBC", out, plaintext);
+		free(out);
+
+		//The IV carries the chain from one call to the next
+		std::vector<uint8_t> stream = plaintext, chain = iv;
+		aes.EncryptStreamOriginCBC(stream.data(), 32, chain.data());
+		aes.EncryptStreamOriginCBC(stream.data() + 32, stream.size() - 32, chain.data());
+		Kat_Check(result, v.name, engineNames[engine], "chained EncryptStreamOriginCBC", stream.data(), ciphertext);
+
+		chain = iv;
+		aes.DecryptStreamOriginCBC(stream.data(), 32, chain.data());
+		aes.DecryptStreamOriginCBC(stream.data() + 32, stream.size() - 32, chain.data());
+		Kat_Check(result, v.name, engineNames[engine], "chained DecryptStreamOriginCBC", stream.data(), plaintext);
+
+		//Prefixes of the message as independent lanes, each must match the vector's prefix
+		const size_t lanes = 5;
+		std::vector<std::vector<uint8_t>> streams(lanes, plaintext), ivs(lanes, iv);
+		uint8_t* streamPtrs[lanes];
+		uint8_t* ivPtrs[lanes];
+		size_t lengths[lanes];
+		for (size_t l = 0; l < lanes; l++) {
+			streamPtrs[l] = streams[l].data();
+			ivPtrs[l] = ivs[l].data();
+			lengths[l] = plaintext.size() - (l % 4) * 16;
+		}
+
+		aes.EncryptStreamsCBC(streamPtrs, lengths, ivPtrs, lanes);
+		for (size_t l = 0; l < lanes; l++) {
+			std::vector<uint8_t> expected(ciphertext.begin(), ciphertext.begin() + lengths[l]);
+			Kat_Check(result, v.name, engineNames[engine], "EncryptStreamsCBC lane", streams[l].data(), expected);
+		}
+	}
+
+	//Chunks decrypted on four threads must join into the serial result
+	std::vector<uint8_t> key = Kat_Hex(KAT_38A_KEY), iv = Kat_Hex(cbcVectors[0].iv);
+	std::vector<uint8_t> plaintext(KAT_STREAM_BLOCKS * 16);
+	for (size_t i = 0; i < plaintext.size(); i++)
+		plaintext[i] = (uint8_t)i;
+
+	AES aes;
+	aes.Init(key.data(), key.size());
+	aes.SetEngine(engine);
+
+	std::vector<uint8_t> stream = plaintext, chain = iv;
+	aes.EncryptStreamOriginCBC(stream.data(), stream.size(), chain.data());
+	std::vector<uint8_t> lastBlock(stream.end() - 16, stream.end());
+
+	aes.SetThreadNum(4);
+	aes.SetParallelMinSize(16);
+	chain = iv;
+	aes.DecryptStreamOriginCBC(stream.data(), stream.size(), chain.data());
+	Kat_Check(result, "CBC stream", engineNames[engine], "parallel DecryptStreamOriginCBC", stream.data(), plaintext);
+	Kat_Check(result, "CBC stream", engineNames[engine], "parallel DecryptStreamOriginCBC IV", chain.data(), lastBlock);
+
+	Kat_Expect(result, !aes.DecryptStreamOriginCBC(NULL, 16, chain.data()), "CBC stream", engineNames[engine], "DecryptStreamOriginCBC rejected a NULL stream");
+	Kat_Expect(result, !aes.DecryptStreamOriginCBC(stream.data(), 16, NULL), "CBC stream", engineNames[engine], "DecryptStreamOriginCBC rejected a NULL iv");
+}
+
+//GCM vectors one shot and in uneven pieces, a flipped tag bit must be rejected
+static void Kat_GCMVectors(KAT_RESULT& result, AES_ENGINE engine, bool clmul, const char* label) {
+	for (const KAT_GCM& v : gcmVectors) {
+		std::vector<uint8_t> key = Kat_Hex(v.key), iv = Kat_Hex(v.iv), aad = Kat_Hex(v.aad);
+		std::vector<uint8_t> plaintext = Kat_Hex(v.plaintext), ciphertext = Kat_Hex(v.ciphertext), tag = Kat_Hex(v.tag);
+
+		AES aes;
+		aes.Init(key.data(), key.size());
+		aes.SetEngine(engine);
+		AESGCM gcm(aes);
+		gcm.SetClmul(clmul);
+
+		//One spare byte keeps data() valid for the empty messages
+		std::vector<uint8_t> out(plaintext.size() + 1), gotTag(16);
+		int code = gcm.Encrypt(iv.data(), iv.size(), aad.data(), aad.size(), plaintext.data(), out.data(), plaintext.size(), gotTag.data());
+		Kat_Expect(result, code == 0x00, v.name, label, "Encrypt returned 0x00");
+		Kat_Check(result, v.name, label, "Encrypt ciphertext", out.data(), ciphertext);
+		Kat_Check(result, v.name, label, "Encrypt tag", gotTag.data(), tag);
+
+		code = gcm.Decrypt(iv.data(), iv.size(), aad.data(), aad.size(), ciphertext.data(), out.data(), ciphertext.size(), tag.data());
+		Kat_Expect(result, code == 0x00, v.name, label, "Decrypt returned 0x00");
+		Kat_Check(result, v.name, label, "Decrypt plaintext", out.data(), plaintext);
+
+		//AAD in 3 byte and data in 7 byte pieces
+		gcm.Start(iv.data(), iv.size());
+		for (size_t i = 0; i < aad.size(); i += 3)
+			gcm.UpdateAAD(aad.data() + i, aad.size() - i < 3 ? aad.size() - i : 3);
+		for (size_t i = 0; i < plaintext.size(); i += 7)
+			gcm.EncryptUpdate(plaintext.data() + i, out.data() + i, plaintext.size() - i < 7 ? plaintext.size() - i : 7);
+		gcm.EncryptFinal(gotTag.data());
+		Kat_Check(result, v.name, label, "split EncryptUpdate ciphertext", out.data(), ciphertext);
+		Kat_Check(result, v.name, label, "split EncryptUpdate tag", gotTag.data(), tag);
+
+		tag[15] ^= 0x01;
+		code = gcm.Decrypt(iv.data(), iv.size(), aad.data(), aad.size(), ciphertext.data(), out.data(), ciphertext.size(), tag.data());
+		Kat_Expect(result, code == 0x03, v.name, label, "Decrypt rejected a flipped tag bit");
+	}
+}
+
+//Long GCM messages: the tag against OpenSSL, the ciphertext against CTR from the first counter block (IV || 2)
+static void Kat_GCMLong(KAT_RESULT& result, AES_ENGINE engine, bool clmul, const char* label) {
+	std::vector<uint8_t> iv = Kat_Hex(KAT_GCM_IV), aad = Kat_Hex(KAT_GCM_AAD);
+	std::vector<uint8_t> counter = iv;
+	counter.insert(counter.end(), { 0x00, 0x00, 0x00, 0x02 });
+
+	for (const KAT_GCM_LONG& v : gcmLongVectors) {
+		std::vector<uint8_t> key = Kat_Hex(v.key);
+
+		AES aes;
+		aes.Init(key.data(), key.size());
+		aes.SetEngine(engine);
+
+		std::vector<uint8_t> plaintext(v.length), ciphertext(v.length), out(v.length), tag = Kat_Hex(v.tag), gotTag(16);
+		for (size_t i = 0; i < v.length; i++)
+			plaintext[i] = (uint8_t)i;
+		aes.EncryptCTR(plaintext.data(), ciphertext.data(), v.length, counter.data());
+
+		AESGCM gcm(aes);
+		gcm.SetClmul(clmul);
+
+		int code = gcm.Encrypt(iv.data(), iv.size(), aad.data(), aad.size(), plaintext.data(), out.data(), v.length, gotTag.data());
+		Kat_Expect(result, code == 0x00 && out == ciphertext, v.name, label, "Encrypt ciphertext matches EncryptCTR");
+		Kat_Check(result, v.name, label, "Encrypt tag", gotTag.data(), tag);
+
+		code = gcm.Decrypt(iv.data(), iv.size(), aad.data(), aad.size(), ciphertext.data(), out.data(), v.length, tag.data());
+		Kat_Expect(result, code == 0x00 && out == plaintext, v.name, label, "Decrypt returned the plaintext");
+	}
+}
+
+//GCM on one engine with every GHASH implementation this CPU has
+static void Kat_GCM(KAT_RESULT& result, AES_ENGINE engine) {
+	for (int clmul = 1; clmul >= 0; clmul--) {
+		AES probe;
+		if (clmul && !AESGCM(probe).SetClmul(true))	continue;
+
+		char label[40];
+		snprintf(label, sizeof(label), "%s, %s GHASH", engineNames[engine], clmul ? "clmul" : "table");
+
+		Kat_GCMVectors(result, engine, clmul != 0, label);
+		Kat_GCMLong(result, engine, clmul != 0, label);
+	}
+}
+
+//Keys through a two entry cache: hits, misses, eviction, and an evicted schedule that is still in use
+static void Kat_KeyCache(KAT_RESULT& result, AES_ENGINE engine) {
+	std::shared_ptr<AESKeyCache> cache = std::make_shared<AESKeyCache>(2);
+
+	//B, C.1 and C.2: the third key evicts the first one
+	std::vector<AES> objects(3);
+	for (size_t i = 0; i < objects.size(); i++) {
+		std::vector<uint8_t> key = Kat_Hex(blockVectors[i].key);
+		objects[i].SetKeyCache(cache);
+		objects[i].Init(key.data(), key.size());
+		objects[i].SetEngine(engine);
+	}
+	Kat_Expect(result, cache->GetMisses() == 3 && cache->GetHits() == 0 && cache->GetSize() == 2, "key cache", engineNames[engine], "three new keys fill two entries");
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		std::vector<uint8_t> block = Kat_Hex(blockVectors[i].plaintext);
+		objects[i].EncryptBlock(block.data());
+		Kat_Check(result, blockVectors[i].name, engineNames[engine], "EncryptBlock on a cached key", block.data(), Kat_Hex(blockVectors[i].ciphertext));
+	}
+
+	//C.2 is still cached, B was evicted
+	std::vector<uint8_t> key = Kat_Hex(blockVectors[2].key);
+	AES again;
+	again.SetKeyCache(cache);
+	again.Init(key.data(), key.size());
+	Kat_Expect(result, cache->GetHits() == 1 && cache->GetMisses() == 3, "key cache", engineNames[engine], "a cached key is a hit");
+
+	key = Kat_Hex(blockVectors[0].key);
+	again.Init(key.data(), key.size());
+	again.SetEngine(engine);
+	Kat_Expect(result, cache->GetHits() == 1 && cache->GetMisses() == 4, "key cache", engineNames[engine], "an evicted key is a miss");
+
+	std::vector<uint8_t> block = Kat_Hex(blockVectors[0].plaintext);
+	again.EncryptBlock(block.data());
+	Kat_Check(result, blockVectors[0].name, engineNames[engine], "EncryptBlock on a key expanded again", block.data(), Kat_Hex(blockVectors[0].ciphertext));
+}
+
+//ECB vectors into caller buffers: padded, in place, too small, bad padding and a partial block
+static void Kat_Into(KAT_RESULT& result, AES_ENGINE engine) {
+	for (const KAT_MODE& v : ecbVectors) {
+		std::vector<uint8_t> key = Kat_Hex(v.key), plaintext = Kat_Hex(v.plaintext), ciphertext = Kat_Hex(v.ciphertext);
+
+		AES aes;
+		aes.Init(key.data(), key.size());
+		aes.SetEngine(engine);
+
+		std::vector<uint8_t> out(AES::GetEncryptedSize(plaintext.size()));
+		size_t length = 0;
+		int code = aes.EncryptInto(plaintext.data(), plaintext.size(), out.data(), out.size(), &length);
+		Kat_Expect(result, code == 0x00 && length == ciphertext.size(), v.name, engineNames[engine], "EncryptInto returned the padded length");
+		Kat_Check(result, v.name, engineNames[engine], "EncryptInto", out.data(), ciphertext);
+
+		code = aes.DecryptInto(ciphertext.data(), ciphertext.size(), out.data(), out.size(), &length);
+		Kat_Expect(result, code == 0x00 && length == plaintext.size(), v.name, engineNames[engine], "DecryptInto stripped the padding");
+		Kat_Check(result, v.name, engineNames[engine], "DecryptInto", out.data(), plaintext);
+
+		std::vector<uint8_t> buffer = plaintext;
+		buffer.resize(out.size());
+		aes.EncryptInto(buffer.data(), plaintext.size(), buffer.data(), buffer.size(), &length);
+		Kat_Check(result, v.name, engineNames[engine], "EncryptInto in place", buffer.data(), ciphertext);
+
+		code = aes.EncryptInto(plaintext.data(), plaintext.size(), out.data(), out.size() - 1, &length);
+		Kat_Expect(result, code == 0x02, v.name, engineNames[engine], "EncryptInto rejected a short buffer");
+
+		//Without the padding block the last plaintext byte (0x10) claims a whole block of padding
+		code = aes.DecryptInto(ciphertext.data(), plaintext.size(), out.data(), out.size(), &length);
+		Kat_Expect(result, code == 0x04, v.name, engineNames[engine], "DecryptInto rejected a bad padding");
+
+		size_t decryptedLength = 0;
+		uint8_t* decrypted = aes.Decrypt(ciphertext.data(), plaintext.size(), &decryptedLength, true);
+		Kat_Expect(result, decrypted == NULL, v.name, engineNames[engine], "Decrypt rejected a bad padding");
+		free(decrypted);
+
+		//A last byte of 0xFF must not be taken as a length
+		std::vector<uint8_t> ff(16, 0xFF);
+		uint8_t* ffCipher = aes.Encrypt(ff.data(), ff.size(), &length, false);
+		decrypted = aes.Decrypt(ffCipher, length, &decryptedLength, true);
+		Kat_Expect(result, decrypted == NULL, v.name, engineNames[engine], "Decrypt rejected a 0xFF padding byte");
+		free(decrypted);
+		free(ffCipher);
+
+		std::vector<uint8_t> partial(plaintext.begin(), plaintext.begin() + 21), back(32);
+		aes.EncryptInto(partial.data(), partial.size(), out.data(), out.size(), &length);
+		code = aes.DecryptInto(out.data(), length, back.data(), back.size(), &length);
+		Kat_Expect(result, code == 0x00 && length == partial.size(), v.name, engineNames[engine], "21 byte round trip kept the length");
+		Kat_Check(result, v.name, engineNames[engine], "21 byte round trip", back.data(), partial);
+	}
+}
+
+//Feed a message through Update in uneven fragments (1, 5, 16, 17, 3 bytes, repeating), then Final
+template <class STREAMER>
+static bool Kat_Feed(STREAMER& streamer, const std::vector<uint8_t>& src, std::vector<uint8_t>& dst) {
+	static const size_t fragments[] = { 1, 5, 16, 17, 3 };
+
+	dst.clear();
+	size_t pos = 0;
+	for (size_t f = 0; pos < src.size(); f++) {
+		size_t length = fragments[f % 5] < src.size() - pos ? fragments[f % 5] : src.size() - pos;
+		std::vector<uint8_t> out(streamer.GetUpdateSize(length) + 1);
+		size_t outLength = 0;
+		if (streamer.Update(src.data() + pos, length, out.data(), &outLength) != 0x00)	return false;
+		dst.insert(dst.end(), out.begin(), out.begin() + outLength);
+		pos += length;
+	}
+
+	uint8_t last[16];
+	size_t lastLength = 0;
+	if (streamer.Final(last, &lastLength) != 0x00)	return false;
+	dst.insert(dst.end(), last, last + lastLength);
+	return true;
+}
+
+//ECB and CBC vectors through the streaming classes, with the padding block and after a Reset
+static void Kat_Streaming(KAT_RESULT& result, AES_ENGINE engine) {
+	std::vector<uint8_t> key = Kat_Hex(KAT_38A_KEY), iv = Kat_Hex(cbcVectors[0].iv), plaintext = Kat_Hex(KAT_38A_PT);
+	std::vector<uint8_t> ecb = Kat_Hex(ecbVectors[0].ciphertext), out;
+
+	AES aes;
+	aes.Init(key.data(), key.size());
+	aes.SetEngine(engine);
+
+	AESEncryptor encryptor(aes);
+	bool ok = Kat_Feed(encryptor, plaintext, out);
+	if (Kat_Expect(result, ok && out.size() == ecb.size(), ecbVectors[0].name, engineNames[engine], "AESEncryptor wrote the padded length"))
+		Kat_Check(result, ecbVectors[0].name, engineNames[engine], "AESEncryptor", out.data(), ecb);
+
+	AESDecryptor decryptor(aes);
+	ok = Kat_Feed(decryptor, ecb, out);
+	if (Kat_Expect(result, ok && out.size() == plaintext.size(), ecbVectors[0].name, engineNames[engine], "AESDecryptor stripped the padding"))
+		Kat_Check(result, ecbVectors[0].name, engineNames[engine], "AESDecryptor", out.data(), plaintext);
+
+	//The vector without its padding block ends in a malformed padding
+	decryptor.Reset();
+	ok = Kat_Feed(decryptor, std::vector<uint8_t>(ecb.begin(), ecb.begin() + plaintext.size()), out);
+	Kat_Expect(result, !ok, ecbVectors[0].name, engineNames[engine], "AESDecryptor rejected a bad padding");
+
+	std::vector<uint8_t> ff(16, 0xFF);
+	size_t ffLength = 0;
+	uint8_t* ffCipher = aes.Encrypt(ff.data(), ff.size(), &ffLength, false);
+	decryptor.Reset();
+	ok = Kat_Feed(decryptor, std::vector<uint8_t>(ffCipher, ffCipher + ffLength), out);
+	Kat_Expect(result, !ok, ecbVectors[0].name, engineNames[engine], "AESDecryptor rejected a 0xFF padding byte");
+	free(ffCipher);
+
+	//CBC with padding: the first blocks are the vector, the whole message must match EncryptCBC
+	size_t cbcLength = 0;
+	uint8_t* cbcBuffer = aes.EncryptCBC(plaintext.data(), plaintext.size(), &cbcLength, iv.data());
+	std::vector<uint8_t> cbc(cbcBuffer, cbcBuffer + cbcLength);
+	free(cbcBuffer);
+	Kat_Check(result, cbcVectors[0].name, engineNames[engine], "EncryptCBC with padding", cbc.data(), Kat_Hex(cbcVectors[0].ciphertext));
+
+	AESEncryptor cbcEncryptor(aes, iv.data());
+	for (int run = 0; run < 2; run++) {
+		ok = Kat_Feed(cbcEncryptor, plaintext, out);
+		if (Kat_Expect(result, ok && out.size() == cbc.size(), cbcVectors[0].name, engineNames[engine], "CBC AESEncryptor wrote the padded length"))
+			Kat_Check(result, cbcVectors[0].name, engineNames[engine], run == 0 ? "CBC AESEncryptor" : "CBC AESEncryptor after Reset", out.data(), cbc);
+		cbcEncryptor.Reset(iv.data());
+	}
+
+	AESDecryptor cbcDecryptor(aes, iv.data());
+	ok = Kat_Feed(cbcDecryptor, cbc, out);
+	if (Kat_Expect(result, ok && out.size() == plaintext.size(), cbcVectors[0].name, engineNames[engine], "CBC AESDecryptor stripped the padding"))
+		Kat_Check(result, cbcVectors[0].name, engineNames[engine], "CBC AESDecryptor", out.data(), plaintext);
+}
+
+//Whole file as a byte vector
+static std::vector<uint8_t> Kat_ReadFile(const char* fileName) {
+	std::vector<uint8_t> data;
+	FILE* file = AES::OpenFile(fileName, "rb");
+	if (file == NULL)	return data;
+
+	uint8_t buffer[4096];
+	size_t got;
+	while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0)	data.insert(data.end(), buffer, buffer + got);
+	fclose(file);
+	return data;
+}
+
+//
+static bool Kat_WriteFile(const char* fileName, const std::vector<uint8_t>& data) {
+	FILE* file = AES::OpenFile(fileName, "wb");
+	if (file == NULL)	return false;
+	bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+	return fclose(file) == 0 && ok;
+}
+
+//EncryptFileToFile must write the same bytes as Encrypt, DecryptFileToFile must give the file back
+static void Kat_Files(KAT_RESULT& result, AES_FILE_MODE mode) {
+	static const size_t sizes[] = { 1, 16, 4109, AES_FILE_BUFFER_SIZE, AES_FILE_BUFFER_SIZE + 21, 3 * AES_FILE_BUFFER_SIZE + 4109 };
+	char plainName[] = "aes_kat_plain.tmp", cipherName[] = "aes_kat_cipher.tmp", outputName[] = "aes_kat_output.tmp";
+	char name[64];
+
+	std::vector<uint8_t> key = Kat_Hex(KAT_38A_KEY);
+	AES aes;
+	aes.Init(key.data(), key.size());
+	aes.SetFileMode(mode);
+	aes.SetFileQueueDepth(2);		//Few io_uring buffers, so the larger files reuse them
+	aes.SetThreadNum(3);			//More parallel ranges than threads for the largest file
+	const char* label = fileModeNames[mode];
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		snprintf(name, sizeof(name), "file, %zu bytes", sizes[i]);
+
+		std::vector<uint8_t> plaintext(sizes[i]);
+		for (size_t b = 0; b < plaintext.size(); b++)	plaintext[b] = (uint8_t)(b * 7 + 3);
+
+		size_t expectedLength = 0;
+		uint8_t* expectedBuffer = aes.Encrypt(plaintext.data(), plaintext.size(), &expectedLength);
+		std::vector<uint8_t> expected(expectedBuffer, expectedBuffer + expectedLength);
+		free(expectedBuffer);
+
+		if (!Kat_Expect(result, Kat_WriteFile(plainName, plaintext), name, label, "plaintext file written"))	continue;
+
+		int encrypted = aes.EncryptFileToFile(plainName, cipherName);
+		std::vector<uint8_t> ciphertext = Kat_ReadFile(cipherName);
+		if (Kat_Expect(result, encrypted == 0x00 && ciphertext.size() == expected.size(), name, label, "EncryptFileToFile wrote the padded length"))
+			Kat_Check(result, name, label, "EncryptFileToFile", ciphertext.data(), expected);
+
+		size_t decrypted = aes.DecryptFileToFile(cipherName, outputName);
+		std::vector<uint8_t> output = Kat_ReadFile(outputName);
+		if (Kat_Expect(result, decrypted == 0x00 && output.size() == plaintext.size(), name, label, "DecryptFileToFile stripped the padding"))
+			Kat_Check(result, name, label, "DecryptFileToFile", output.data(), plaintext);
+	}
+
+	//Two encrypted zero blocks without a padding block decrypt to a last byte of 0x00
+	std::vector<uint8_t> zeros(32, 0x00);
+	size_t unpaddedLength = 0;
+	uint8_t* unpadded = aes.Encrypt(zeros.data(), zeros.size(), &unpaddedLength, false);
+	Kat_WriteFile(cipherName, std::vector<uint8_t>(unpadded, unpadded + unpaddedLength));
+	free(unpadded);
+	Kat_Expect(result, aes.DecryptFileToFile(cipherName, outputName) == 0x07, "file, bad padding", label, "DecryptFileToFile returned 0x07");
+	Kat_Expect(result, Kat_ReadFile(outputName).empty(), "file, bad padding", label, "DecryptFileToFile left no output");
+
+	remove(plainName);
+	remove(cipherName);
+	remove(outputName);
+}
+
+//Encrypt and decrypt a batch on three workers, every file must match Encrypt in memory
+static void Kat_Batch(KAT_RESULT& result) {
+	static const size_t sizes[] = { 1, 16, 4109, AES_FILE_BUFFER_SIZE + 21, 2 * AES_FILE_BUFFER_SIZE + 17, 31 };
+	const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+	char name[64];
+
+	std::vector<uint8_t> key = Kat_Hex(KAT_38A_KEY);
+	AES aes;
+	aes.Init(key.data(), key.size());
+
+	std::vector<std::vector<uint8_t>> plaintexts(count), expected(count);
+	std::vector<std::string> plainNames(count), cipherNames(count), outputNames(count);
+	AESBatch encryptBatch(aes), decryptBatch(aes);
+	encryptBatch.SetThreadNum(3);
+	decryptBatch.SetThreadNum(3);
+
+	for (size_t i = 0; i < count; i++) {
+		plainNames[i] = "aes_kat_batch" + std::to_string(i) + ".plain";
+		cipherNames[i] = "aes_kat_batch" + std::to_string(i) + ".enc";
+		outputNames[i] = "aes_kat_batch" + std::to_string(i) + ".out";
+
+		plaintexts[i].resize(sizes[i]);
+		for (size_t b = 0; b < sizes[i]; b++)	plaintexts[i][b] = (uint8_t)(b * 13 + i);
+
+		size_t expectedLength = 0;
+		uint8_t* expectedBuffer = aes.Encrypt(plaintexts[i].data(), plaintexts[i].size(), &expectedLength);
+		expected[i].assign(expectedBuffer, expectedBuffer + expectedLength);
+		free(expectedBuffer);
+
+		Kat_WriteFile(plainNames[i].c_str(), plaintexts[i]);
+		encryptBatch.Add(plainNames[i].c_str(), cipherNames[i].c_str());
+		decryptBatch.Add(cipherNames[i].c_str(), outputNames[i].c_str());
+	}
+
+	//Two encrypted zero blocks without a padding block decrypt to a last byte of 0x00
+	std::vector<uint8_t> zeros(32, 0x00);
+	size_t unpaddedLength = 0;
+	uint8_t* unpadded = aes.Encrypt(zeros.data(), zeros.size(), &unpaddedLength, false);
+	Kat_WriteFile("aes_kat_batch_bad.enc", std::vector<uint8_t>(unpadded, unpadded + unpaddedLength));
+	free(unpadded);
+	decryptBatch.Add("aes_kat_batch_bad.enc", "aes_kat_batch_bad.out");
+
+	Kat_Expect(result, encryptBatch.EncryptFiles() == 0, "batch", "default", "EncryptFiles had no failures");
+	Kat_Expect(result, decryptBatch.DecryptFiles() == 1, "batch", "default", "DecryptFiles failed only the bad padding");
+	Kat_Expect(result, decryptBatch.GetFiles()[count].status == 0x07, "batch, bad padding", "default", "status 0x07");
+
+	for (size_t i = 0; i < count; i++) {
+		snprintf(name, sizeof(name), "batch, %zu bytes", sizes[i]);
+
+		std::vector<uint8_t> ciphertext = Kat_ReadFile(cipherNames[i].c_str());
+		if (Kat_Expect(result, encryptBatch.GetFiles()[i].status == 0x00 && ciphertext.size() == expected[i].size(), name, "default", "EncryptFiles wrote the padded length"))
+			Kat_Check(result, name, "default", "EncryptFiles", ciphertext.data(), expected[i]);
+
+		std::vector<uint8_t> output = Kat_ReadFile(outputNames[i].c_str());
+		if (Kat_Expect(result, decryptBatch.GetFiles()[i].status == 0x00 && output.size() == plaintexts[i].size(), name, "default", "DecryptFiles stripped the padding"))
+			Kat_Check(result, name, "default", "DecryptFiles", output.data(), plaintexts[i]);
+
+		remove(plainNames[i].c_str());
+		remove(cipherNames[i].c_str());
+		remove(outputNames[i].c_str());
+	}
+	remove("aes_kat_batch_bad.enc");
+	remove("aes_kat_batch_bad.out");
+}
+
+//Container round trip and random access reads, on three threads and small chunks
+static void Kat_Container(KAT_RESULT& result, AES_CONTAINER_MODE mode) {
+	static const uint64_t ranges[][2] = { { 0, 1 }, { 4095, 2 }, { 12345, 20000 }, { 0, 50021 }, { 50014, 7 } };
+	char plainName[] = "aes_kat_plain.tmp", containerName[] = "aes_kat_container.tmp", outputName[] = "aes_kat_output.tmp";
+	const char* label = mode == AES_CONTAINER_GCM ? "container, GCM" : "container, CTR";
+	char what[64];
+
+	std::vector<uint8_t> key = Kat_Hex(KAT_38A_KEY);
+	AES aes;
+	aes.Init(key.data(), key.size());
+
+	std::vector<uint8_t> plaintext(50021);
+	for (size_t b = 0; b < plaintext.size(); b++)	plaintext[b] = (uint8_t)(b * 11 + 5);
+	Kat_WriteFile(plainName, plaintext);
+
+	AESContainer container(aes);
+	container.SetFormat(mode, 4096);
+	container.SetThreadNum(3);
+
+	Kat_Expect(result, container.EncryptFileToContainer(plainName, containerName) == 0x00, label, "default", "EncryptFileToContainer");
+	Kat_Expect(result, container.DecryptContainerToFile(containerName, outputName) == 0x00, label, "default", "DecryptContainerToFile");
+	std::vector<uint8_t> output = Kat_ReadFile(outputName);
+	if (Kat_Expect(result, output.size() == plaintext.size(), label, "default", "DecryptContainerToFile wrote the plaintext length"))
+		Kat_Check(result, label, "default", "DecryptContainerToFile", output.data(), plaintext);
+
+	if (!Kat_Expect(result, container.Open(containerName) == 0x00, label, "default", "Open"))	return;
+
+	for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+		snprintf(what, sizeof(what), "DecryptRange(%llu, %llu)", (unsigned long long)ranges[r][0], (unsigned long long)ranges[r][1]);
+		std::vector<uint8_t> range((size_t)ranges[r][1]);
+		std::vector<uint8_t> expected(plaintext.begin() + ranges[r][0], plaintext.begin() + ranges[r][0] + ranges[r][1]);
+		if (Kat_Expect(result, container.DecryptRange(ranges[r][0], range.size(), range.data()) == 0x00, label, "default", what))
+			Kat_Check(result, label, "default", what, range.data(), expected);
+	}
+
+	uint8_t past[4];
+	Kat_Expect(result, container.DecryptRange(plaintext.size() - 3, sizeof(past), past) == 0x08, label, "default", "range past the end returned 0x08");
+
+	std::vector<uint8_t> stored = Kat_ReadFile(containerName);
+	std::vector<uint8_t> nonce(container.GetHeader().nonce, container.GetHeader().nonce + 16);
+	if (mode == AES_CONTAINER_CTR) {
+		//One keystream from nonce[0..7] || 0, the chunks follow the header
+		uint8_t counter[16] = { 0 };
+		memcpy(counter, container.GetHeader().nonce, 8);
+		std::vector<uint8_t> ctr(plaintext.size());
+		aes.EncryptCTR(plaintext.data(), ctr.data(), plaintext.size(), counter);
+		if (Kat_Expect(result, stored.size() >= AES_CONTAINER_HEADER_SIZE + ctr.size(), label, "default", "container holds the whole ciphertext"))
+			Kat_Check(result, label, "default", "chunks against EncryptCTR", stored.data() + AES_CONTAINER_HEADER_SIZE, ctr);
+	}
+	container.Close();
+
+	if (mode == AES_CONTAINER_GCM && stored.size() > AES_CONTAINER_HEADER_SIZE + 2 * 4096) {
+		//A changed byte in the second chunk fails that chunk only
+		stored[AES_CONTAINER_HEADER_SIZE + 4096 + 100] ^= 0x01;
+		Kat_WriteFile(containerName, stored);
+
+		std::vector<uint8_t> range(64, 0xAA);
+		Kat_Expect(result, container.DecryptRange(containerName, 4096 + 90, range.size(), range.data()) == 0x07, label, "default", "changed chunk returned 0x07");
+		Kat_Expect(result, range == std::vector<uint8_t>(range.size(), 0x00), label, "default", "changed chunk zeroed the range");
+		Kat_Expect(result, container.DecryptRange(containerName, 0, range.size(), range.data()) == 0x00, label, "default", "first chunk still decrypts");
+	}
+
+	//Every container gets a fresh nonce from the OS
+	container.EncryptFileToContainer(plainName, containerName);
+	if (Kat_Expect(result, container.Open(containerName) == 0x00, label, "default", "second container opens"))
+		Kat_Expect(result, memcmp(container.GetHeader().nonce, nonce.data(), 16) != 0, label, "default", "second container has a new nonce");
+	container.Close();
+
+	remove(plainName);
+	remove(containerName);
+	remove(outputName);
+}
+
+//
+int main() {
+	KAT_RESULT result;
+
+	for (int e = 0; e < (int)(sizeof(engineNames) / sizeof(engineNames[0])); e++) {
+		AES probe;
+		if (!probe.SetEngine((AES_ENGINE)e)) {
+			printf("skip [%s]: not supported by this CPU\n", engineNames[e]);
+			continue;
+		}
+
+		Kat_Blocks(result, (AES_ENGINE)e);
+		Kat_Streams(result, (AES_ENGINE)e);
+		Kat_Into(result, (AES_ENGINE)e);
+		Kat_Streaming(result, (AES_ENGINE)e);
+		Kat_Shared(result, (AES_ENGINE)e);
+		Kat_CTR(result, (AES_ENGINE)e);
+		Kat_CBC(result, (AES_ENGINE)e);
+		Kat_GCM(result, (AES_ENGINE)e);
+		Kat_KeyCache(result, (AES_ENGINE)e);
+	}
+
+	for (int m = 0; m < (int)(sizeof(fileModeNames) / sizeof(fileModeNames[0])); m++)
+		Kat_Files(result, (AES_FILE_MODE)m);
+	Kat_Batch(result);
+	Kat_Container(result, AES_CONTAINER_GCM);
+	Kat_Container(result, AES_CONTAINER_CTR);
+
+	printf("%d checks, %d failures\n", result.checks, result.failures);
+	return result.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,613 @@
+/*
+
+	CPython extension module "aes_native": the C++ AES class behind the interface of Python/AES/aes_class.py
+
+	Build (from C++/AES):
+		g++ -O2 -std=c++17 -fopenmp -shared -fPIC $(python3-config --includes) -I. python/aes_python.cpp aes*.cpp -o aes_native$(python3-config --extension-suffix) -lpthread
+		cl /O2 /std:c++17 /openmp /LD /I. /I<python>\include python\aes_python.cpp aes*.cpp /link /LIBPATH:<python>\libs /OUT:aes_native.pyd
+
+	Usage (drop-in for aes_class.AES):
+		from aes_native import AES
+		aes = AES("0123456789abcdef", "PKCS7")
+		cipher = aes.EncryptStream(data)				# bytearray
+		plain = aes.DecryptStream(cipher)
+		aes.EncryptStream(data, out=buffer)				# zero-copy into a writable buffer, returns the length
+
+	Input can be anything with the buffer protocol (bytes, bytearray, memoryview, mmap, C-contiguous numpy arrays),
+	other sequences of ints are copied into a bytearray first. Streams of AESPY_GIL_MIN_SIZE bytes and more run
+	without the GIL, so Python threads encrypt in parallel (and large streams also use the OpenMP threads of the class).
+
+	Differences to aes_class.py: results are bytearray instead of list, keys can be 16, 24 or 32 bytes (str or
+	bytes-like), NOPAD never adds a block, ISO/IEC 9797-1 padding 1 and 2 are implemented, a bad PKCS7 padding
+	raises ValueError instead of returning a wrong length. The round helpers (SubstituteBytes, MixColumn, ...)
+	are not exposed.
+
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <new>
+
+#include "aes.h"
+
+#define AESPY_GIL_MIN_SIZE		( 4 * 1024 )				//Streams shorter than this keep the GIL (releasing it costs more than the cipher)
+
+/**
+*	Padding methods, the values of AES.PADLIST
+*/
+enum AESPY_PADDING : uint8_t {
+	AESPY_NOPAD = 0x00,				//No padding, length must be a multiple of 16
+	AESPY_PKCS7 = 0x01,				//PKCS#7
+	AESPY_979711 = 0x02,			//ISO/IEC 9797-1 method 1 (zero bytes, not removable)
+	AESPY_979712 = 0x03				//ISO/IEC 9797-1 method 2 (0x80 then zero bytes)
+};
+
+static const struct {
+	const char* name;
+	AESPY_PADDING padding;
+} paddingNames[] = {
+	{ "NOPAD", AESPY_NOPAD },
+	{ "PKCS7", AESPY_PKCS7 },
+	{ "979711", AESPY_979711 },
+	{ "979712", AESPY_979712 }
+};
+
+static const char* engineNames[] = { "reference", "ttable", "aesni", "bitslice" };
+
+/**
+*	Python object of the AES type
+*/
+struct AESPY_OBJECT {
+	PyObject_HEAD
+	AES* aes;						//Block cipher
+	AESPY_PADDING padding;			//Padding of EncryptStream / EncryptBlock and default of DecryptStream
+};
+
+/**
+*	Contiguous bytes of a Python object
+*/
+struct AESPY_BUFFER {
+	Py_buffer view = {};
+	PyObject* copy = NULL;			//bytearray made from a sequence without the buffer protocol
+	bool held = false;
+};
+
+//
+static void AESPy_Release(AESPY_BUFFER* buffer) {
+	if (buffer->held)	PyBuffer_Release(&buffer->view);
+	Py_XDECREF(buffer->copy);
+	buffer->held = false;
+	buffer->copy = NULL;
+}
+
+//Get the bytes of an object (zero-copy for the buffer protocol, a copy for lists of ints like aes_class.py accepts)
+static bool AESPy_GetInput(PyObject* object, AESPY_BUFFER* buffer) {
+	if (PyObject_GetBuffer(object, &buffer->view, PyBUF_C_CONTIGUOUS) == 0) {
+		buffer->held = true;
+		return true;
+	}
+
+	if (!PyErr_ExceptionMatches(PyExc_TypeError) || PyUnicode_Check(object))	return false;
+	PyErr_Clear();
+
+	buffer->copy = PyByteArray_FromObject(object);
+	if (buffer->copy == NULL)	return false;
+
+	if (PyObject_GetBuffer(buffer->copy, &buffer->view, PyBUF_C_CONTIGUOUS) != 0)	return false;
+	buffer->held = true;
+	return true;
+}
+
+//
+static bool AESPy_GetOutput(PyObject* object, AESPY_BUFFER* buffer) {
+	if (PyObject_GetBuffer(object, &buffer->view, PyBUF_C_CONTIGUOUS | PyBUF_WRITABLE) != 0)	return false;
+	buffer->held = true;
+	return true;
+}
+
+//
+static bool AESPy_ParsePadding(PyObject* name, AESPY_PADDING* padding) {
+	const char* text = PyUnicode_Check(name) ? PyUnicode_AsUTF8(name) : NULL;
+
+	for (size_t i = 0; text != NULL && i < sizeof(paddingNames) / sizeof(paddingNames[0]); i++) {
+		if (strcmp(text, paddingNames[i].name) == 0) {
+			*padding = paddingNames[i].padding;
+			return true;
+		}
+	}
+
+	PyErr_Clear();
+	PyErr_SetString(PyExc_KeyError, "AES: Invalid padding method!");
+	return false;
+}
+
+//Expand a key given as ASCII str (like aes_class.py) or bytes-like
+static bool AESPy_SetKey(AES* aes, PyObject* key) {
+	AESPY_BUFFER buffer;
+	bool ok;
+
+	if (PyUnicode_Check(key)) {
+		buffer.copy = PyUnicode_AsASCIIString(key);
+		if (buffer.copy == NULL)	return false;
+		ok = aes->Init((const uint8_t*)PyBytes_AS_STRING(buffer.copy), (size_t)PyBytes_GET_SIZE(buffer.copy));
+	}
+	else {
+		if (!AESPy_GetInput(key, &buffer))	return false;
+		ok = aes->Init((const uint8_t*)buffer.view.buf, (size_t)buffer.view.len);
+	}
+
+	AESPy_Release(&buffer);
+
+	if (!ok)	PyErr_SetString(PyExc_ValueError, "AES: Key must be 16, 24 or 32 bytes long!");
+	return ok;
+}
+
+//Ciphertext length of a plaintext
+static size_t AESPy_EncryptedSize(AESPY_PADDING padding, size_t length) {
+	switch (padding) {
+	case AESPY_NOPAD:	return length;
+	case AESPY_979711:	return length == 0 ? 16 : (length + 15) & ~(size_t)0x0F;
+	default:			return (length & ~(size_t)0x0F) + 16;
+	}
+}
+
+//Encrypt with padding into dst (AESPy_EncryptedSize bytes, may be src), returns the EncryptInto code
+static int AESPy_Encrypt(const AES& aes, AESPY_PADDING padding, const uint8_t* src, size_t length, uint8_t* dst) {
+	size_t outLength = 0;
+
+	if (padding == AESPY_PKCS7 || padding == AESPY_NOPAD)
+		return aes.EncryptInto(src, length, dst, AESPy_EncryptedSize(padding, length), &outLength, padding == AESPY_PKCS7);
+
+	//ISO/IEC 9797-1: whole blocks straight through, the padded last block is built on the stack
+	size_t whole = length & ~(size_t)0x0F;
+	int code = whole > 0 ? aes.EncryptInto(src, whole, dst, whole, &outLength, false) : 0x00;
+	if (code != 0x00)	return code;
+
+	size_t rest = length - whole;
+	if (padding == AESPY_979711 && rest == 0 && length > 0)	return 0x00;
+
+	uint8_t block[16] = { 0 };
+	memcpy(block, src + whole, rest);
+	if (padding == AESPY_979712)	block[rest] = 0x80;
+
+	aes.EncryptBlock(block);
+	memcpy(dst + whole, block, 16);
+	return 0x00;
+}
+
+//Decrypt into dst (length bytes, may be src), returns the DecryptInto code (0x04 bad padding)
+static int AESPy_Decrypt(const AES& aes, AESPY_PADDING padding, const uint8_t* src, size_t length, uint8_t* dst, size_t* dstLength) {
+	int code = aes.DecryptInto(src, length, dst, length, dstLength, padding == AESPY_PKCS7);
+	if (code != 0x00)	return code;
+
+	if (padding == AESPY_979712) {
+		size_t n = *dstLength;
+		while (n > 0 && length - n < 16 && dst[n - 1] == 0x00)	n--;
+		if (n == 0 || length - n >= 16 || dst[n - 1] != 0x80)	return 0x04;
+		*dstLength = n - 1;
+	}
+
+	return 0x00;
+}
+
+//
+static PyObject* AESPy_New(PyTypeObject* type, PyObject* args, PyObject* kwargs) {
+	AESPY_OBJECT* self = (AESPY_OBJECT*)type->tp_alloc(type, 0);
+	if (self == NULL)	return NULL;
+
+	self->aes = new (std::nothrow) AES();
+	self->padding = AESPY_PKCS7;
+
+	if (self->aes == NULL) {
+		Py_DECREF(self);
+		return PyErr_NoMemory();
+	}
+
+	return (PyObject*)self;
+}
+
+//
+static void AESPy_Dealloc(AESPY_OBJECT* self) {
+	delete self->aes;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+//AES(key, padding)
+static int AESPy_Init(AESPY_OBJECT* self, PyObject* args, PyObject* kwargs) {
+	static const char* keywords[] = { "key", "padding", NULL };
+	PyObject* key;
+	PyObject* padding = NULL;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", (char**)keywords, &key, &padding))	return -1;
+
+	if (padding != NULL && !AESPy_ParsePadding(padding, &self->padding))	return -1;
+
+	return AESPy_SetKey(self->aes, key) ? 0 : -1;
+}
+
+//EncryptStream(stream, out=None)
+static PyObject* AESPy_EncryptStream(AESPY_OBJECT* self, PyObject* args, PyObject* kwargs) {
+	static const char* keywords[] = { "stream", "out", NULL };
+	PyObject* stream;
+	PyObject* out = Py_None;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", (char**)keywords, &stream, &out))	return NULL;
+
+	AESPY_BUFFER input, output;
+	if (!AESPy_GetInput(stream, &input)) {
+		AESPy_Release(&input);
+		return NULL;
+	}
+
+	const size_t length = (size_t)input.view.len;
+	const AESPY_PADDING padding = self->padding;
+
+	if (padding == AESPY_NOPAD && (length & 0x0F) != 0) {
+		AESPy_Release(&input);
+		PyErr_SetString(PyExc_ValueError, "AES EncryptStream: Stream length must be divisible with 16 without padding!");
+		return NULL;
+	}
+
+	const size_t size = AESPy_EncryptedSize(padding, length);
+	PyObject* result;
+	uint8_t* dst;
+
+	if (out == Py_None) {
+		result = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t)size);
+		dst = result != NULL ? (uint8_t*)PyByteArray_AS_STRING(result) : NULL;
+	}
+	else if (!AESPy_GetOutput(out, &output))
+		result = NULL, dst = NULL;
+	else if ((size_t)output.view.len < size) {
+		PyErr_Format(PyExc_ValueError, "AES EncryptStream: Output buffer is too small (%zu bytes needed)", size);
+		result = NULL, dst = NULL;
+	}
+	else {
+		result = PyLong_FromSize_t(size);
+		dst = (uint8_t*)output.view.buf;
+	}
+
+	if (result != NULL) {
+		const uint8_t* src = (const uint8_t*)input.view.buf;
+
+		//The cipher runs on a copy, so CalculateKeys or SetEngine from another thread can't change it midway
+		AES cipher = *self->aes;
+		int code;
+
+		if (length >= AESPY_GIL_MIN_SIZE) {
+			Py_BEGIN_ALLOW_THREADS
+			code = AESPy_Encrypt(cipher, padding, src, length, dst);
+			Py_END_ALLOW_THREADS
+		}
+		else
+			code = AESPy_Encrypt(cipher, padding, src, length, dst);
+
+		if (code != 0x00) {
+			PyErr_Format(PyExc_RuntimeError, "AES EncryptStream: Encryption failed (0x%02X)", code);
+			Py_CLEAR(result);
+		}
+	}
+
+	AESPy_Release(&output);
+	AESPy_Release(&input);
+	return result;
+}
+
+//DecryptStream(stream, padding=None, out=None)
+static PyObject* AESPy_DecryptStream(AESPY_OBJECT* self, PyObject* args, PyObject* kwargs) {
+	static const char* keywords[] = { "stream", "padding", "out", NULL };
+	PyObject* stream;
+	PyObject* paddingName = Py_None;
+	PyObject* out = Py_None;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OO", (char**)keywords, &stream, &paddingName, &out))	return NULL;
+
+	AESPY_PADDING padding = self->padding;
+	if (paddingName != Py_None && !AESPy_ParsePadding(paddingName, &padding))	return NULL;
+
+	AESPY_BUFFER input, output;
+	if (!AESPy_GetInput(stream, &input)) {
+		AESPy_Release(&input);
+		return NULL;
+	}
+
+	const size_t length = (size_t)input.view.len;
+
+	if ((length & 0x0F) != 0 || (length == 0 && padding != AESPY_NOPAD)) {
+		AESPy_Release(&input);
+		PyErr_SetString(PyExc_ValueError, "AES DecryptStream: Stream length must be divisible with 16!");
+		return NULL;
+	}
+
+	//The padding is decrypted too, so the output needs the whole input length
+	PyObject* result = NULL;
+	uint8_t* dst = NULL;
+
+	if (out == Py_None) {
+		result = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t)length);
+		dst = result != NULL ? (uint8_t*)PyByteArray_AS_STRING(result) : NULL;
+	}
+	else if (AESPy_GetOutput(out, &output)) {
+		if ((size_t)output.view.len < length)
+			PyErr_Format(PyExc_ValueError, "AES DecryptStream: Output buffer is too small (%zu bytes needed)", length);
+		else
+			dst = (uint8_t*)output.view.buf;
+	}
+
+	if (dst != NULL) {
+		const uint8_t* src = (const uint8_t*)input.view.buf;
+		AES cipher = *self->aes;
+		size_t dstLength = 0;
+		int code;
+
+		if (length >= AESPY_GIL_MIN_SIZE) {
+			Py_BEGIN_ALLOW_THREADS
+			code = AESPy_Decrypt(cipher, padding, src, length, dst, &dstLength);
+			Py_END_ALLOW_THREADS
+		}
+		else
+			code = AESPy_Decrypt(cipher, padding, src, length, dst, &dstLength);
+
+		if (code == 0x04) {
+			PyErr_SetString(PyExc_ValueError, "AES DecryptStream: Bad padding!");
+			Py_CLEAR(result);
+		}
+		else if (code != 0x00) {
+			PyErr_Format(PyExc_RuntimeError, "AES DecryptStream: Decryption failed (0x%02X)", code);
+			Py_CLEAR(result);
+		}
+		else if (result == NULL)
+			result = PyLong_FromSize_t(dstLength);
+		else if (PyByteArray_Resize(result, (Py_ssize_t)dstLength) != 0)
+			Py_CLEAR(result);
+	}
+	else
+		Py_CLEAR(result);
+
+	AESPy_Release(&output);
+	AESPy_Release(&input);
+	return result;
+}
+
+//EncryptBlock(rawBlock): one block, a shorter one is padded
+static PyObject* AESPy_EncryptBlock(AESPY_OBJECT* self, PyObject* block) {
+	AESPY_BUFFER input;
+	if (!AESPy_GetInput(block, &input)) {
+		AESPy_Release(&input);
+		return NULL;
+	}
+
+	size_t length = (size_t)input.view.len;
+	uint8_t state[16] = { 0 };
+	memcpy(state, input.view.buf, length < 16 ? length : 16);
+	AESPy_Release(&input);
+
+	if (length > 16) {
+		PyErr_SetString(PyExc_ValueError, "AES EncryptBlock: Block length cannot be greater than 16!");
+		return NULL;
+	}
+
+	if (length < 16) {
+		switch (self->padding) {
+		case AESPY_NOPAD:
+			PyErr_SetString(PyExc_ValueError, "AES EncryptBlock: Block length is less than 16 bytes! Please enable padding!");
+			return NULL;
+		case AESPY_PKCS7:
+			memset(state + length, (int)(16 - length), 16 - length);
+			break;
+		case AESPY_979712:
+			state[length] = 0x80;
+			break;
+		default:
+			break;
+		}
+	}
+
+	self->aes->EncryptBlock(state);
+	return PyByteArray_FromStringAndSize((const char*)state, 16);
+}
+
+//DecryptBlock(cipherBlock)
+static PyObject* AESPy_DecryptBlock(AESPY_OBJECT* self, PyObject* block) {
+	AESPY_BUFFER input;
+	if (!AESPy_GetInput(block, &input)) {
+		AESPy_Release(&input);
+		return NULL;
+	}
+
+	if (input.view.len != 16) {
+		AESPy_Release(&input);
+		PyErr_SetString(PyExc_ValueError, "AES DecryptBlock: Block length must be 16!");
+		return NULL;
+	}
+
+	uint8_t state[16];
+	memcpy(state, input.view.buf, 16);
+	AESPy_Release(&input);
+
+	self->aes->DecryptBlock(state);
+	return PyByteArray_FromStringAndSize((const char*)state, 16);
+}
+
+//CalculateKeys(key): change the key
+static PyObject* AESPy_CalculateKeys(AESPY_OBJECT* self, PyObject* key) {
+	if (!AESPy_SetKey(self->aes, key))	return NULL;
+	Py_RETURN_NONE;
+}
+
+//GetEncryptedSize(length): ciphertext length with the current padding (size of an out buffer)
+static PyObject* AESPy_GetEncryptedSize(AESPY_OBJECT* self, PyObject* length) {
+	size_t n = PyLong_AsSize_t(length);
+	if (n == (size_t)-1 && PyErr_Occurred())	return NULL;
+	return PyLong_FromSize_t(AESPy_EncryptedSize(self->padding, n));
+}
+
+//SetEngine(name): "reference", "ttable", "aesni" or "bitslice"
+static PyObject* AESPy_SetEngine(AESPY_OBJECT* self, PyObject* name) {
+	const char* text = PyUnicode_Check(name) ? PyUnicode_AsUTF8(name) : NULL;
+
+	for (size_t i = 0; text != NULL && i < sizeof(engineNames) / sizeof(engineNames[0]); i++) {
+		if (strcmp(text, engineNames[i]) == 0) {
+			if (self->aes->SetEngine((AES_ENGINE)i))	Py_RETURN_NONE;
+			PyErr_Format(PyExc_ValueError, "AES SetEngine: %s is not supported by this CPU", text);
+			return NULL;
+		}
+	}
+
+	PyErr_Clear();
+	PyErr_SetString(PyExc_KeyError, "AES SetEngine: Unknown engine!");
+	return NULL;
+}
+
+//
+static PyObject* AESPy_GetEngine(AESPY_OBJECT* self, PyObject* unused) {
+	return PyUnicode_FromString(engineNames[self->aes->GetEngine()]);
+}
+
+//SetThreadNum(threads): OpenMP threads of one large stream (0: OpenMP default, 1: single-threaded)
+static PyObject* AESPy_SetThreadNum(AESPY_OBJECT* self, PyObject* threads) {
+	long n = PyLong_AsLong(threads);
+	if (n == -1 && PyErr_Occurred())	return NULL;
+	self->aes->SetThreadNum((int)n);
+	Py_RETURN_NONE;
+}
+
+//PADDING: padding name, assigning checks it like __init__
+static PyObject* AESPy_GetPadding(AESPY_OBJECT* self, void* closure) {
+	for (size_t i = 0; i < sizeof(paddingNames) / sizeof(paddingNames[0]); i++)
+		if (paddingNames[i].padding == self->padding)	return PyUnicode_FromString(paddingNames[i].name);
+	Py_RETURN_NONE;
+}
+
+//
+static int AESPy_SetPadding(AESPY_OBJECT* self, PyObject* value, void* closure) {
+	if (value == NULL) {
+		PyErr_SetString(PyExc_AttributeError, "AES: PADDING can't be deleted");
+		return -1;
+	}
+	return AESPy_ParsePadding(value, &self->padding) ? 0 : -1;
+}
+
+//
+static PyObject* AESPy_GetKeySize(AESPY_OBJECT* self, void* closure) {
+	std::shared_ptr<const AESKeySchedule> schedule = self->aes->GetKeySchedule();
+	return PyLong_FromLong(schedule ? (schedule->GetRounds() - 6) * 4 : 0);
+}
+
+//CRYPTO_KEX[stage][i][j]: byte j * 4 + i of the round key (same layout as aes_class.py), read only
+static PyObject* AESPy_GetKeyStages(AESPY_OBJECT* self, void* closure) {
+	std::shared_ptr<const AESKeySchedule> schedule = self->aes->GetKeySchedule();
+	if (!schedule)	return PyList_New(0);
+
+	const uint8_t* keys = schedule->GetRoundKeys();
+	const int stages = schedule->GetRounds() + 1;
+
+	PyObject* result = PyList_New(stages);
+	for (int s = 0; result != NULL && s < stages; s++) {
+		PyObject* stage = PyList_New(4);
+		for (int i = 0; stage != NULL && i < 4; i++) {
+			PyObject* row = Py_BuildValue("[iiii]", keys[s * 16 + i], keys[s * 16 + 4 + i], keys[s * 16 + 8 + i], keys[s * 16 + 12 + i]);
+			if (row == NULL)	Py_CLEAR(stage);
+			else				PyList_SET_ITEM(stage, i, row);
+		}
+		if (stage == NULL)	Py_CLEAR(result);
+		else				PyList_SET_ITEM(result, s, stage);
+	}
+	return result;
+}
+
+//SupportedEngines(): engines this CPU can run
+static PyObject* AESPy_SupportedEngines(PyObject* module, PyObject* unused) {
+	PyObject* result = PyList_New(0);
+	AES probe;
+
+	for (size_t i = 0; result != NULL && i < sizeof(engineNames) / sizeof(engineNames[0]); i++) {
+		if (!probe.SetEngine((AES_ENGINE)i))	continue;
+		PyObject* name = PyUnicode_FromString(engineNames[i]);
+		if (name == NULL || PyList_Append(result, name) != 0)	Py_CLEAR(result);
+		Py_XDECREF(name);
+	}
+	return result;
+}
+
+static PyMethodDef aesMethods[] = {
+	{ "EncryptStream", (PyCFunction)(void(*)(void))AESPy_EncryptStream, METH_VARARGS | METH_KEYWORDS, "EncryptStream(stream, out=None)\n\nEncrypt and pad with PADDING. Returns a bytearray, or the length written into out." },
+	{ "DecryptStream", (PyCFunction)(void(*)(void))AESPy_DecryptStream, METH_VARARGS | METH_KEYWORDS, "DecryptStream(stream, padding=None, out=None)\n\nDecrypt and remove the padding (PADDING if None). Returns a bytearray, or the plaintext length written into out (len(stream) bytes needed)." },
+	{ "EncryptBlock", (PyCFunction)AESPy_EncryptBlock, METH_O, "EncryptBlock(rawBlock)\n\nEncrypt one block, a block shorter than 16 bytes is padded." },
+	{ "DecryptBlock", (PyCFunction)AESPy_DecryptBlock, METH_O, "DecryptBlock(cipherBlock)\n\nDecrypt one 16 byte block." },
+	{ "CalculateKeys", (PyCFunction)AESPy_CalculateKeys, METH_O, "CalculateKeys(key)\n\nExpand a new 16, 24 or 32 byte key." },
+	{ "GetEncryptedSize", (PyCFunction)AESPy_GetEncryptedSize, METH_O, "GetEncryptedSize(length)\n\nCiphertext length of a plaintext with the current padding." },
+	{ "SetEngine", (PyCFunction)AESPy_SetEngine, METH_O, "SetEngine(name)\n\nSelect the round engine: reference, ttable, aesni or bitslice." },
+	{ "GetEngine", (PyCFunction)AESPy_GetEngine, METH_NOARGS, "GetEngine()\n\nName of the round engine in use." },
+	{ "SetThreadNum", (PyCFunction)AESPy_SetThreadNum, METH_O, "SetThreadNum(threads)\n\nThreads of one large stream (0: OpenMP default, 1: single-threaded)." },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef aesGetSet[] = {
+	{ "PADDING", (getter)AESPy_GetPadding, (setter)AESPy_SetPadding, "Padding method (a key of PADLIST)", NULL },
+	{ "KEY_SIZE", (getter)AESPy_GetKeySize, NULL, "Key length in bytes", NULL },
+	{ "CRYPTO_KEX", (getter)AESPy_GetKeyStages, NULL, "Round keys (read only)", NULL },
+	{ NULL, NULL, NULL, NULL, NULL }
+};
+
+static PyTypeObject aesType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+};
+
+static PyMethodDef moduleMethods[] = {
+	{ "SupportedEngines", (PyCFunction)AESPy_SupportedEngines, METH_NOARGS, "SupportedEngines()\n\nRound engines this CPU can run." },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PyModuleDef aesModule = {
+	PyModuleDef_HEAD_INIT,
+	"aes_native",
+	"AES on the C++ engines, interface of aes_class.AES",
+	-1,
+	moduleMethods
+};
+
+//
+PyMODINIT_FUNC PyInit_aes_native(void) {
+	aesType.tp_name = "aes_native.AES";
+	aesType.tp_basicsize = sizeof(AESPY_OBJECT);
+	aesType.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE;
+	aesType.tp_doc = "AES(key, padding)\n\nAES-ECB with the C++ engines (key: 16, 24 or 32 byte str or bytes, padding: a key of PADLIST)";
+	aesType.tp_new = AESPy_New;
+	aesType.tp_init = (initproc)AESPy_Init;
+	aesType.tp_dealloc = (destructor)AESPy_Dealloc;
+	aesType.tp_methods = aesMethods;
+	aesType.tp_getset = aesGetSet;
+
+	if (PyType_Ready(&aesType) != 0)	return NULL;
+
+	//Class attributes of aes_class.AES
+	PyObject* padList = PyDict_New();
+	for (size_t i = 0; padList != NULL && i < sizeof(paddingNames) / sizeof(paddingNames[0]); i++) {
+		PyObject* value = PyLong_FromLong(paddingNames[i].padding);
+		if (value == NULL || PyDict_SetItemString(padList, paddingNames[i].name, value) != 0)	Py_CLEAR(padList);
+		Py_XDECREF(value);
+	}
+	if (padList == NULL || PyDict_SetItemString(aesType.tp_dict, "PADLIST", padList) != 0 || PyDict_SetItemString(aesType.tp_dict, "REMOVE_PAD", Py_True) != 0) {
+		Py_XDECREF(padList);
+		return NULL;
+	}
+	Py_DECREF(padList);
+	PyType_Modified(&aesType);
+
+	PyObject* module = PyModule_Create(&aesModule);
+	if (module == NULL)		return NULL;
+
+	Py_INCREF(&aesType);
+	if (PyModule_AddObject(module, "AES", (PyObject*)&aesType) != 0) {
+		Py_DECREF(&aesType);
+		Py_DECREF(module);
+		return NULL;
+	}
+
+	return module;
+}